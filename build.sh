@@ -3,17 +3,9 @@
 # this must match the entry in run.sh
 BUILD_FOLDER="./build"
 
-# default architecture
-ARCH=INTEL
-
-# parse first arg
-if [ -z "$1" ]
-then
-  echo "[-] Missing first argument representing target architecture [INTEL/AMD]. Aborting."
-  exit 1
-else
-  ARCH=$1
-fi
+# optional first arg representing the target architecture [INTEL/AMD]
+# (without it the timer is selected at runtime)
+ARCH=$1
 
 # save src directory
 pushd . 
@@ -24,7 +16,7 @@ cd $DIR
 
 mkdir $BUILD_FOLDER | true
 cd $BUILD_FOLDER
-cmake .. -DARCH=${ARCH}
+cmake .. -DARCH="${ARCH}"
 make -j 5
 cd ..
 
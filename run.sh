@@ -78,6 +78,8 @@ cd $BUILD_FOLDER
 # cleanup instruction file
 echo "[+] Removing faulting instructions from the instruction set..."
 ./osiris --cleanup
+# compile the cleaned instruction file such that all following runs map it instead of parsing it
+./osiris --compile-isa
 
 if [ "$all" = true ]
 then
@@ -95,20 +97,28 @@ then
   echo ""
   # filter out cache-related side channels
   ./osiris --filter ./${output_base_filename}.csv
-  taskset -c $CPU_NO ./osiris --confirm ./${output_base_filename}_nocache.csv ./${output_base_filename}_confirmed_iter1.csv
+  taskset -c $CPU_NO ./osiris --confirm ./${output_base_filename}_nocache.csv ./${output_base_filename}_confirmed.csv
 else
   echo ""
   # do not filter out cache-related side channels
-  taskset -c $CPU_NO ./osiris --confirm ./${output_base_filename}.csv ./${output_base_filename}_confirmed_iter1.csv
+  taskset -c $CPU_NO ./osiris --confirm ./${output_base_filename}.csv ./${output_base_filename}_confirmed.csv
+fi
+# a single confirmation round suffices as the samples are interleaved (see --sample-order)
+confirmed_filename="${output_base_filename}_confirmed_cleaned"
+if [ "$all" = true ]
+then
+  # exception: the search without assumptions compares against cached baselines which are not
+  # paired with the samples of the trigger sequence, hence its results get a second round
+  taskset -c $CPU_NO ./osiris --confirm ./${confirmed_filename}.csv ./${output_base_filename}_confirmed_iter2.csv
+  confirmed_filename="${output_base_filename}_confirmed_iter2_cleaned"
 fi
-taskset -c $CPU_NO ./osiris --confirm ./${output_base_filename}_confirmed_iter1_cleaned.csv ./${output_base_filename}_confirmed_iter2.csv
 
 # apply filters on final result
-./osiris --filter ./${output_base_filename}_confirmed_iter2_cleaned.csv
+./osiris --filter ./${confirmed_filename}.csv
 
 # print results before and after filtering
 result_no_before_confirmation=`cat ${output_base_filename}.csv | wc -l`
-result_no_after_confirmation=`cat ${output_base_filename}_confirmed_iter2_cleaned.csv | wc -l`
+result_no_after_confirmation=`cat ${confirmed_filename}.csv | wc -l`
 # substract headerlines
 result_no_before_confirmation=$(($result_no_before_confirmation - 1))
 result_no_after_confirmation=$(($result_no_after_confirmation - 1))
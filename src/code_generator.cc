@@ -15,11 +15,21 @@
 
 #include "code_generator.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <fstream>
+#include <iterator>
 #include <sstream>
-#include <iomanip>
+#include <unordered_map>
+#include <utility>
 
 #include "logger.h"
 #include "utils.h"
@@ -44,14 +54,347 @@ std::string x86Instruction::GetCSVRepresentation() const {
   return line.str();
 }
 
+uint64_t x86Sequence::GetSequenceUID() const {
+  return CalculateHashFNV1a(byte_representation.data(), byte_representation.size());
+}
+
+std::string x86Sequence::GetUIDString() const {
+  std::stringstream uid_string;
+  uid_string << std::hex;
+  for (size_t i = 0; i < instruction_uids.size(); i++) {
+    if (i > 0) {
+      uid_string << kSequenceUIDSeparator;
+    }
+    uid_string << instruction_uids[i];
+    if (operand_variants[i] != 0) {
+      uid_string << kOperandVariantSeparator << std::dec << operand_variants[i] << std::hex;
+    }
+  }
+  return uid_string.str();
+}
+
+std::string x86Sequence::GetCSVRepresentation() const {
+  std::stringstream line;
+  line << GetUIDString();
+  line << ";";
+
+  line << assembly_code;
+  line << ";";
+
+  line << category;
+  line << ";";
+
+  line << extension;
+  line << ";";
+
+  line << isa_set;
+  return line.str();
+}
+
+size_t SequenceSpace::GetNumberOfSequences() const {
+  if (position_candidates.empty()) {
+    return 0;
+  }
+  size_t no_sequences = 1;
+  for (const std::vector<size_t>& candidates : position_candidates) {
+    if (candidates.empty()) {
+      return 0;
+    }
+    // CreateSequenceSpace rejects spaces whose size does not fit
+    assert(no_sequences <= SIZE_MAX / candidates.size());
+    no_sequences *= candidates.size();
+  }
+  return no_sequences;
+}
+
+// bump whenever the layout of the instruction database changes
+constexpr uint32_t kInstructionDatabaseVersion = 2;
+constexpr char kInstructionDatabaseMagic[8] = {'O', 'S', 'I', 'R', 'I', 'S', 'D', 'B'};
+
+// all sections start at a multiple of this to allow direct access to the mapped database
+constexpr size_t kDatabaseSectionAlignment = 8;
+
+///
+/// location of one array of the instruction table in the database
+///
+struct DatabaseSection {
+  uint64_t offset;  // relative to the beginning of the database
+  uint64_t size;  // in bytes
+};
+
+///
+/// header of the instruction database, followed by the sections it describes
+///
+struct InstructionDatabaseHeader {
+  char magic[sizeof(kInstructionDatabaseMagic)];
+  uint32_t version;
+  uint32_t no_instructions;
+  uint32_t no_metadata_strings;
+  uint32_t reserved;
+  uint64_t database_size;
+  uint64_t checksum;  // FNV-1a hash of everything behind the header
+  DatabaseSection instruction_uids;
+  DatabaseSection uid_index;
+  DatabaseSection byte_offsets;
+  DatabaseSection byte_arena;
+  DatabaseSection assembly_offsets;
+  DatabaseSection assembly_arena;
+  DatabaseSection category_ids;
+  DatabaseSection extension_ids;
+  DatabaseSection isa_set_ids;
+  DatabaseSection instruction_flags;
+  DatabaseSection metadata_offsets;
+  DatabaseSection metadata_arena;
+};
+static_assert(sizeof(InstructionDatabaseHeader) % kDatabaseSectionAlignment == 0);
+
+/// Derives the UID of an instruction from its encoding. Hence, the UID stays valid when the
+/// instruction file changes. Instructions with the same encoding would share their UID, hence
+/// only the first one of them is kept in the instruction table.
+static uint64_t GenerateInstructionUID(const byte_array& byte_representation) {
+  return CalculateHashFNV1a(byte_representation.data(), byte_representation.size());
+}
+
+/// Returns the first slot of the UID in the open-addressing UID index
+static size_t GetUIDIndexSlot(uint64_t instruction_uid, size_t index_capacity) {
+  // the FNV-1a hash is mixed well enough to use its lowest bits directly
+  return instruction_uid & (index_capacity - 1);
+}
+
+/// Derives the flags of an instruction from its assembly code and category
+static uint32_t ComputeInstructionFlags(const std::string& assembly_code,
+                                        const std::string& category) {
+  uint32_t flags = 0;
+  if (assembly_code == "busy-sleep" ||
+      assembly_code == "short-busy-sleep" ||
+      assembly_code == "sleep-syscall") {
+    flags |= kInstructionIsSleep;
+  }
+
+  // explicit memory operands are always written as [...]; the remaining categories access the
+  // stack or the string operands implicitly
+  if (assembly_code.find('[') != std::string::npos ||
+      category == "PUSH" || category == "POP" ||
+      category == "STRINGOP" || category == "IOSTRINGOP") {
+    flags |= kInstructionTouchesMemory;
+  }
+
+  std::string mnemonic = assembly_code.substr(0, assembly_code.find(' '));
+  if (mnemonic.rfind("PREFETCH", 0) == 0 ||
+      mnemonic == "CLFLUSH" || mnemonic == "CLFLUSHOPT" || mnemonic == "CLWB" ||
+      mnemonic == "CLDEMOTE" || mnemonic == "INVD" || mnemonic == "WBINVD" ||
+      mnemonic == "WBNOINVD") {
+    flags |= kInstructionIsCacheOperation;
+  }
+  return flags;
+}
+
+///
+/// Collects the instructions of an instruction file and packs them into the database format
+///
+class InstructionTableBuilder {
+ public:
+  void AddInstruction(const byte_array& byte_representation,
+                      const std::string& assembly_code, const std::string& category,
+                      const std::string& extension, const std::string& isa_set) {
+    uint64_t instruction_uid = GenerateInstructionUID(byte_representation);
+    auto [first_instruction, inserted] =
+        first_instruction_of_uid_.try_emplace(instruction_uid, instruction_uids_.size());
+    if (!inserted) {
+      if (!HasBytes(first_instruction->second, byte_representation)) {
+        LOG_ERROR("UID collision between the instructions '" + assembly_code + "' and '" +
+            assembly_arena_.substr(assembly_offsets_[first_instruction->second],
+                                   assembly_offsets_[first_instruction->second + 1] -
+                                       assembly_offsets_[first_instruction->second]) +
+            "'. Aborting!");
+        std::exit(1);
+      }
+      // the same encoding would be tested twice under the same UID; lookups by UID resolve
+      // to the first instruction anyway
+      no_duplicates_++;
+      return;
+    }
+    instruction_uids_.push_back(instruction_uid);
+    byte_arena_.insert(byte_arena_.end(), byte_representation.begin(),
+                       byte_representation.end());
+    byte_offsets_.push_back(byte_arena_.size());
+    assembly_arena_ += assembly_code;
+    assembly_offsets_.push_back(assembly_arena_.size());
+    category_ids_.push_back(InternMetadata(category));
+    extension_ids_.push_back(InternMetadata(extension));
+    isa_set_ids_.push_back(InternMetadata(isa_set));
+    instruction_flags_.push_back(ComputeInstructionFlags(assembly_code, category));
+  }
+
+  /// \return number of instructions that were dropped as their encoding was already added
+  size_t GetNumberOfDuplicates() const {
+    return no_duplicates_;
+  }
+
+  /// Creates the database image (uint64_t elements to align it for direct access)
+  /// \return image; the database size is stored in its header
+  std::vector<uint64_t> BuildImage() const {
+    InstructionDatabaseHeader header{};
+    std::copy(std::begin(kInstructionDatabaseMagic), std::end(kInstructionDatabaseMagic),
+              header.magic);
+    header.version = kInstructionDatabaseVersion;
+    header.no_instructions = instruction_uids_.size();
+    header.no_metadata_strings = metadata_strings_.size();
+
+    std::string metadata_arena;
+    std::vector<uint32_t> metadata_offsets{0};
+    for (const std::string& metadata : metadata_strings_) {
+      metadata_arena += metadata;
+      metadata_offsets.push_back(metadata_arena.size());
+    }
+
+    // open-addressing hash index from the UID to the instruction with that UID
+    // (slots hold the instruction index + 1; 0 marks an empty slot)
+    size_t index_capacity = 1;
+    while (index_capacity < 2 * instruction_uids_.size()) {
+      index_capacity *= 2;
+    }
+    std::vector<uint32_t> uid_index(index_capacity, 0);
+    for (const auto& [instruction_uid, instruction_idx] : first_instruction_of_uid_) {
+      size_t slot = GetUIDIndexSlot(instruction_uid, index_capacity);
+      while (uid_index[slot] != 0) {
+        slot = (slot + 1) & (index_capacity - 1);
+      }
+      uid_index[slot] = instruction_idx + 1;
+    }
+
+    // layout: header followed by the aligned sections
+    std::vector<std::pair<DatabaseSection*, const void*>> sections;
+    uint64_t database_size = sizeof(header);
+    auto add_section = [&](DatabaseSection* section, const void* data, size_t size) {
+      database_size = (database_size + kDatabaseSectionAlignment - 1) /
+          kDatabaseSectionAlignment * kDatabaseSectionAlignment;
+      *section = DatabaseSection{database_size, size};
+      sections.emplace_back(section, data);
+      database_size += size;
+    };
+    add_section(&header.instruction_uids, instruction_uids_.data(),
+                instruction_uids_.size() * sizeof(uint64_t));
+    add_section(&header.uid_index, uid_index.data(), uid_index.size() * sizeof(uint32_t));
+    add_section(&header.byte_offsets, byte_offsets_.data(),
+                byte_offsets_.size() * sizeof(uint32_t));
+    add_section(&header.byte_arena, byte_arena_.data(), byte_arena_.size());
+    add_section(&header.assembly_offsets, assembly_offsets_.data(),
+                assembly_offsets_.size() * sizeof(uint32_t));
+    add_section(&header.assembly_arena, assembly_arena_.data(), assembly_arena_.size());
+    add_section(&header.category_ids, category_ids_.data(),
+                category_ids_.size() * sizeof(uint32_t));
+    add_section(&header.extension_ids, extension_ids_.data(),
+                extension_ids_.size() * sizeof(uint32_t));
+    add_section(&header.isa_set_ids, isa_set_ids_.data(),
+                isa_set_ids_.size() * sizeof(uint32_t));
+    add_section(&header.instruction_flags, instruction_flags_.data(),
+                instruction_flags_.size() * sizeof(uint32_t));
+    add_section(&header.metadata_offsets, metadata_offsets.data(),
+                metadata_offsets.size() * sizeof(uint32_t));
+    add_section(&header.metadata_arena, metadata_arena.data(), metadata_arena.size());
+    header.database_size = database_size;
+
+    std::vector<uint64_t> image((database_size + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+    auto* image_bytes = reinterpret_cast<char*>(image.data());
+    for (const auto& [section, data] : sections) {
+      std::copy_n(static_cast<const char*>(data), section->size, image_bytes + section->offset);
+    }
+    header.checksum = CalculateHashFNV1a(image_bytes + sizeof(header),
+                                         database_size - sizeof(header));
+    std::copy_n(reinterpret_cast<const char*>(&header), sizeof(header), image_bytes);
+    return image;
+  }
+
+ private:
+  bool HasBytes(size_t instruction_idx, const byte_array& byte_representation) const {
+    return std::equal(byte_arena_.begin() + byte_offsets_[instruction_idx],
+                      byte_arena_.begin() + byte_offsets_[instruction_idx + 1],
+                      byte_representation.begin(), byte_representation.end());
+  }
+
+  uint32_t InternMetadata(const std::string& metadata) {
+    auto [entry, inserted] = metadata_ids_.try_emplace(metadata, metadata_strings_.size());
+    if (inserted) {
+      metadata_strings_.push_back(metadata);
+    }
+    return entry->second;
+  }
+
+  std::vector<uint64_t> instruction_uids_;
+  byte_array byte_arena_;
+  std::vector<uint32_t> byte_offsets_{0};
+  std::string assembly_arena_;
+  std::vector<uint32_t> assembly_offsets_{0};
+  std::vector<uint32_t> category_ids_;
+  std::vector<uint32_t> extension_ids_;
+  std::vector<uint32_t> isa_set_ids_;
+  std::vector<uint32_t> instruction_flags_;
+  std::vector<std::string> metadata_strings_;
+  std::unordered_map<std::string, uint32_t> metadata_ids_;
+  std::unordered_map<uint64_t, uint32_t> first_instruction_of_uid_;
+  size_t no_duplicates_ = 0;
+};
+
+/// Checks that a section lies within the database and holds the expected number of elements
+static bool IsValidSection(const DatabaseSection& section, size_t database_size,
+                           size_t expected_size) {
+  return section.offset % kDatabaseSectionAlignment == 0 &&
+      section.offset <= database_size &&
+      section.size <= database_size - section.offset &&
+      section.size == expected_size;
+}
+
+/// Checks that the UID index has a power-of-two capacity with empty slots (which terminate every
+/// lookup) and only refers to existing instructions
+static bool IsValidUIDIndex(const uint32_t* uid_index, size_t index_capacity,
+                            size_t no_instructions) {
+  if (index_capacity == 0 || (index_capacity & (index_capacity - 1)) != 0) {
+    return false;
+  }
+  size_t no_empty_slots = 0;
+  for (size_t slot = 0; slot < index_capacity; slot++) {
+    if (uid_index[slot] == 0) {
+      no_empty_slots++;
+    } else if (uid_index[slot] > no_instructions) {
+      return false;
+    }
+  }
+  return no_empty_slots > 0;
+}
+
+/// Checks that an offset table is monotonic and ends at the end of its arena
+static bool IsValidOffsetTable(const uint32_t* offsets, size_t no_entries, size_t arena_size) {
+  if (offsets[0] != 0 || offsets[no_entries] != arena_size) {
+    return false;
+  }
+  for (size_t i = 0; i < no_entries; i++) {
+    if (offsets[i] > offsets[i + 1]) {
+      return false;
+    }
+  }
+  return true;
+}
+
 CodeGenerator::CodeGenerator(const std::string& instructions_filename) {
   // seed rng
   unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
   rand_generator_ = std::default_random_engine(seed);
 
-  // calculate hash of the instruction file (required for instruction UID)
-  instruction_file_sha256hash_ = CalculateFileHashSHA256(instructions_filename);
+  if (MapDatabase(instructions_filename)) {
+    LOG_DEBUG("Mapped instruction database " + instructions_filename);
+  } else {
+    ParseInstructionFile(instructions_filename);
+  }
+}
+
+CodeGenerator::~CodeGenerator() {
+  if (database_mapping_ != nullptr) {
+    munmap(database_mapping_, database_mapping_size_);
+  }
+}
 
+void CodeGenerator::ParseInstructionFile(const std::string& instructions_filename) {
   // load instructions from file
   std::ifstream istream(instructions_filename);
   if (!istream.is_open()) {
@@ -67,59 +410,183 @@ CodeGenerator::CodeGenerator(const std::string& instructions_filename) {
     std::exit(1);
   }
 
-  uint64_t instruction_idx = 0;
+  InstructionTableBuilder table_builder;
   while (std::getline(istream, line)) {
     std::vector<std::string> line_splitted = SplitString(line, ';');
     if (line_splitted.size() != 5) {
       LOG_ERROR("Mismatch of line format in instruction file. Aborting!");
       std::abort();
     }
-    x86Instruction instruction{
-        GenerateInstructionUID(instruction_idx),
-        base64_decode(line_splitted[0]),
-        line_splitted[1],
-        line_splitted[2],
-        line_splitted[3],
-        line_splitted[4]
-    };
-    instruction_list_.push_back(instruction);
-    instruction_idx++;
-  }
-}
-
-uint64_t CodeGenerator::GenerateInstructionUID(size_t instruction_idx) {
-  // the filehash defaults to empty, hence we need to generate the corresponding instruction file
-  // hash before calling this function
-  assert(!instruction_file_sha256hash_.empty());
-  assert(instruction_idx <= 65535);  // idx < 2**16
-
-  // uid = the last 4 hex chars (last 2 bytes of the instruction file hash) + instruction_idx
-  std::string end_of_hash = instruction_file_sha256hash_.substr(
-      instruction_file_sha256hash_.size() - 4,
-      instruction_file_sha256hash_.size());
-  uint64_t end_of_hash_integer = std::stoi(end_of_hash, nullptr, 16);
-  uint64_t instruction_uid = (end_of_hash_integer << 16) + instruction_idx;
-  return instruction_uid;
-}
-
-size_t CodeGenerator::InstructionUIDToInstructionIndex(uint64_t instruction_uid) {
-  // check whether the correct instruction file is used (last 2 byte of hash are encoded in UID)
-  std::stringstream instructionfile_end_of_hash_uid;
-  instructionfile_end_of_hash_uid << std::setw(4) << std::setfill('0') << std::hex
-                                  << ((instruction_uid >> 16) & 0xffff);
-  std::string instructionfile_end_of_hash_loaded = instruction_file_sha256hash_.substr(
-      instruction_file_sha256hash_.size() - 4,
-      instruction_file_sha256hash_.size());
-  if (instructionfile_end_of_hash_uid.str() != instructionfile_end_of_hash_loaded) {
-    LOG_ERROR("UID was not generated using this instruction file. "
-              "Maybe the instruction file has changed in the meantime. Aborting!");
-    LOG_ERROR("expected UID beginning: " + instructionfile_end_of_hash_loaded);
-    LOG_ERROR("got UID beginning: " + instructionfile_end_of_hash_uid.str());
+    table_builder.AddInstruction(base64_decode(line_splitted[0]),
+                                 line_splitted[1],
+                                 line_splitted[2],
+                                 line_splitted[3],
+                                 line_splitted[4]);
+  }
+
+  if (table_builder.GetNumberOfDuplicates() > 0) {
+    LOG_DEBUG("Dropped " + std::to_string(table_builder.GetNumberOfDuplicates()) +
+        " instructions with duplicate encodings from " + instructions_filename);
+  }
+  table_storage_ = table_builder.BuildImage();
+  const auto* image = reinterpret_cast<const std::byte*>(table_storage_.data());
+  if (!AttachTable(image,
+                   reinterpret_cast<const InstructionDatabaseHeader*>(image)->database_size)) {
+    LOG_ERROR("Failed to build the instruction table of " + instructions_filename + ". Aborting!");
+    std::exit(1);
+  }
+}
+
+bool CodeGenerator::MapDatabase(const std::string& database_filename) {
+  int fd = open(database_filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  char magic[sizeof(kInstructionDatabaseMagic)];
+  struct stat file_status{};
+  if (read(fd, magic, sizeof(magic)) != sizeof(magic) ||
+      !std::equal(std::begin(magic), std::end(magic), std::begin(kInstructionDatabaseMagic)) ||
+      fstat(fd, &file_status) != 0) {
+    close(fd);
+    return false;
+  }
+
+  // the mapping is shared, hence all processes using the database share its page cache copy
+  size_t database_size = file_status.st_size;
+  void* mapping = mmap(nullptr, database_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    LOG_ERROR("Could not map instruction database " + database_filename + ". Aborting!");
     std::exit(1);
   }
+  database_mapping_ = mapping;
+  database_mapping_size_ = database_size;
+
+  if (!AttachTable(static_cast<const std::byte*>(mapping), database_size)) {
+    LOG_ERROR("Instruction database " + database_filename + " is corrupted or was created by a "
+              "different version of osiris. Recreate it with --compile-isa. Aborting!");
+    std::exit(1);
+  }
+  return true;
+}
 
-  // lowest 2 byte encode the instruction index (see CodeGenerator::GenerateInstructionUID)
-  return instruction_uid & 0xffff;
+bool CodeGenerator::AttachTable(const std::byte* image, size_t image_size) {
+  if (image_size < sizeof(InstructionDatabaseHeader)) {
+    return false;
+  }
+  const auto* header = reinterpret_cast<const InstructionDatabaseHeader*>(image);
+  if (!std::equal(std::begin(header->magic), std::end(header->magic),
+                  std::begin(kInstructionDatabaseMagic)) ||
+      header->version != kInstructionDatabaseVersion ||
+      header->database_size != image_size ||
+      header->checksum != CalculateHashFNV1a(image + sizeof(InstructionDatabaseHeader),
+                                             image_size - sizeof(InstructionDatabaseHeader))) {
+    return false;
+  }
+
+  size_t no_instructions = header->no_instructions;
+  size_t no_metadata_strings = header->no_metadata_strings;
+  if (!IsValidSection(header->instruction_uids, image_size, no_instructions * sizeof(uint64_t)) ||
+      !IsValidSection(header->uid_index, image_size, header->uid_index.size) ||
+      header->uid_index.size % sizeof(uint32_t) != 0 ||
+      !IsValidSection(header->byte_offsets, image_size,
+                      (no_instructions + 1) * sizeof(uint32_t)) ||
+      !IsValidSection(header->byte_arena, image_size, header->byte_arena.size) ||
+      !IsValidSection(header->assembly_offsets, image_size,
+                      (no_instructions + 1) * sizeof(uint32_t)) ||
+      !IsValidSection(header->assembly_arena, image_size, header->assembly_arena.size) ||
+      !IsValidSection(header->category_ids, image_size, no_instructions * sizeof(uint32_t)) ||
+      !IsValidSection(header->extension_ids, image_size, no_instructions * sizeof(uint32_t)) ||
+      !IsValidSection(header->isa_set_ids, image_size, no_instructions * sizeof(uint32_t)) ||
+      !IsValidSection(header->instruction_flags, image_size,
+                      no_instructions * sizeof(uint32_t)) ||
+      !IsValidSection(header->metadata_offsets, image_size,
+                      (no_metadata_strings + 1) * sizeof(uint32_t)) ||
+      !IsValidSection(header->metadata_arena, image_size, header->metadata_arena.size)) {
+    return false;
+  }
+
+  auto section_begin = [image](const DatabaseSection& section) {
+    return image + section.offset;
+  };
+  const auto* byte_offsets =
+      reinterpret_cast<const uint32_t*>(section_begin(header->byte_offsets));
+  const auto* assembly_offsets =
+      reinterpret_cast<const uint32_t*>(section_begin(header->assembly_offsets));
+  const auto* metadata_offsets =
+      reinterpret_cast<const uint32_t*>(section_begin(header->metadata_offsets));
+  const auto* category_ids =
+      reinterpret_cast<const uint32_t*>(section_begin(header->category_ids));
+  const auto* extension_ids =
+      reinterpret_cast<const uint32_t*>(section_begin(header->extension_ids));
+  const auto* isa_set_ids = reinterpret_cast<const uint32_t*>(section_begin(header->isa_set_ids));
+  const auto* uid_index = reinterpret_cast<const uint32_t*>(section_begin(header->uid_index));
+  size_t uid_index_capacity = header->uid_index.size / sizeof(uint32_t);
+  if (!IsValidOffsetTable(byte_offsets, no_instructions, header->byte_arena.size) ||
+      !IsValidOffsetTable(assembly_offsets, no_instructions, header->assembly_arena.size) ||
+      !IsValidOffsetTable(metadata_offsets, no_metadata_strings, header->metadata_arena.size) ||
+      !IsValidUIDIndex(uid_index, uid_index_capacity, no_instructions)) {
+    return false;
+  }
+  for (size_t i = 0; i < no_instructions; i++) {
+    if (category_ids[i] >= no_metadata_strings || extension_ids[i] >= no_metadata_strings ||
+        isa_set_ids[i] >= no_metadata_strings) {
+      return false;
+    }
+  }
+
+  table_image_ = image;
+  table_image_size_ = image_size;
+  no_instructions_ = no_instructions;
+  instruction_uids_ =
+      reinterpret_cast<const uint64_t*>(section_begin(header->instruction_uids));
+  uid_index_ = uid_index;
+  uid_index_capacity_ = uid_index_capacity;
+  byte_offsets_ = byte_offsets;
+  byte_arena_ = section_begin(header->byte_arena);
+  assembly_offsets_ = assembly_offsets;
+  assembly_arena_ = reinterpret_cast<const char*>(section_begin(header->assembly_arena));
+  category_ids_ = category_ids;
+  extension_ids_ = extension_ids;
+  isa_set_ids_ = isa_set_ids;
+  instruction_flags_ =
+      reinterpret_cast<const uint32_t*>(section_begin(header->instruction_flags));
+  no_metadata_strings_ = no_metadata_strings;
+  metadata_offsets_ = metadata_offsets;
+  metadata_arena_ = reinterpret_cast<const char*>(section_begin(header->metadata_arena));
+  return true;
+}
+
+void CodeGenerator::SaveDatabase(const std::string& database_filename) const {
+  // write to a temporary file first as other processes might still map the old database
+  std::string temporary_filename = database_filename + ".tmp";
+  std::ofstream database_file(temporary_filename, std::ios::binary | std::ios::trunc);
+  if (!database_file.is_open()) {
+    LOG_ERROR("Couldn't open " + temporary_filename + " for writing. Aborting!");
+    std::exit(1);
+  }
+  database_file.write(reinterpret_cast<const char*>(table_image_), table_image_size_);
+  database_file.close();
+  if (!database_file || std::rename(temporary_filename.c_str(), database_filename.c_str()) != 0) {
+    LOG_ERROR("Couldn't write " + database_filename + ". Aborting!");
+    std::exit(1);
+  }
+}
+
+size_t CodeGenerator::InstructionUIDToInstructionIndex(uint64_t instruction_uid) const {
+  for (size_t slot = GetUIDIndexSlot(instruction_uid, uid_index_capacity_);
+       uid_index_[slot] != 0;
+       slot = (slot + 1) & (uid_index_capacity_ - 1)) {
+    size_t instruction_idx = uid_index_[slot] - 1;
+    if (instruction_uids_[instruction_idx] == instruction_uid) {
+      return instruction_idx;
+    }
+  }
+  std::stringstream uid_hex;
+  uid_hex << std::hex << instruction_uid;
+  LOG_ERROR("UID " + uid_hex.str() + " does not belong to any instruction of the instruction "
+            "file. Maybe the instruction file has changed in the meantime. Aborting!");
+  std::exit(1);
 }
 
 int CodeGenerator::GenerateRandomNumber(int min, int max) {
@@ -127,31 +594,216 @@ int CodeGenerator::GenerateRandomNumber(int min, int max) {
   return distribution(rand_generator_);
 }
 
-x86Instruction CodeGenerator::CreateInstructionFromIndex(uint64_t instruction_idx) {
-  if (instruction_idx > instruction_list_.size()) {
+std::string_view CodeGenerator::GetMetadataString(uint32_t metadata_id) const {
+  return std::string_view(metadata_arena_ + metadata_offsets_[metadata_id],
+                          metadata_offsets_[metadata_id + 1] - metadata_offsets_[metadata_id]);
+}
+
+x86Instruction CodeGenerator::CreateInstructionFromIndex(size_t instruction_idx) const {
+  if (instruction_idx >= no_instructions_) {
     LOG_ERROR("Invalid instruction index");
     std::abort();
   }
-  return instruction_list_[instruction_idx];
+  uint32_t bytes_begin = byte_offsets_[instruction_idx];
+  uint32_t assembly_begin = assembly_offsets_[instruction_idx];
+  return x86Instruction{
+      instruction_uids_[instruction_idx],
+      ByteView(byte_arena_ + bytes_begin, byte_offsets_[instruction_idx + 1] - bytes_begin),
+      std::string_view(assembly_arena_ + assembly_begin,
+                       assembly_offsets_[instruction_idx + 1] - assembly_begin),
+      GetMetadataString(category_ids_[instruction_idx]),
+      GetMetadataString(extension_ids_[instruction_idx]),
+      GetMetadataString(isa_set_ids_[instruction_idx]),
+      instruction_flags_[instruction_idx]
+  };
 }
 
-x86Instruction CodeGenerator::CreateInstructionFromUID(uint64_t instruction_uid) {
-  size_t instruction_idx = InstructionUIDToInstructionIndex(instruction_uid);
-  if (instruction_idx > instruction_list_.size()) {
-    LOG_ERROR("Invalid instruction index");
-    std::abort();
+x86Instruction CodeGenerator::CreateInstructionFromUID(uint64_t instruction_uid) const {
+  return CreateInstructionFromIndex(InstructionUIDToInstructionIndex(instruction_uid));
+}
+
+SequenceSpace CodeGenerator::CreateSequenceSpace(const SequenceConstraints& constraints) const {
+  // resolve the categories to their interned IDs s.t. the filter compares integers
+  std::vector<std::vector<uint32_t>> position_category_ids;
+  for (const std::vector<std::string>& categories : constraints.position_categories) {
+    std::vector<uint32_t> category_ids;
+    for (const std::string& category : categories) {
+      uint32_t metadata_id = 0;
+      while (metadata_id < no_metadata_strings_ && GetMetadataString(metadata_id) != category) {
+        metadata_id++;
+      }
+      if (metadata_id == no_metadata_strings_) {
+        LOG_ERROR("Unknown instruction category '" + category + "'. Aborting!");
+        std::exit(1);
+      }
+      category_ids.push_back(metadata_id);
+    }
+    position_category_ids.push_back(category_ids);
+  }
+  if (position_category_ids.size() > 1 &&
+      position_category_ids.size() != constraints.length) {
+    LOG_ERROR("The number of category lists has to match the sequence length. Aborting!");
+    std::exit(1);
+  }
+
+  SequenceSpace sequence_space;
+  for (size_t position = 0; position < constraints.length; position++) {
+    const std::vector<uint32_t>* category_ids = nullptr;
+    if (!position_category_ids.empty()) {
+      category_ids = &position_category_ids[position_category_ids.size() == 1 ? 0 : position];
+    }
+    std::vector<size_t> candidates;
+    for (size_t instruction_idx = 0; instruction_idx < no_instructions_; instruction_idx++) {
+      uint32_t flags = instruction_flags_[instruction_idx];
+      if (flags & kInstructionIsSleep) {
+        continue;
+      }
+      if (position == 0 && constraints.memory_access_first &&
+          !(flags & kInstructionTouchesMemory)) {
+        continue;
+      }
+      if (category_ids != nullptr && !category_ids->empty() &&
+          std::find(category_ids->begin(), category_ids->end(),
+                    category_ids_[instruction_idx]) == category_ids->end()) {
+        continue;
+      }
+      candidates.push_back(instruction_idx);
+    }
+    sequence_space.position_candidates.push_back(std::move(candidates));
+  }
+
+  // the ranks of the sequences are size_t hence the size of the space has to fit exactly
+  size_t no_sequences = 1;
+  for (const std::vector<size_t>& candidates : sequence_space.position_candidates) {
+    if (!candidates.empty() && no_sequences > SIZE_MAX / candidates.size()) {
+      LOG_ERROR("The space of composed sequences of length " +
+          std::to_string(constraints.length) + " is too large to be enumerated. Restrict the "
+          "categories or reduce the sequence length. Aborting!");
+      std::exit(1);
+    }
+    no_sequences *= std::max<size_t>(candidates.size(), 1);
+  }
+  return sequence_space;
+}
+
+x86Sequence CodeGenerator::CreateSequenceFromRank(const SequenceSpace& sequence_space,
+                                                  size_t rank) const {
+  const auto& position_candidates = sequence_space.position_candidates;
+  std::vector<size_t> instruction_indexes(position_candidates.size());
+  for (size_t position = position_candidates.size(); position-- > 0;) {
+    size_t no_candidates = position_candidates[position].size();
+    instruction_indexes[position] = position_candidates[position][rank % no_candidates];
+    rank /= no_candidates;
+  }
+  return CreateSequenceFromIndexes(instruction_indexes);
+}
+
+void CodeGenerator::AppendToSequence(size_t instruction_idx, const x86Instruction& instruction,
+                                     size_t operand_variant, x86Sequence* sequence) {
+  if (!sequence->instruction_indexes.empty()) {
+    sequence->assembly_code += kSequenceFieldSeparator;
+    sequence->category += kSequenceFieldSeparator;
+    sequence->extension += kSequenceFieldSeparator;
+    sequence->isa_set += kSequenceFieldSeparator;
+  }
+  sequence->instruction_indexes.push_back(instruction_idx);
+  sequence->instruction_uids.push_back(instruction.instruction_uid);
+  sequence->operand_variants.push_back(operand_variant);
+  sequence->byte_representation.insert(sequence->byte_representation.end(),
+                                       instruction.byte_representation.begin(),
+                                       instruction.byte_representation.end());
+  sequence->assembly_code += instruction.assembly_code;
+  sequence->category += instruction.category;
+  sequence->extension += instruction.extension;
+  sequence->isa_set += instruction.isa_set;
+  sequence->flags |= instruction.flags;
+}
+
+x86Sequence CodeGenerator::CreateSequenceFromIndexes(
+    const std::vector<size_t>& instruction_indexes) const {
+  x86Sequence sequence{};
+  for (size_t instruction_idx : instruction_indexes) {
+    AppendToSequence(instruction_idx, CreateInstructionFromIndex(instruction_idx), 0, &sequence);
+  }
+  return sequence;
+}
+
+x86Sequence CodeGenerator::CreateSequenceFromUIDString(const std::string& uid_string) {
+  x86Sequence sequence{};
+  for (const std::string& uid : SplitString(uid_string, kSequenceUIDSeparator)) {
+    std::vector<std::string> uid_splitted = SplitString(uid, kOperandVariantSeparator);
+    size_t instruction_idx =
+        InstructionUIDToInstructionIndex(std::stoull(uid_splitted[0], nullptr, 16));
+    x86Instruction instruction = CreateInstructionFromIndex(instruction_idx);
+    size_t operand_variant = uid_splitted.size() > 1 ? std::stoull(uid_splitted[1]) : 0;
+    byte_array variant_bytes;
+    std::string variant_assembly_code;
+    if (operand_variant != 0) {
+      OperandLayout operand_layout = CreateOperandLayout(instruction_idx);
+      if (operand_variant > operand_layout.GetNumberOfCandidates() ||
+          !operand_mutator_.CreateVariant(operand_layout, operand_variant, &variant_bytes,
+                                          &variant_assembly_code)) {
+        LOG_ERROR("Operand variant " + uid + " does not exist. Maybe the instruction file or "
+                  "the version of capstone has changed in the meantime. Aborting!");
+        std::exit(1);
+      }
+      instruction.byte_representation = variant_bytes;
+      instruction.assembly_code = variant_assembly_code;
+    }
+    AppendToSequence(instruction_idx, instruction, operand_variant, &sequence);
+  }
+  return sequence;
+}
+
+OperandLayout CodeGenerator::CreateOperandLayout(size_t instruction_idx) {
+  OperandLayout operand_layout;
+  if (!operand_mutator_.DecodeBaseInstruction(
+      CreateInstructionFromIndex(instruction_idx).byte_representation, &operand_layout)) {
+    LOG_DEBUG("Couldn't decode instruction on index " + std::to_string(instruction_idx) +
+        ". It has no operand variants.");
+  }
+  return operand_layout;
+}
+
+bool CodeGenerator::CreateNextOperandVariant(const x86Sequence& sequence, size_t position,
+                                             const OperandLayout& operand_layout,
+                                             size_t* variant_no, x86Sequence* variant) {
+  byte_array variant_bytes;
+  std::string variant_assembly_code;
+  size_t no_candidates = operand_layout.GetNumberOfCandidates();
+  // candidates are only validated once they are needed s.t. a search that tests few children
+  // of many instructions does not mutate each of them completely
+  do {
+    if (*variant_no >= no_candidates) {
+      return false;
+    }
+    (*variant_no)++;
+  } while (!operand_mutator_.CreateVariant(operand_layout, *variant_no, &variant_bytes,
+                                           &variant_assembly_code));
+
+  *variant = x86Sequence{};
+  for (size_t i = 0; i < sequence.instruction_indexes.size(); i++) {
+    x86Instruction instruction = CreateInstructionFromIndex(sequence.instruction_indexes[i]);
+    if (i != position) {
+      AppendToSequence(sequence.instruction_indexes[i], instruction, 0, variant);
+      continue;
+    }
+    // the variant keeps the UID and the properties of its instruction
+    instruction.byte_representation = variant_bytes;
+    instruction.assembly_code = variant_assembly_code;
+    AppendToSequence(sequence.instruction_indexes[i], instruction, *variant_no, variant);
   }
-  return instruction_list_[instruction_idx];
+  return true;
 }
 
 x86Instruction CodeGenerator::CreateRandomInstruction() {
-  size_t idx = GenerateRandomNumber(0, instruction_list_.size() - 1);
+  size_t idx = GenerateRandomNumber(0, GetNumberOfInstructions() - 1);
   LOG_DEBUG("Got random instruction on index " + std::to_string(idx));
   return CreateInstructionFromIndex(idx);
 }
 
-size_t CodeGenerator::GetNumberOfInstructions() {
-  return instruction_list_.size();
+size_t CodeGenerator::GetNumberOfInstructions() const {
+  return no_instructions_;
 }
 
 }  // namespace osiris
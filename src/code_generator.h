@@ -16,11 +16,14 @@
 #ifndef OSIRIS_SRC_CODE_GENERATOR_H_
 #define OSIRIS_SRC_CODE_GENERATOR_H_
 
-#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <random>
 
+#include "operand_mutator.h"
 #include "utils.h"
 
 namespace osiris {
@@ -35,60 +38,240 @@ constexpr uint64_t kMemoryBegin = 0x13370000;
 ///
 constexpr uint64_t kMemoryEnd = 0x13371fff;
 
+///
+/// precomputed properties of an instruction (bits of x86Instruction::flags)
+///
+constexpr uint32_t kInstructionIsSleep = 1u << 0;  // busy-sleep, short-busy-sleep, sleep-syscall
+constexpr uint32_t kInstructionTouchesMemory = 1u << 1;  // explicit or implicit memory operand
+constexpr uint32_t kInstructionIsCacheOperation = 1u << 2;  // flushes, prefetches, write-backs
+
 ////
-/// Represents one x86 instruction
+/// Represents one x86 instruction. This is a lightweight view into the instruction table of the
+/// CodeGenerator which created it, hence it is only valid as long as the CodeGenerator exists.
 ///
 struct x86Instruction {
-  uint64_t instruction_uid;
+  uint64_t instruction_uid;  // 64-bit FNV-1a hash of the byte representation
+  ByteView byte_representation;
+  std::string_view assembly_code;
+  std::string_view category;
+  std::string_view extension;
+  std::string_view isa_set;
+  uint32_t flags;
+
+  bool IsSleep() const { return flags & kInstructionIsSleep; }
+  bool TouchesMemory() const { return flags & kInstructionTouchesMemory; }
+  bool IsCacheOperation() const { return flags & kInstructionIsCacheOperation; }
+
+  std::string GetCSVRepresentation() const;
+};
+
+///
+/// separators of the instructions of a multi-instruction sequence in its CSV representation
+///
+constexpr char kSequenceUIDSeparator = '+';
+constexpr char kSequenceFieldSeparator[] = " | ";
+
+////
+/// Represents a sequence of one or more x86 instructions that is tested as one trigger,
+/// measurement or reset sequence. Unlike x86Instruction, it owns its data.
+///
+struct x86Sequence {
+  std::vector<size_t> instruction_indexes;
+  std::vector<uint64_t> instruction_uids;
+  // per instruction the number of the operand variant that replaces it (0 for none)
+  std::vector<size_t> operand_variants;
   byte_array byte_representation;
+  // properties of the instructions joined by kSequenceFieldSeparator
   std::string assembly_code;
   std::string category;
   std::string extension;
   std::string isa_set;
+  uint32_t flags;  // union of the flags of all instructions
+
+  bool IsSleep() const { return flags & kInstructionIsSleep; }
 
+  /// \return UID of the whole sequence (equals the instruction UID for single instructions),
+  ///  e.g. for the noise profile
+  uint64_t GetSequenceUID() const;
+
+  /// \return UIDs of the instructions in hex joined by kSequenceUIDSeparator, each followed by
+  ///  kOperandVariantSeparator and the number of its operand variant if it is replaced by one
+  std::string GetUIDString() const;
+
+  /// \return CSV representation (the same as x86Instruction's for single instructions)
   std::string GetCSVRepresentation() const;
 };
 
+///
+/// Constraints on the instructions of composed sequences (see CodeGenerator::CreateSequenceSpace)
+///
+struct SequenceConstraints {
+  /// number of instructions per sequence
+  size_t length = 2;
+
+  /// allowed categories per position, e.g. {{"DATAXFER"}, {"BINARY", "LOGICAL"}} for a move
+  /// followed by an arithmetic or logic instruction. An empty list allows every category and a
+  /// single list applies to every position.
+  std::vector<std::vector<std::string>> position_categories;
+
+  /// only allow instructions accessing memory at the first position (e.g. a load followed by
+  /// dependent operations)
+  bool memory_access_first = false;
+};
+
+///
+/// Candidate instructions of every position of a composed sequence. The sequences are the
+/// cartesian product of the candidates, numbered by their rank in mixed radix with the last
+/// position varying fastest.
+///
+struct SequenceSpace {
+  std::vector<std::vector<size_t>> position_candidates;
+
+  /// \return number of sequences (CreateSequenceSpace ensures that it fits into size_t)
+  size_t GetNumberOfSequences() const;
+};
+
 ///
 /// Generates assembly code in binary format
 ///
 class CodeGenerator {
  public:
   /// Initializes Codegenerator with given instruction list
-  /// \param instructions_filename file containing base64 encoded instructions one per line
+  /// \param instructions_filename file containing base64 encoded instructions one per line or
+  ///  an instruction database written by SaveDatabase (detected by its magic)
   explicit CodeGenerator(const std::string &instructions_filename);
+  ~CodeGenerator();
+
+  // the instruction views point into the table of the CodeGenerator
+  CodeGenerator(const CodeGenerator&) = delete;
+  CodeGenerator& operator=(const CodeGenerator&) = delete;
 
-  /// Create instruction from instruction list
+  /// Writes the instruction table as binary database which later CodeGenerators can map
+  /// instead of parsing the instruction file again
+  /// \param database_filename output file (replaced atomically)
+  void SaveDatabase(const std::string& database_filename) const;
+
+  /// Create instruction from instruction list (does not allocate)
   /// \param instruction_idx instruction index
-  /// \return corresponding instruction
-  x86Instruction CreateInstructionFromIndex(size_t instruction_idx);
+  /// \return view of the corresponding instruction
+  x86Instruction CreateInstructionFromIndex(size_t instruction_idx) const;
 
   /// Create instruction from instruction UID
   /// \param instruction_idx instruction UID
-  /// \return corresponding instruction
-  x86Instruction CreateInstructionFromUID(uint64_t instruction_uid);
+  /// \return view of the corresponding instruction
+  x86Instruction CreateInstructionFromUID(uint64_t instruction_uid) const;
 
   /// Create random instruction
-  /// \return random instruction
+  /// \return view of a random instruction
   x86Instruction CreateRandomInstruction();
 
   /// Get number of Instructions that were loaded to the codegen
   /// \return no of instructions
-  size_t GetNumberOfInstructions();
+  size_t GetNumberOfInstructions() const;
+
+  /// Collects the candidate instructions of every position of composed sequences. Sleeps are
+  /// never part of composed sequences.
+  /// \param constraints constraints on the instructions
+  /// \return sequence space (positions without candidates make it empty)
+  SequenceSpace CreateSequenceSpace(const SequenceConstraints& constraints) const;
+
+  /// Composes a sequence of a sequence space
+  /// \param sequence_space sequence space
+  /// \param rank number of the sequence in [0, sequence_space.GetNumberOfSequences())
+  /// \return sequence
+  x86Sequence CreateSequenceFromRank(const SequenceSpace& sequence_space, size_t rank) const;
+
+  /// Composes a sequence of the given instructions
+  /// \param instruction_indexes indexes of the instructions in order of execution
+  /// \return sequence
+  x86Sequence CreateSequenceFromIndexes(const std::vector<size_t>& instruction_indexes) const;
+
+  /// Composes a sequence from its UID string (see x86Sequence::GetUIDString); a single UID
+  /// yields a sequence of one instruction
+  /// \param uid_string UIDs in hex joined by kSequenceUIDSeparator
+  /// \return sequence
+  x86Sequence CreateSequenceFromUIDString(const std::string& uid_string);
+
+  /// Decodes an instruction once s.t. its operand variants can be derived on the fly
+  /// \param instruction_idx index of the instruction
+  /// \return layout of the instruction (without candidates if it can not be decoded)
+  OperandLayout CreateOperandLayout(size_t instruction_idx);
+
+  /// Derives the next operand variant of an instruction of a sequence, i.e., lazily generates
+  /// the children of the sequence one by one
+  /// \param sequence base sequence (its instructions must not be replaced by variants)
+  /// \param position position of the instruction in the sequence
+  /// \param operand_layout layout of the instruction (see CreateOperandLayout)
+  /// \param variant_no number of the previous variant (0 for the first one); outputs the number
+  ///  of the returned one
+  /// \param variant outputs the sequence with the instruction replaced by the variant
+  /// \return false if the instruction has no further variants
+  bool CreateNextOperandVariant(const x86Sequence& sequence, size_t position,
+                                const OperandLayout& operand_layout, size_t* variant_no,
+                                x86Sequence* variant);
 
  private:
   int GenerateRandomNumber(int min, int max);
 
-  /// We add a checksum over the instruction input file to our instruction UIDs to detect when the
-  /// user tries to use the wrong combination of instruction file and UIDs
-  /// \param instruction_idx
-  /// \return
-  uint64_t GenerateInstructionUID(size_t instruction_idx);
-  size_t InstructionUIDToInstructionIndex(uint64_t instruction_uid);
+  /// Looks the UID up in the UID index (aborts if the UID is unknown)
+  /// \param instruction_uid instruction UID
+  /// \return index of the instruction with this UID
+  size_t InstructionUIDToInstructionIndex(uint64_t instruction_uid) const;
+
+  /// Parses a base64 instruction file into table_storage_
+  void ParseInstructionFile(const std::string& instructions_filename);
+
+  /// Maps an instruction database read-only
+  /// \return false if the file is no instruction database
+  bool MapDatabase(const std::string& database_filename);
+
+  /// Validates the table image and points the table members into it
+  /// \param image image in the format of the instruction database
+  /// \param image_size size of the image in bytes
+  /// \return false if the image is malformed
+  bool AttachTable(const std::byte* image, size_t image_size);
+
+  std::string_view GetMetadataString(uint32_t metadata_id) const;
+
+  /// Appends an instruction to a sequence
+  /// \param instruction_idx index of the instruction
+  /// \param instruction instruction or its operand variant
+  /// \param operand_variant number of the operand variant (0 for the instruction itself)
+  /// \param sequence sequence to append to
+  static void AppendToSequence(size_t instruction_idx, const x86Instruction& instruction,
+                               size_t operand_variant, x86Sequence* sequence);
+
+  // image of the instruction table in the database format; owned by table_storage_ if it was
+  // parsed from an instruction file, otherwise a read-only mapping of the database
+  std::vector<uint64_t> table_storage_;
+  void* database_mapping_ = nullptr;
+  size_t database_mapping_size_ = 0;
+  const std::byte* table_image_ = nullptr;
+  size_t table_image_size_ = 0;
+
+  // The instruction table is stored as structure of arrays indexed by the instruction index.
+  // Bytes and assembly code of all instructions are packed into one arena each; instruction i
+  // occupies [offsets[i], offsets[i + 1]) of it.
+  size_t no_instructions_ = 0;
+  const uint64_t* instruction_uids_ = nullptr;
+  const uint32_t* uid_index_ = nullptr;  // open addressing, instruction index + 1 per slot
+  size_t uid_index_capacity_ = 0;
+  const uint32_t* byte_offsets_ = nullptr;
+  const std::byte* byte_arena_ = nullptr;
+  const uint32_t* assembly_offsets_ = nullptr;
+  const char* assembly_arena_ = nullptr;
+  const uint32_t* category_ids_ = nullptr;
+  const uint32_t* extension_ids_ = nullptr;
+  const uint32_t* isa_set_ids_ = nullptr;
+  const uint32_t* instruction_flags_ = nullptr;
+
+  // interned category, extension and ISA set strings
+  size_t no_metadata_strings_ = 0;
+  const uint32_t* metadata_offsets_ = nullptr;
+  const char* metadata_arena_ = nullptr;
 
-  std::vector<x86Instruction> instruction_list_;
   std::default_random_engine rand_generator_;
-  std::string instruction_file_sha256hash_;
+  OperandMutator operand_mutator_;
 };
 
 }  // namespace osiris
@@ -18,27 +18,36 @@
 #include <capstone/capstone.h>  // disassembling the output for proper formatting
 
 #include <algorithm>
+#include <cmath>
 #include <filesystem>
 #include <iostream>
+#include <iterator>
+#include <random>
 #include <string>
 #include <fstream>
+#include <unordered_set>
 
 #include "code_generator.h"
 #include "logger.h"
+#include "statistics.h"
 
 namespace osiris {
 
-Core::Core(const std::string& instructions_filename) :
+Core::Core(const std::string& instructions_filename, const ExecutorConfig& executor_config) :
     code_generator_(CodeGenerator(instructions_filename)),
-    executor_(Executor()) {
+    executor_(executor_config) {
   iterations_no_ = 10;
   reset_executions_amount_without_assumptions_ = 1;
   reset_executions_amount_trigger_equals_measurement_ = 50;
+  baseline_max_age_ = kDefaultBaselineMaxAge;
+  reset_tolerance_ = 20;
+  executor_.SetBaselineMaxAge(baseline_max_age_);
 }
 
 void Core::FindAndOutputTriggerpairsWithoutAssumptions(const std::string& output_csvfilename,
                                                        bool execute_trigger_only_in_speculation,
-                                                       int64_t threshold_in_cycles) {
+                                                       int64_t threshold_in_cycles,
+                                                       WorkQueue* work_queue) {
   std::ofstream output_csvfile(output_csvfilename);
   if (output_csvfile.fail()) {
     LOG_ERROR("Couldn't not open " + output_csvfilename + " for writing. Aborting!");
@@ -52,74 +61,205 @@ void Core::FindAndOutputTriggerpairsWithoutAssumptions(const std::string& output
                          "reset-isa-set");
   output_csvfile << headerline << std::endl;
 
+  WorkQueue local_work_queue;
+  if (work_queue == nullptr) {
+    work_queue = &local_work_queue;
+  }
+  bool is_screening = screening_config_.screening_testruns > 0;
   size_t max_instruction_no = code_generator_.GetNumberOfInstructions();
-  for (size_t measurement_idx = 0; measurement_idx < max_instruction_no; measurement_idx++) {
+  size_t measurement_idx;
+  while (work_queue->Next(max_instruction_no, &measurement_idx)) {
     x86Instruction measurement_sequence =
         code_generator_.CreateInstructionFromIndex(measurement_idx);
     LOG_INFO("processing measurement " + std::to_string(measurement_idx) + "/"
                  + std::to_string(max_instruction_no - 1));
+    int64_t threshold = noise_profile_.GetThreshold(measurement_sequence.instruction_uid,
+                                                    threshold_in_cycles);
+    int64_t reset_tolerance = noise_profile_.GetResetTolerance(
+        measurement_sequence.instruction_uid, reset_tolerance_);
+    // the first stage only screens for candidates hence it uses a looser threshold
+    int64_t screening_threshold = is_screening
+        ? static_cast<int64_t>(static_cast<double>(threshold) *
+            screening_config_.screening_threshold_fraction)
+        : threshold;
+    executor_.SetEffectThresholds(-screening_threshold, screening_threshold);
+    // the runs without trigger sequence only depend on the (reset, measurement) pair, hence we
+    // cache them per reset sequence while the measurement sequence stays the same
+    executor_.ClearBaselineCache();
 
-    for (size_t trigger_idx = 0; trigger_idx < max_instruction_no; trigger_idx++) {
-      x86Instruction trigger_sequence = code_generator_.CreateInstructionFromIndex(trigger_idx);
-      if (trigger_sequence.assembly_code == "busy-sleep" ||
-          trigger_sequence.assembly_code == "short-busy-sleep" ||
-          trigger_sequence.assembly_code == "sleep-syscall") {
-        // the sleeps are only valid reset sequences
-        continue;
-      }
-      for (size_t reset_idx = 0; reset_idx < max_instruction_no; reset_idx++) {
-        x86Instruction reset_sequence = code_generator_.CreateInstructionFromIndex(reset_idx);
-        // execute sleeps only 1 time
-        int reset_executions_amount =
-            reset_sequence.assembly_code == "busy-sleep" ||
-                reset_sequence.assembly_code == "sleep-syscall" ||
-                reset_sequence.assembly_code == "short-busy-sleep"
-            ? 1 : reset_executions_amount_without_assumptions_;
+    // stage 1: test every (trigger, reset) pair (at full fidelity if screening is disabled);
+    // the reset sequence is the outer loop s.t. the cached baseline is reused while it is fresh
+    std::vector<TriggerResetCandidate> candidates;
+    size_t tested_pairs = 0;
+    for (size_t reset_idx = 0; reset_idx < max_instruction_no; reset_idx++) {
+      x86Instruction reset_sequence = code_generator_.CreateInstructionFromIndex(reset_idx);
+      for (size_t trigger_idx = 0; trigger_idx < max_instruction_no; trigger_idx++) {
+        if (IsBlacklistedTriple(measurement_idx, trigger_idx, reset_idx)) {
+          continue;
+        }
+        x86Instruction trigger_sequence = code_generator_.CreateInstructionFromIndex(trigger_idx);
+        if (trigger_sequence.IsSleep()) {
+          // the sleeps are only valid reset sequences
+          continue;
+        }
         int64_t result;
-        int error = executor_.TestTriggerSequence(trigger_sequence.byte_representation,
-                                                  measurement_sequence.byte_representation,
-                                                  reset_sequence.byte_representation,
-                                                  execute_trigger_only_in_speculation,
-                                                  iterations_no_,
-                                                  reset_executions_amount,
-                                                  &result);
-        if (error == 0 && (result < -threshold_in_cycles || result > threshold_in_cycles)) {
-          // this removes the "reset-sequence is not really working"-problem
-          // by checking that the reset we observe is indeed triggered by this reset sequence
-          int64_t reset_test_result;
-          error = executor_.TestResetSequence(trigger_sequence.byte_representation,
+        int error = TestTripleWithCachedBaseline(measurement_sequence, trigger_sequence,
+                                                 reset_sequence,
+                                                 execute_trigger_only_in_speculation,
+                                                 is_screening
+                                                     ? screening_config_.screening_testruns
+                                                     : iterations_no_,
+                                                 reset_idx, &result);
+        tested_pairs++;
+        if (error == kTestrunHang) {
+          BlacklistHangingTriple(measurement_idx, trigger_idx, reset_idx);
+        }
+        if (error == 0 && (result < -screening_threshold || result > screening_threshold)) {
+          candidates.push_back(TriggerResetCandidate{trigger_idx, reset_idx, result});
+        }
+      }
+    }
+
+    // stage 2: measure the candidates at full fidelity; they are ordered by reset sequence
+    // s.t. consecutive tests share their cached baseline
+    if (is_screening) {
+      LOG_INFO("screening passed on " + std::to_string(candidates.size()) + "/" +
+          std::to_string(tested_pairs) + " pairs");
+      executor_.SetEffectThresholds(-threshold, threshold);
+      executor_.ClearBaselineCache();
+      std::vector<TriggerResetCandidate> measured_candidates;
+      for (TriggerResetCandidate candidate : candidates) {
+        x86Instruction trigger_sequence =
+            code_generator_.CreateInstructionFromIndex(candidate.trigger_idx);
+        x86Instruction reset_sequence =
+            code_generator_.CreateInstructionFromIndex(candidate.reset_idx);
+        int error = TestTripleWithCachedBaseline(measurement_sequence, trigger_sequence,
+                                                 reset_sequence,
+                                                 execute_trigger_only_in_speculation,
+                                                 iterations_no_, candidate.reset_idx,
+                                                 &candidate.result);
+        if (error == kTestrunHang) {
+          BlacklistHangingTriple(measurement_idx, candidate.trigger_idx, candidate.reset_idx);
+        }
+        if (error == 0 && (candidate.result < -threshold || candidate.result > threshold)) {
+          measured_candidates.push_back(candidate);
+        }
+      }
+      LOG_INFO("measurement passed on " + std::to_string(measured_candidates.size()) + "/" +
+          std::to_string(candidates.size()) + " candidates");
+      candidates.swap(measured_candidates);
+    }
+
+    for (const TriggerResetCandidate& candidate : candidates) {
+      x86Instruction trigger_sequence =
+          code_generator_.CreateInstructionFromIndex(candidate.trigger_idx);
+      x86Instruction reset_sequence =
+          code_generator_.CreateInstructionFromIndex(candidate.reset_idx);
+      int reset_executions_amount = GetResetExecutionsAmount(
+          reset_sequence, reset_executions_amount_without_assumptions_,
+          trigger_sequence.instruction_uid, true);
+      // this removes the "reset-sequence is not really working"-problem
+      // by checking that the reset we observe is indeed triggered by this reset sequence
+      int64_t reset_test_result;
+      int error = executor_.TestResetSequence(trigger_sequence.byte_representation,
                                               measurement_sequence.byte_representation,
                                               reset_sequence.byte_representation,
                                               iterations_no_,
                                               reset_executions_amount,
                                               &reset_test_result);
-          if (error == 0 && -20 < reset_test_result && reset_test_result < 20) {
-            // write csv line
-            std::string csv_line = std::to_string(result);
-            csv_line += ";";
-            csv_line += measurement_sequence.GetCSVRepresentation();
-            csv_line += ";";
-            csv_line += trigger_sequence.GetCSVRepresentation();
-            csv_line += ";";
-            csv_line += reset_sequence.GetCSVRepresentation();
-            output_csvfile << csv_line << std::endl;
-          }
-        }
+      if (error == kTestrunHang) {
+        BlacklistHangingTriple(measurement_idx, candidate.trigger_idx, candidate.reset_idx);
       }
+      if (error == 0 && -reset_tolerance < reset_test_result &&
+          reset_test_result < reset_tolerance) {
+        // write csv line
+        std::string csv_line = std::to_string(candidate.result);
+        csv_line += ";";
+        csv_line += measurement_sequence.GetCSVRepresentation();
+        csv_line += ";";
+        csv_line += trigger_sequence.GetCSVRepresentation();
+        csv_line += ";";
+        csv_line += reset_sequence.GetCSVRepresentation();
+        output_csvfile << csv_line << std::endl;
+      }
+    }
+  }
+}
+
+int Core::TestTripleWithCachedBaseline(const x86Instruction& measurement_sequence,
+                                       const x86Instruction& trigger_sequence,
+                                       const x86Instruction& reset_sequence,
+                                       bool execute_trigger_only_in_speculation,
+                                       int no_testruns,
+                                       size_t reset_idx,
+                                       int64_t* result) {
+  return executor_.TestTriggerSequenceWithCachedBaseline(
+      trigger_sequence.byte_representation,
+      measurement_sequence.byte_representation,
+      reset_sequence.byte_representation,
+      execute_trigger_only_in_speculation,
+      no_testruns,
+      GetResetExecutionsAmount(reset_sequence, reset_executions_amount_without_assumptions_,
+                               trigger_sequence.instruction_uid, true),
+      reset_idx,
+      result);
+}
+
+int Core::GetResetExecutionsAmount(const x86Instruction& reset_sequence,
+                                   int default_amount,
+                                   uint64_t trigger_uid,
+                                   bool only_calibrated_pair) const {
+  // execute sleeps only 1 time
+  if (reset_sequence.IsSleep()) {
+    return 1;
+  }
+  if (only_calibrated_pair) {
+    return reset_calibration_.GetPairExecutionsAmount(trigger_uid, reset_sequence.instruction_uid,
+                                                      default_amount);
+  }
+  return reset_calibration_.GetExecutionsAmount(trigger_uid, reset_sequence.instruction_uid,
+                                                default_amount);
+}
+
+void Core::GetTriggerEqualsMeasurementThresholds(uint64_t trigger_uid,
+                                                 int64_t negative_threshold,
+                                                 int64_t positive_threshold,
+                                                 int64_t* lower_threshold,
+                                                 int64_t* upper_threshold,
+                                                 int64_t* reset_tolerance) const {
+  *lower_threshold = negative_threshold;
+  *upper_threshold = positive_threshold;
+  *reset_tolerance = reset_tolerance_;
+  if (!noise_profile_.IsEmpty()) {
+    int64_t threshold = noise_profile_.GetThreshold(trigger_uid, -1);
+    if (threshold != -1) {
+      *lower_threshold = -threshold;
+      *upper_threshold = threshold;
+      *reset_tolerance = noise_profile_.GetResetTolerance(trigger_uid, reset_tolerance_);
     }
   }
 }
 
+void Core::SetScreeningConfig(const ScreeningConfig& screening_config) {
+  screening_config_ = screening_config;
+  iterations_no_ = screening_config.measurement_testruns;
+}
+
 void Core::FindAndOutputTriggerpairsWithTriggerEqualsMeasurement(
     const std::string& output_folder,
     const std::string&
     output_csvfilename,
     bool execute_trigger_only_in_speculation,
     int64_t negative_threshold,
-    int64_t positive_threshold) {
-  // remove and recreate output directory to delete all old content
-  std::filesystem::remove_all(output_folder);
-  std::filesystem::create_directory(output_folder);
+    int64_t positive_threshold,
+    WorkQueue* work_queue) {
+  WorkQueue local_work_queue;
+  if (work_queue == nullptr) {
+    work_queue = &local_work_queue;
+    // remove and recreate output directory to delete all old content
+    std::filesystem::remove_all(output_folder);
+    std::filesystem::create_directory(output_folder);
+  }
 
   std::ofstream output_csvfile(output_csvfilename);
   std::string headerline("timing;"
@@ -131,25 +271,31 @@ void Core::FindAndOutputTriggerpairsWithTriggerEqualsMeasurement(
                          "reset-isa-set");
   output_csvfile << headerline << std::endl;
   size_t max_instruction_no = code_generator_.GetNumberOfInstructions();
-  for (size_t trigger_idx = 0; trigger_idx < max_instruction_no; trigger_idx++) {
+  size_t trigger_idx;
+  while (work_queue->Next(max_instruction_no, &trigger_idx)) {
     x86Instruction trigger_sequence = code_generator_.CreateInstructionFromIndex(trigger_idx);
     std::stringstream output_stream;
     LOG_INFO("processing trigger " + std::to_string(trigger_idx) +
-        " (" + trigger_sequence.assembly_code + ")");
-    if (trigger_sequence.assembly_code == "busy-sleep" ||
-        trigger_sequence.assembly_code == "short-busy-sleep" ||
-        trigger_sequence.assembly_code == "sleep-syscall") {
+        " (" + std::string(trigger_sequence.assembly_code) + ")");
+    if (trigger_sequence.IsSleep()) {
       // the sleeps are only valid reset sequences
       continue;
     }
+    int64_t lower_threshold;
+    int64_t upper_threshold;
+    int64_t reset_tolerance;
+    GetTriggerEqualsMeasurementThresholds(trigger_sequence.instruction_uid, negative_threshold,
+                                          positive_threshold, &lower_threshold,
+                                          &upper_threshold, &reset_tolerance);
+    executor_.SetEffectThresholds(lower_threshold, upper_threshold);
     for (size_t reset_idx = 0; reset_idx < max_instruction_no; reset_idx++) {
+      if (IsBlacklistedTriple(trigger_idx, trigger_idx, reset_idx)) {
+        continue;
+      }
       x86Instruction reset_sequence = code_generator_.CreateInstructionFromIndex(reset_idx);
-      // execute sleeps only 1 time
-      int reset_executions_amount =
-          reset_sequence.assembly_code == "busy-sleep" ||
-              reset_sequence.assembly_code == "sleep-syscall" ||
-              reset_sequence.assembly_code == "short-busy-sleep"
-          ? 1 : reset_executions_amount_trigger_equals_measurement_;
+      int reset_executions_amount = GetResetExecutionsAmount(
+          reset_sequence, reset_executions_amount_trigger_equals_measurement_,
+          trigger_sequence.instruction_uid, false);
       int64_t result;
       // we assume that trigger sequence equals measurement sequence
       int error = executor_.TestTriggerSequence(trigger_sequence.byte_representation,
@@ -159,7 +305,10 @@ void Core::FindAndOutputTriggerpairsWithTriggerEqualsMeasurement(
                                                 iterations_no_,
                                                 reset_executions_amount,
                                                 &result);
-      if (error == 0 && (result < negative_threshold || result > positive_threshold)) {
+      if (error == kTestrunHang) {
+        BlacklistHangingTriple(trigger_idx, trigger_idx, reset_idx);
+      }
+      if (error == 0 && (result < lower_threshold || result > upper_threshold)) {
         // this removes the "reset-sequence is not really working"-problem
         // by checking that the reset we observe is indeed triggered by this reset sequence
         int64_t reset_test_result;
@@ -168,7 +317,11 @@ void Core::FindAndOutputTriggerpairsWithTriggerEqualsMeasurement(
                                             reset_sequence.byte_representation,
                                             iterations_no_, reset_executions_amount,
                                             &reset_test_result);
-        if (error == 0 && -20 < reset_test_result && reset_test_result < 20) {
+        if (error == kTestrunHang) {
+          BlacklistHangingTriple(trigger_idx, trigger_idx, reset_idx);
+        }
+        if (error == 0 && -reset_tolerance < reset_test_result &&
+            reset_test_result < reset_tolerance) {
           output_stream << base64_encode(reset_sequence.byte_representation)
                         << ";" << result << std::endl;
 
@@ -195,6 +348,360 @@ void Core::FindAndOutputTriggerpairsWithTriggerEqualsMeasurement(
   }
 }
 
+void Core::CreateNoiseProfile(NoiseProfile* noise_profile) {
+  // number of test results the noise is estimated from
+  constexpr int kProfileRepetitions = 32;
+  byte_array empty_sequence;
+  std::vector<int64_t> results;
+  std::vector<int64_t> baselines;
+  size_t max_instruction_no = code_generator_.GetNumberOfInstructions();
+  for (size_t measurement_idx = 0; measurement_idx < max_instruction_no; measurement_idx++) {
+    x86Instruction measurement_sequence =
+        code_generator_.CreateInstructionFromIndex(measurement_idx);
+    if (measurement_sequence.IsSleep()) {
+      // the sleeps are only valid reset sequences
+      continue;
+    }
+    LOG_INFO("profiling measurement " + std::to_string(measurement_idx) + "/"
+                 + std::to_string(max_instruction_no - 1));
+    results.clear();
+    baselines.clear();
+    for (int repetition = 0; repetition < kProfileRepetitions; repetition++) {
+      // without trigger and reset sequence both code pages are equal, hence every difference
+      // of the result is noise
+      int64_t result;
+      int error = executor_.TestTriggerSequence(empty_sequence,
+                                                measurement_sequence.byte_representation,
+                                                empty_sequence,
+                                                false,
+                                                iterations_no_,
+                                                1,
+                                                &result);
+      if (error) {
+        break;
+      }
+      results.push_back(result);
+      baselines.push_back(std::llround(executor_.GetNoTriggerStatistics().median));
+    }
+    if (static_cast<int>(results.size()) != kProfileRepetitions) {
+      continue;
+    }
+    SampleStatistics result_statistics = ComputeSampleStatistics(&results);
+    noise_profile->SetEntry(measurement_sequence.instruction_uid,
+                            NoiseProfileEntry{ComputeSampleStatistics(&baselines).median,
+                                              kMADToStandardDeviation *
+                                                  result_statistics.median_absolute_deviation});
+  }
+}
+
+void Core::SetNoiseProfile(const NoiseProfile& noise_profile) {
+  noise_profile_ = noise_profile;
+}
+
+void Core::CalibrateResetExecutions(bool execute_trigger_only_in_speculation,
+                                    int64_t negative_threshold,
+                                    int64_t positive_threshold,
+                                    ResetCalibration* reset_calibration,
+                                    WorkQueue* work_queue) {
+  // candidate amounts in ascending order (a reset that works with an amount is assumed to
+  // work with all larger ones as well)
+  constexpr int kCandidateAmounts[] = {1, 2, 5, 10, 20, 50, 100, 200};
+  constexpr int kCandidateNo = static_cast<int>(std::size(kCandidateAmounts));
+  static_assert(kCandidateAmounts[kCandidateNo - 1] <= kMaxSequenceExecutions);
+  // leave room in the code page for the remaining sequences and the sample scaffolding
+  constexpr size_t kMaxResetCodeSize = kPagesize / 2;
+  // the search probes every candidate once; only the amount it settles on has to pass the
+  // remaining repetitions
+  constexpr int kReliabilityRepetitions = 3;
+
+  WorkQueue local_work_queue;
+  if (work_queue == nullptr) {
+    work_queue = &local_work_queue;
+  }
+  size_t max_instruction_no = code_generator_.GetNumberOfInstructions();
+  size_t trigger_idx;
+  while (work_queue->Next(max_instruction_no, &trigger_idx)) {
+    x86Instruction trigger_sequence = code_generator_.CreateInstructionFromIndex(trigger_idx);
+    if (trigger_sequence.IsSleep()) {
+      // the sleeps are only valid reset sequences
+      continue;
+    }
+    LOG_INFO("calibrating resets of trigger " + std::to_string(trigger_idx) + "/"
+                 + std::to_string(max_instruction_no - 1));
+    int64_t lower_threshold;
+    int64_t upper_threshold;
+    int64_t reset_tolerance;
+    GetTriggerEqualsMeasurementThresholds(trigger_sequence.instruction_uid, negative_threshold,
+                                          positive_threshold, &lower_threshold,
+                                          &upper_threshold, &reset_tolerance);
+    executor_.SetEffectThresholds(lower_threshold, upper_threshold);
+    int calibrated_pairs = 0;
+    for (size_t reset_idx = 0; reset_idx < max_instruction_no; reset_idx++) {
+      if (IsBlacklistedTriple(trigger_idx, trigger_idx, reset_idx)) {
+        continue;
+      }
+      x86Instruction reset_sequence = code_generator_.CreateInstructionFromIndex(reset_idx);
+      if (reset_sequence.IsSleep()) {
+        // sleeps are always executed once
+        continue;
+      }
+      // the largest candidate that still fits into the code page has to work, else the
+      // reset sequence does not reset the trigger sequence at all
+      int max_idx = kCandidateNo - 1;
+      while (max_idx >= 0 && reset_sequence.byte_representation.size() *
+          kCandidateAmounts[max_idx] > kMaxResetCodeSize) {
+        max_idx--;
+      }
+      if (max_idx < 0 ||
+          !IsReliableReset(trigger_idx, reset_idx,
+                           execute_trigger_only_in_speculation, kCandidateAmounts[max_idx],
+                           1, lower_threshold, upper_threshold, reset_tolerance)) {
+        continue;
+      }
+      // binary search for the smallest working candidate
+      bool is_probed[kCandidateNo] = {};
+      is_probed[max_idx] = true;
+      int upper_idx = max_idx;
+      int lower_idx = -1;
+      while (upper_idx - lower_idx > 1) {
+        int middle_idx = (lower_idx + upper_idx) / 2;
+        if (IsReliableReset(trigger_idx, reset_idx,
+                            execute_trigger_only_in_speculation, kCandidateAmounts[middle_idx],
+                            1, lower_threshold, upper_threshold, reset_tolerance)) {
+          upper_idx = middle_idx;
+          is_probed[middle_idx] = true;
+        } else {
+          lower_idx = middle_idx;
+        }
+      }
+      // a candidate that passed its probe by chance gets replaced by the next larger one
+      while (upper_idx <= max_idx &&
+          !IsReliableReset(trigger_idx, reset_idx, execute_trigger_only_in_speculation,
+                           kCandidateAmounts[upper_idx],
+                           kReliabilityRepetitions - (is_probed[upper_idx] ? 1 : 0),
+                           lower_threshold, upper_threshold, reset_tolerance)) {
+        upper_idx++;
+      }
+      if (upper_idx > max_idx) {
+        continue;
+      }
+      reset_calibration->SetExecutionsAmount(trigger_sequence.instruction_uid,
+                                             reset_sequence.instruction_uid,
+                                             kCandidateAmounts[upper_idx]);
+      calibrated_pairs++;
+    }
+    LOG_INFO("calibrated " + std::to_string(calibrated_pairs) + " reset sequences");
+  }
+}
+
+bool Core::IsReliableReset(size_t trigger_idx,
+                           size_t reset_idx,
+                           bool execute_trigger_only_in_speculation,
+                           int reset_executions_amount,
+                           int repetitions,
+                           int64_t lower_threshold,
+                           int64_t upper_threshold,
+                           int64_t reset_tolerance) {
+  x86Instruction trigger_sequence = code_generator_.CreateInstructionFromIndex(trigger_idx);
+  x86Instruction reset_sequence = code_generator_.CreateInstructionFromIndex(reset_idx);
+  for (int repetition = 0; repetition < repetitions; repetition++) {
+    int64_t result;
+    int error = executor_.TestTriggerSequence(trigger_sequence.byte_representation,
+                                              trigger_sequence.byte_representation,
+                                              reset_sequence.byte_representation,
+                                              execute_trigger_only_in_speculation,
+                                              iterations_no_,
+                                              reset_executions_amount,
+                                              &result);
+    if (error == 0 && lower_threshold <= result && result <= upper_threshold) {
+      return false;
+    }
+    if (error == 0) {
+      error = executor_.TestResetSequence(trigger_sequence.byte_representation,
+                                          trigger_sequence.byte_representation,
+                                          reset_sequence.byte_representation,
+                                          iterations_no_, reset_executions_amount,
+                                          &result);
+    }
+    if (error == kTestrunHang) {
+      BlacklistHangingTriple(trigger_idx, trigger_idx, reset_idx);
+    }
+    if (error != 0 || result <= -reset_tolerance || reset_tolerance <= result) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Core::SetResetCalibration(const ResetCalibration& reset_calibration) {
+  reset_calibration_ = reset_calibration;
+}
+
+void Core::SetHangBlacklist(const std::string& filename) {
+  hang_blacklist_.Open(filename);
+}
+
+void Core::FindAndOutputSequenceTriggerpairs(const std::string& output_csvfilename,
+                                             const SequenceSearchConfig& sequence_search_config,
+                                             bool execute_trigger_only_in_speculation,
+                                             int64_t negative_threshold,
+                                             int64_t positive_threshold,
+                                             WorkQueue* work_queue) {
+  std::ofstream output_csvfile(output_csvfilename);
+  if (output_csvfile.fail()) {
+    LOG_ERROR("Couldn't not open " + output_csvfilename + " for writing. Aborting!");
+    std::exit(1);
+  }
+  std::string headerline("timing;"
+                         "measurement-uid;measurement-sequence;measurement-category;"
+                         "measurement-extension;measurement-isa-set;"
+                         "trigger-uid;trigger-sequence;trigger-category;trigger-extension;"
+                         "trigger-isa-set;"
+                         "reset-uid;reset-sequence;reset-category;reset-extension;"
+                         "reset-isa-set");
+  output_csvfile << headerline << std::endl;
+
+  WorkQueue local_work_queue;
+  if (work_queue == nullptr) {
+    work_queue = &local_work_queue;
+  }
+  SequenceSpace sequence_space =
+      code_generator_.CreateSequenceSpace(sequence_search_config.constraints);
+  size_t no_sequences = sequence_space.GetNumberOfSequences();
+  std::vector<size_t> sampled_ranks = SampleSequenceRanks(no_sequences, sequence_search_config);
+  size_t no_trigger_sequences = sampled_ranks.empty() ? no_sequences : sampled_ranks.size();
+  LOG_INFO("Testing " + std::to_string(no_trigger_sequences) + " of " +
+      std::to_string(no_sequences) + " trigger sequences");
+
+  size_t trigger_no;
+  while (work_queue->Next(no_trigger_sequences, &trigger_no)) {
+    size_t rank = sampled_ranks.empty() ? trigger_no : sampled_ranks[trigger_no];
+    x86Sequence trigger_sequence = code_generator_.CreateSequenceFromRank(sequence_space, rank);
+    LOG_INFO("processing trigger sequence " + std::to_string(trigger_no) +
+        " (" + trigger_sequence.assembly_code + ")");
+    TestSequenceTrigger(trigger_sequence, execute_trigger_only_in_speculation, negative_threshold,
+                        positive_threshold, &output_csvfile);
+
+    // the children of the trigger sequence replace one of its instructions by an operand
+    // variant; they are derived one at a time from the instruction decoded once
+    if (sequence_search_config.operand_variants_per_instruction == 0) {
+      continue;
+    }
+    for (size_t position = 0; position < trigger_sequence.instruction_indexes.size();
+         position++) {
+      OperandLayout operand_layout =
+          code_generator_.CreateOperandLayout(trigger_sequence.instruction_indexes[position]);
+      size_t variant_no = 0;
+      size_t no_variants = 0;
+      x86Sequence variant_sequence;
+      while (no_variants < sequence_search_config.operand_variants_per_instruction &&
+          code_generator_.CreateNextOperandVariant(trigger_sequence, position, operand_layout,
+                                                   &variant_no, &variant_sequence)) {
+        LOG_DEBUG("processing operand variant " + variant_sequence.GetUIDString() + " (" +
+            variant_sequence.assembly_code + ")");
+        TestSequenceTrigger(variant_sequence, execute_trigger_only_in_speculation,
+                            negative_threshold, positive_threshold, &output_csvfile);
+        no_variants++;
+      }
+    }
+  }
+}
+
+void Core::TestSequenceTrigger(const x86Sequence& trigger_sequence,
+                               bool execute_trigger_only_in_speculation,
+                               int64_t negative_threshold,
+                               int64_t positive_threshold,
+                               std::ofstream* output_csvfile) {
+  // the instructions do not fault on their own but they might in combination or as variant
+  int64_t result;
+  int error = executor_.TestTriggerSequence(trigger_sequence.byte_representation,
+                                            trigger_sequence.byte_representation,
+                                            trigger_sequence.byte_representation,
+                                            false,
+                                            1, 1, &result);
+  if (error != 0) {
+    LOG_DEBUG("Skipping faulting trigger sequence");
+    return;
+  }
+
+  int64_t lower_threshold;
+  int64_t upper_threshold;
+  int64_t reset_tolerance;
+  GetTriggerEqualsMeasurementThresholds(trigger_sequence.GetSequenceUID(), negative_threshold,
+                                        positive_threshold, &lower_threshold,
+                                        &upper_threshold, &reset_tolerance);
+  executor_.SetEffectThresholds(lower_threshold, upper_threshold);
+  size_t max_instruction_no = code_generator_.GetNumberOfInstructions();
+  uint64_t trigger_uid = trigger_sequence.GetSequenceUID();
+  for (size_t reset_idx = 0; reset_idx < max_instruction_no; reset_idx++) {
+    x86Instruction reset_sequence = code_generator_.CreateInstructionFromIndex(reset_idx);
+    if (!hang_blacklist_.IsEmpty() &&
+        hang_blacklist_.Contains(trigger_uid, trigger_uid, reset_sequence.instruction_uid)) {
+      continue;
+    }
+    // the reset calibration only covers single trigger instructions (whose sequence UID equals
+    // their instruction UID)
+    int reset_executions_amount = GetResetExecutionsAmount(
+        reset_sequence, reset_executions_amount_trigger_equals_measurement_, trigger_uid, true);
+    // we assume that trigger sequence equals measurement sequence
+    error = executor_.TestTriggerSequence(trigger_sequence.byte_representation,
+                                          trigger_sequence.byte_representation,
+                                          reset_sequence.byte_representation,
+                                          execute_trigger_only_in_speculation,
+                                          iterations_no_,
+                                          reset_executions_amount,
+                                          &result);
+    if (error == 0 && (result < lower_threshold || result > upper_threshold)) {
+      // check that the reset we observe is indeed triggered by this reset sequence
+      int64_t reset_test_result;
+      error = executor_.TestResetSequence(trigger_sequence.byte_representation,
+                                          trigger_sequence.byte_representation,
+                                          reset_sequence.byte_representation,
+                                          iterations_no_, reset_executions_amount,
+                                          &reset_test_result);
+      if (error == 0 && -reset_tolerance < reset_test_result &&
+          reset_test_result < reset_tolerance) {
+        std::string csv_line = std::to_string(result);
+        csv_line += ";";
+        csv_line += trigger_sequence.GetCSVRepresentation();  // measurement sequence
+        csv_line += ";";
+        csv_line += trigger_sequence.GetCSVRepresentation();
+        csv_line += ";";
+        csv_line += reset_sequence.GetCSVRepresentation();
+        *output_csvfile << csv_line << std::endl;
+      }
+    }
+    if (error == kTestrunHang) {
+      LOG_WARNING("Execution hung (trigger: " + trigger_sequence.assembly_code + ", reset: " +
+          std::string(reset_sequence.assembly_code) + "). Blacklisting the sequence triple and "
+          "skipping the trigger sequence.");
+      hang_blacklist_.Add(trigger_uid, trigger_uid, reset_sequence.instruction_uid);
+      break;
+    }
+  }
+}
+
+std::vector<size_t> Core::SampleSequenceRanks(size_t no_sequences,
+                                              const SequenceSearchConfig&
+                                              sequence_search_config) {
+  size_t no_samples = sequence_search_config.no_samples;
+  if (no_samples == 0 || no_samples >= no_sequences) {
+    return {};
+  }
+  std::mt19937_64 rand_generator(sequence_search_config.sampling_seed);
+  std::uniform_int_distribution<size_t> distribution(0, no_sequences - 1);
+  std::unordered_set<size_t> drawn_ranks;
+  std::vector<size_t> sampled_ranks;
+  sampled_ranks.reserve(no_samples);
+  while (sampled_ranks.size() < no_samples) {
+    size_t rank = distribution(rand_generator);
+    if (drawn_ranks.insert(rank).second) {
+      sampled_ranks.push_back(rank);
+    }
+  }
+  return sampled_ranks;
+}
+
 void Core::FormatTriggerPairOutput(const std::string& output_folder,
                                    const std::string& output_folder_formatted) {
   // delete and create the folder to remove all old content in there
@@ -347,7 +854,7 @@ std::vector<size_t> Core::FindNonFaultingInstructions() {
   for (size_t inst_idx = 0; inst_idx < code_generator_.GetNumberOfInstructions(); inst_idx++) {
     x86Instruction measurement_sequence = code_generator_.CreateInstructionFromIndex(inst_idx);
     int64_t result;
-    LOG_INFO("testing instruction " + measurement_sequence.assembly_code);
+    LOG_INFO("testing instruction " + std::string(measurement_sequence.assembly_code));
     int error = executor_.TestTriggerSequence(measurement_sequence.byte_representation,
                                               measurement_sequence.byte_representation,
                                               measurement_sequence.byte_representation,
@@ -360,8 +867,33 @@ std::vector<size_t> Core::FindNonFaultingInstructions() {
   return non_faulting_instruction_indexes;
 }
 
+void Core::BlacklistHangingTriple(size_t measurement_idx, size_t trigger_idx,
+                                  size_t reset_idx) {
+  x86Instruction measurement_sequence =
+      code_generator_.CreateInstructionFromIndex(measurement_idx);
+  x86Instruction trigger_sequence = code_generator_.CreateInstructionFromIndex(trigger_idx);
+  x86Instruction reset_sequence = code_generator_.CreateInstructionFromIndex(reset_idx);
+  LOG_WARNING("Execution hung (measurement: " +
+      std::string(measurement_sequence.assembly_code) +
+      ", trigger: " + std::string(trigger_sequence.assembly_code) +
+      ", reset: " + std::string(reset_sequence.assembly_code) +
+      "). Blacklisting the sequence triple.");
+  hang_blacklist_.Add(measurement_sequence.instruction_uid, trigger_sequence.instruction_uid,
+                      reset_sequence.instruction_uid);
+}
+
+bool Core::IsBlacklistedTriple(size_t measurement_idx, size_t trigger_idx,
+                               size_t reset_idx) const {
+  return !hang_blacklist_.IsEmpty() &&
+      hang_blacklist_.Contains(
+          code_generator_.CreateInstructionFromIndex(measurement_idx).instruction_uid,
+          code_generator_.CreateInstructionFromIndex(trigger_idx).instruction_uid,
+          code_generator_.CreateInstructionFromIndex(reset_idx).instruction_uid);
+}
+
 void Core::PrintFaultStatistics() {
-  Executor::PrintFaultCount();
+  executor_.PrintFaultCount();
+  executor_.PrintContaminationRate();
 }
 
 }  // namespace osiris
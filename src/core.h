@@ -16,22 +16,63 @@
 #ifndef OSIRIS_SRC_CORE_H_
 #define OSIRIS_SRC_CORE_H_
 
+#include <fstream>
 #include <string>
 #include <vector>
 
 #include "code_generator.h"
 #include "executor.h"
+#include "hang_blacklist.h"
+#include "noise_profile.h"
+#include "reset_calibration.h"
+#include "worker_pool.h"
 
 namespace osiris {
 
 using InstructionIndexSequence = std::vector<size_t>;
 
+///
+/// Budget of the search without assumptions. With screening, every triple is first tested
+/// with few samples and a loose threshold and only the candidates that pass this stage are
+/// measured with measurement_testruns samples and the actual threshold.
+///
+struct ScreeningConfig {
+  /// samples per code page of the screening stage (0 disables screening)
+  int screening_testruns = 0;
+
+  /// fraction of the threshold a difference has to exceed in the screening stage
+  double screening_threshold_fraction = 0.5;
+
+  /// samples per code page of a full measurement
+  int measurement_testruns = 10;
+};
+
+///
+/// Search with composed multi-instruction trigger sequences (see
+/// Core::FindAndOutputSequenceTriggerpairs)
+///
+struct SequenceSearchConfig {
+  /// constraints on the instructions of the trigger sequences
+  SequenceConstraints constraints;
+
+  /// number of trigger sequences drawn at random without replacement (0 enumerates all)
+  size_t no_samples = 0;
+
+  /// seed of the sampling (workers of a parallel search need the same one)
+  uint64_t sampling_seed = 0;
+
+  /// number of operand variants per instruction of a trigger sequence that are tested as
+  /// trigger sequences of their own right after it (0 tests no variants)
+  size_t operand_variants_per_instruction = 0;
+};
+
 /// The key component of Osiris.
 /// It lets the CodeGenerator generates new code samples and
 /// sends them to the executor
 class Core {
  public:
-  explicit Core(const std::string& instructions_filename);
+  explicit Core(const std::string& instructions_filename,
+                const ExecutorConfig& executor_config = ExecutorConfig());
 
   /// Searches for trigger-reset pairs without any assumption
   /// \param output_csvfilename human-readable csv output
@@ -41,10 +82,14 @@ class Core {
   ///     trigger-uid;trigger-sequence;trigger-category;trigger-extension;trigger-isa-set;
   ///     reset-uid;reset-sequence;reset-category;reset-extension;reset-isa-set
   /// \param execute_trigger_only_in_speculation toggle to execute trigger sequence only transiently
-  /// \param threshold_in_cycles absolute cycle difference for logging a success
+  /// \param threshold_in_cycles absolute difference of the metric (see ExecutorConfig::metric)
+  ///     for logging a success
+  /// \param work_queue queue handing out the measurement sequences to test (shared between
+  ///     workers of a parallel search); nullptr tests all of them
   void FindAndOutputTriggerpairsWithoutAssumptions(const std::string& output_csvfilename,
                                                    bool execute_trigger_only_in_speculation,
-                                                   int64_t threshold_in_cycles);
+                                                   int64_t threshold_in_cycles,
+                                                   WorkQueue* work_queue = nullptr);
 
   /// Searches for trigger-reset pairs with the assumption that the trigger-sequence is the same
   /// as the measurement-sequence
@@ -61,14 +106,39 @@ class Core {
   ///     trigger-uid;trigger-sequence;trigger-category;trigger-extension;trigger-isa-set;
   ///     reset-uid;reset-sequence;reset-category;reset-extension;reset-isa-set
   /// \param execute_trigger_only_in_speculation toggle to execute trigger sequence only transiently
-  /// \param negative_threshold cycle difference for logging a success
-  /// \param positive_threshold cycle difference for logging a success
+  /// \param negative_threshold difference of the metric for logging a success
+  /// \param positive_threshold difference of the metric for logging a success
+  /// \param work_queue queue handing out the trigger sequences to test (shared between
+  ///     workers of a parallel search); nullptr tests all of them. If a queue is given, the
+  ///     output folder is shared and must have been recreated by the caller.
   void FindAndOutputTriggerpairsWithTriggerEqualsMeasurement(const std::string& output_folder,
                                                              const std::string& output_csvfilename,
                                                              bool
                                                              execute_trigger_only_in_speculation,
                                                              int64_t negative_threshold,
-                                                             int64_t positive_threshold);
+                                                             int64_t positive_threshold,
+                                                             WorkQueue* work_queue = nullptr);
+
+  /// Searches for trigger-reset pairs with composed multi-instruction trigger sequences and
+  /// the assumption that the trigger sequence is the same as the measurement sequence. Every
+  /// instruction is tested as reset sequence. Trigger sequences that fault are skipped. Operand
+  /// variants of the instructions (see OperandMutator) are generated on the fly as children of
+  /// every trigger sequence.
+  /// \param output_csvfilename human-readable csv output (same format as above; the UIDs of the
+  ///     instructions of a sequence are joined by '+' and their properties by " | "; operand
+  ///     variants append '~' and their number to the UID of their instruction)
+  /// \param sequence_search_config trigger sequences to test
+  /// \param execute_trigger_only_in_speculation toggle to execute trigger sequence only transiently
+  /// \param negative_threshold difference of the metric for logging a success
+  /// \param positive_threshold difference of the metric for logging a success
+  /// \param work_queue queue handing out the trigger sequences to test (shared between
+  ///     workers of a parallel search); nullptr tests all of them
+  void FindAndOutputSequenceTriggerpairs(const std::string& output_csvfilename,
+                                         const SequenceSearchConfig& sequence_search_config,
+                                         bool execute_trigger_only_in_speculation,
+                                         int64_t negative_threshold,
+                                         int64_t positive_threshold,
+                                         WorkQueue* work_queue = nullptr);
 
   /// Formats output of FindAndOutputTriggerpairsWithTriggerEqualsMeasurement by disassembling all output encodings
   /// \param output_folder output folder of FindAndOutputTriggerpairsWithTriggerEqualsMeasurement
@@ -76,8 +146,46 @@ class Core {
   void FormatTriggerPairOutput(const std::string& output_folder,
                                const std::string& output_folder_formatted);
 
+  /// Measures the noise of every measurement sequence without trigger sequence, i.e., the spread
+  /// of the test result if there is no effect at all
+  /// \param noise_profile profile the measurement sequences are added to
+  void CreateNoiseProfile(NoiseProfile* noise_profile);
+
+  /// Sets the budget of the search and enables or disables screening
+  /// \param screening_config configuration
+  void SetScreeningConfig(const ScreeningConfig& screening_config);
+
+  /// Derives the thresholds of profiled measurement sequences from the given profile instead
+  /// of using the thresholds passed to the search functions
+  /// \param noise_profile noise profile
+  void SetNoiseProfile(const NoiseProfile& noise_profile);
+
+  /// Determines for every (trigger, reset) pair of the search with trigger sequence ==
+  /// measurement sequence the smallest amount of reset executions that reliably resets the
+  /// trigger sequence. Pairs without effect even at the maximum amount are not added.
+  /// \param execute_trigger_only_in_speculation toggle to execute trigger sequence only transiently
+  /// \param negative_threshold difference of the metric that counts as effect
+  /// \param positive_threshold difference of the metric that counts as effect
+  /// \param reset_calibration calibration the pairs are added to
+  /// \param work_queue if given, the trigger sequences are drawn from this (shared) queue
+  void CalibrateResetExecutions(bool execute_trigger_only_in_speculation,
+                                int64_t negative_threshold,
+                                int64_t positive_threshold,
+                                ResetCalibration* reset_calibration,
+                                WorkQueue* work_queue = nullptr);
+
+  /// Executes calibrated reset sequences as often as the calibration demands instead of the
+  /// fixed default amounts
+  /// \param reset_calibration reset calibration
+  void SetResetCalibration(const ResetCalibration& reset_calibration);
+
+  /// Skips the sequence triples recorded in the blacklist file and records the triples that
+  /// hang from now on in it s.t. other stages and workers skip them as well
+  /// \param filename hang blacklist file (see HangBlacklist)
+  void SetHangBlacklist(const std::string& filename);
+
   ///
-  /// Print fault statistics of the underlying executor
+  /// Print fault and contamination statistics of the underlying executor
   ///
   void PrintFaultStatistics();
 
@@ -92,11 +200,128 @@ class Core {
   /// \return vector of non-faulting instructions indexes
   std::vector<size_t> FindNonFaultingInstructions();
 
+  ///
+  /// (trigger, reset) pair that passed a stage of the search without assumptions
+  ///
+  struct TriggerResetCandidate {
+    size_t trigger_idx;
+    size_t reset_idx;
+    int64_t result;
+  };
+
+  /// Tests a sequence triple with the baseline cache of the executor (keyed by the reset
+  /// sequence) as used by the search without assumptions
+  /// \param measurement_sequence measurement sequence
+  /// \param trigger_sequence trigger sequence
+  /// \param reset_sequence reset sequence
+  /// \param execute_trigger_only_in_speculation execute the trigger sequence only transiently
+  /// \param no_testruns samples per code page
+  /// \param reset_idx index of the reset sequence
+  /// \param result outputs the difference of the metric
+  /// \return 0 if no failure occurred (see Executor::TestTriggerSequenceWithCachedBaseline)
+  int TestTripleWithCachedBaseline(const x86Instruction& measurement_sequence,
+                                   const x86Instruction& trigger_sequence,
+                                   const x86Instruction& reset_sequence,
+                                   bool execute_trigger_only_in_speculation,
+                                   int no_testruns,
+                                   size_t reset_idx,
+                                   int64_t* result);
+
+  /// Returns how often a reset sequence is executed (sleeps are executed only once,
+  /// calibrated sequences as often as the reset calibration demands)
+  /// \param reset_sequence reset sequence
+  /// \param default_amount amount for all other sequences
+  /// \param trigger_uid UID of the trigger sequence to reset
+  /// \param only_calibrated_pair only use the amount calibrated for exactly this pair instead of
+  ///     falling back to the amount that resets all calibrated triggers (the searches that were
+  ///     not calibrated themselves keep their default amount unless the pair is calibrated)
+  /// \return amount of executions
+  int GetResetExecutionsAmount(const x86Instruction& reset_sequence, int default_amount,
+                               uint64_t trigger_uid, bool only_calibrated_pair) const;
+
+  /// Returns the thresholds of the search with trigger sequence == measurement sequence for a
+  /// trigger sequence (derived from the noise profile if the trigger sequence is profiled)
+  /// \param trigger_uid UID of the trigger sequence
+  /// \param negative_threshold default negative threshold
+  /// \param positive_threshold default positive threshold
+  /// \param lower_threshold outputs the negative threshold
+  /// \param upper_threshold outputs the positive threshold
+  /// \param reset_tolerance outputs the tolerance of the reset test
+  void GetTriggerEqualsMeasurementThresholds(uint64_t trigger_uid,
+                                             int64_t negative_threshold,
+                                             int64_t positive_threshold,
+                                             int64_t* lower_threshold,
+                                             int64_t* upper_threshold,
+                                             int64_t* reset_tolerance) const;
+
+  /// Checks whether the reset sequence reliably resets the trigger sequence (== measurement
+  /// sequence), i.e., the effect of the trigger sequence is visible and the reset test passes
+  /// in every repetition
+  /// \param trigger_idx index of the trigger sequence
+  /// \param reset_idx index of the reset sequence
+  /// \param execute_trigger_only_in_speculation execute the trigger sequence only transiently
+  /// \param reset_executions_amount amount of reset executions
+  /// \param repetitions number of consecutive tests that have to succeed
+  /// \param lower_threshold negative difference that counts as effect
+  /// \param upper_threshold positive difference that counts as effect
+  /// \param reset_tolerance tolerance of the reset test
+  /// \return true if the reset works in all repetitions
+  bool IsReliableReset(size_t trigger_idx,
+                       size_t reset_idx,
+                       bool execute_trigger_only_in_speculation,
+                       int reset_executions_amount,
+                       int repetitions,
+                       int64_t lower_threshold,
+                       int64_t upper_threshold,
+                       int64_t reset_tolerance);
+
+  /// Tests a trigger sequence (== measurement sequence) of the sequence search with every
+  /// instruction as reset sequence
+  /// \param trigger_sequence trigger sequence
+  /// \param execute_trigger_only_in_speculation execute the trigger sequence only transiently
+  /// \param negative_threshold difference of the metric for logging a success
+  /// \param positive_threshold difference of the metric for logging a success
+  /// \param output_csvfile csv output the found pairs are written to
+  void TestSequenceTrigger(const x86Sequence& trigger_sequence,
+                           bool execute_trigger_only_in_speculation,
+                           int64_t negative_threshold,
+                           int64_t positive_threshold,
+                           std::ofstream* output_csvfile);
+
+  /// Selects the ranks of the trigger sequences of the sequence search
+  /// \param no_sequences number of sequences in the sequence space
+  /// \param sequence_search_config configuration of the sampling
+  /// \return ranks in the order in which they are tested; empty if all sequences are tested in
+  ///     order (s.t. the whole space is not materialized)
+  static std::vector<size_t> SampleSequenceRanks(size_t no_sequences,
+                                                 const SequenceSearchConfig&
+                                                 sequence_search_config);
+
+  /// Remembers a sequence triple whose execution exceeded the watchdog timeout s.t. it is
+  /// not executed again (persisted if a blacklist file is set, see SetHangBlacklist)
+  /// \param measurement_idx index of the measurement sequence
+  /// \param trigger_idx index of the trigger sequence
+  /// \param reset_idx index of the reset sequence
+  void BlacklistHangingTriple(size_t measurement_idx, size_t trigger_idx, size_t reset_idx);
+
+  /// Checks whether a sequence triple was blacklisted by BlacklistHangingTriple
+  /// \param measurement_idx index of the measurement sequence
+  /// \param trigger_idx index of the trigger sequence
+  /// \param reset_idx index of the reset sequence
+  /// \return true if the triple must not be executed
+  bool IsBlacklistedTriple(size_t measurement_idx, size_t trigger_idx, size_t reset_idx) const;
+
   CodeGenerator code_generator_;
   Executor executor_;
   int iterations_no_;
   int reset_executions_amount_without_assumptions_;
   int reset_executions_amount_trigger_equals_measurement_;
+  uint64_t baseline_max_age_;
+  int64_t reset_tolerance_;
+  ScreeningConfig screening_config_;
+  NoiseProfile noise_profile_;
+  ResetCalibration reset_calibration_;
+  HangBlacklist hang_blacklist_;
 };
 
 }  // namespace osiris
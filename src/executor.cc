@@ -15,25 +15,134 @@
 
 #include "executor.h"
 
-#include <setjmp.h>
+#include <asm/prctl.h>
+#include <cpuid.h>
+#include <linux/perf_event.h>
 #include <signal.h>
 #include <sys/mman.h>
-
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstddef>
 #include <cstring>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <sstream>
 
 #include "code_generator.h"
 #include "logger.h"
 
+// older glibc versions do not name the thread id field of struct sigevent
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
 namespace osiris {
 
-Executor::Executor() {
+// layout of the result memory: timing results, control page and the stack used for calls
+// out of the generated code (see AddTimerRead)
+constexpr size_t kTimerStackSize = 2 * kPagesize;
+constexpr size_t kResultMemorySize = 2 * kPagesize + kTimerStackSize;
+
+// slots of the control page (in units of uint64_t)
+constexpr int kControlSlotCounterIndex = 0;  // counter read by RDPMC
+constexpr int kControlSlotSavedRSP = 1;  // RSP of the generated code during calls
+constexpr int kControlSlotSavedR10 = 2;  // timer start value during calls
+// RDPMC counter index and start value of each performance counter
+constexpr int kControlSlotPerformanceCounterIndexes = 8;
+constexpr int kControlSlotPerformanceCounterStarts =
+    kControlSlotPerformanceCounterIndexes + kMaxPerformanceCounters;
+
+// number of empty measurements used to calibrate a timer backend
+constexpr int kTimerCalibrationSamples = 256;
+
+// size of the huge pages backing the code page pool (see ExecutorConfig::use_huge_pages)
+constexpr size_t kHugePagesize = 2 * 1024 * 1024;
+
+// executions of code pages that share one arming of the watchdog and one contamination check
+// (both take syscalls that would otherwise dominate the runtime of short code pages)
+constexpr int kMaxExecutionsPerBatch = 16;
+
+// contaminated batches in a row after which the samples are kept anyway (the contamination
+// is persistent, e.g. the tested code itself triggers page faults)
+constexpr int kMaxConsecutiveContaminatedBatches = 16;
+
+// relative deviation of the ratio of core to reference cycles from its usual value that
+// indicates a frequency transition during an execution
+constexpr double kMaxFrequencyRatioDeviation = 0.05;
+
+// weight of a clean execution in the usual ratio of core to reference cycles
+constexpr double kFrequencyRatioUpdateWeight = 1.0 / 16;
+
+Executor::Executor(const ExecutorConfig& config) : planned_samples_per_execution_(1),
+                                                   config_(config),
+                                                   serialization_primitive_(
+                                                       SerializationPrimitive::CPUID),
+                                                   timer_backend_(TimerBackend::RDTSC),
+                                                   timer_overhead_(0),
+                                                   cycle_counter_{Metric::CYCLES, -1, nullptr},
+                                                   frequency_counters_fd_(-1),
+                                                   reference_cycles_fd_(-1),
+                                                   frequency_ratio_(0),
+                                                   metric_result_index_(0),
+                                                   fork_server_pid_(-1),
+                                                   fork_server_socket_fd_(-1),
+                                                   baseline_max_age_(kDefaultBaselineMaxAge),
+                                                   execution_no_(0),
+                                                   effect_negative_threshold_(-50),
+                                                   effect_positive_threshold_(50) {
+  sample_order_generator_.seed(std::random_device()());
+  if (config_.samples_per_execution < 1 ||
+      config_.samples_per_execution > kMaxSamplesPerExecution) {
+    LOG_ERROR("Samples per execution must be between 1 and " +
+        std::to_string(kMaxSamplesPerExecution) + ". Aborting!");
+    std::exit(1);
+  }
+  if (config_.code_page_pool_size < 2) {
+    LOG_ERROR("The code page pool needs at least 2 pages. Aborting!");
+    std::exit(1);
+  }
+  if (config_.watchdog_timeout_ms < 0) {
+    LOG_ERROR("The watchdog timeout must not be negative. Aborting!");
+    std::exit(1);
+  }
+  if (config_.sequential_max_testruns < 0 || config_.sequential_batch_size < 1 ||
+      config_.sequential_error_rate <= 0 || config_.sequential_error_rate >= 0.5) {
+    LOG_ERROR("Invalid configuration of the adaptive sampling mode. Aborting!");
+    std::exit(1);
+  }
+  if (config_.code_alignment < 0 || config_.code_alignment > kMaxCodeAlignment ||
+      (config_.code_alignment & (config_.code_alignment - 1)) != 0) {
+    LOG_ERROR("The code alignment must be a power of two of at most " +
+        std::to_string(kMaxCodeAlignment) + " (or 0). Aborting!");
+    std::exit(1);
+  }
+  result_memory_begin_ = config_.data_memory_begin + (kResultMemoryBegin - kMemoryBegin);
+  control_memory_begin_ = result_memory_begin_ + kPagesize;
+  if (config_.data_memory_begin % kPagesize != 0 ||
+      result_memory_begin_ + kResultMemorySize > (1ull << 31)) {
+    LOG_ERROR("Invalid start of the execution memory. Aborting!");
+    std::exit(1);
+  }
+
+  // the fork server has to see all memory written by us
+  int memory_sharing = config_.use_fork_server ? MAP_SHARED : MAP_PRIVATE;
+
   // allocate memory for memory accesses during execution
   for (size_t i = 0; i < execution_data_pages_.size(); i++) {
-    void* addr = reinterpret_cast<void*>(kMemoryBegin + i * kPagesize);
+    void* addr = reinterpret_cast<void*>(config_.data_memory_begin + i * kPagesize);
     // check that page is not mapped
     int ret = msync(addr, kPagesize, 0);
     if (ret != -1 || errno != ENOMEM) {
@@ -43,54 +152,169 @@ Executor::Executor() {
     char* page = static_cast<char*>(mmap(addr,
                                          kPagesize,
                                          PROT_READ | PROT_WRITE,
-                                         MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS,
+                                         MAP_FIXED | memory_sharing | MAP_ANONYMOUS,
                                          -1,
                                          0));
 
-    if (page != reinterpret_cast<void*>(kMemoryBegin + i * kPagesize) || page == MAP_FAILED) {
+    if (page != addr || page == MAP_FAILED) {
       LOG_ERROR("Couldn't allocate memory for execution (data memory). Aborting!");
       std::exit(1);
     }
     execution_data_pages_[i] = page;
   }
 
-  // allocate memory that holds the actual instructions we execute
-  for (size_t i = 0; i < execution_code_pages_.size(); i++) {
-    execution_code_pages_[i] = static_cast<char*>(mmap(nullptr,
-                                                       kPagesize,
-                                                       PROT_READ | PROT_WRITE | PROT_EXEC,
-                                                       MAP_PRIVATE | MAP_ANONYMOUS,
-                                                       -1,
-                                                       0));
-    if (execution_code_pages_[i] == MAP_FAILED) {
-      LOG_ERROR("Couldn't allocate memory for execution (exec memory). Aborting!");
+  // allocate memory where batched executions store their timing results followed by the
+  // control page and the timer stack
+  void* result_addr = reinterpret_cast<void*>(result_memory_begin_);
+  for (size_t offset = 0; offset < kResultMemorySize; offset += kPagesize) {
+    int ret = msync(static_cast<char*>(result_addr) + offset, kPagesize, 0);
+    if (ret != -1 || errno != ENOMEM) {
+      LOG_ERROR("Result page is already mapped. Aborting!");
       std::exit(1);
     }
   }
+  void* result_page = mmap(result_addr,
+                           kResultMemorySize,
+                           PROT_READ | PROT_WRITE,
+                           MAP_FIXED | memory_sharing | MAP_ANONYMOUS,
+                           -1,
+                           0);
+  if (result_page != result_addr || result_page == MAP_FAILED) {
+    LOG_ERROR("Couldn't allocate memory for execution (result memory). Aborting!");
+    std::exit(1);
+  }
+  execution_result_page_ = static_cast<volatile uint64_t*>(result_page);
+  execution_control_page_ = reinterpret_cast<volatile uint64_t*>(control_memory_begin_);
+
+  // the generated code depends on the number of performance counters
+  OpenPerformanceCounters();
+  if (config_.discard_contaminated_samples) {
+    OpenFrequencyCounters();
+  }
+
+  // allocate the pool of pages that hold the actual instructions we execute
+  size_t pool_size = config_.code_page_pool_size;
+  char* code_pool = static_cast<char*>(MAP_FAILED);
+  if (config_.use_huge_pages) {
+    code_pool_mapping_size_ = (pool_size * kPagesize + kHugePagesize - 1) / kHugePagesize *
+        kHugePagesize;
+    code_pool = static_cast<char*>(mmap(nullptr,
+                                        code_pool_mapping_size_,
+                                        PROT_READ | PROT_WRITE | PROT_EXEC,
+                                        memory_sharing | MAP_ANONYMOUS | MAP_HUGETLB,
+                                        -1,
+                                        0));
+    if (code_pool == MAP_FAILED) {
+      LOG_WARNING("Couldn't allocate huge pages for the code (see /proc/sys/vm/nr_hugepages). "
+                  "Falling back to regular pages.");
+    }
+  }
+  if (code_pool == MAP_FAILED) {
+    code_pool_mapping_size_ = pool_size * kPagesize;
+    code_pool = static_cast<char*>(mmap(nullptr,
+                                        code_pool_mapping_size_,
+                                        PROT_READ | PROT_WRITE | PROT_EXEC,
+                                        memory_sharing | MAP_ANONYMOUS,
+                                        -1,
+                                        0));
+  }
+  if (code_pool == MAP_FAILED) {
+    LOG_ERROR("Couldn't allocate memory for execution (exec memory). Aborting!");
+    std::exit(1);
+  }
+  execution_code_pages_.resize(pool_size);
+  code_pages_last_written_index_.assign(pool_size, 0);
+  code_pages_samples_per_execution_.assign(pool_size, 1);
+  code_pages_key_.assign(pool_size, 0);
+  code_pages_identity_.assign(pool_size, byte_array());
+  code_pages_last_used_.assign(pool_size, 0);
+  for (size_t i = 0; i < pool_size; i++) {
+    execution_code_pages_[i] = code_pool + i * kPagesize;
+    InitializeCodePage(i);
+  }
+  next_code_page_ = 0;
+  code_page_use_counter_ = pool_size;
+  BuildCodePageTemplates();
 
 #if DEBUGMODE == 0
   // if we are not in DEBUGMODE this will instead be inlined in Executor::ExecuteCodePage()
-  std::array<int, 4> signals_to_handle = {SIGSEGV, SIGILL, SIGFPE, SIGTRAP};
-  // register fault handler
-  RegisterFaultHandler<signals_to_handle.size()>(signals_to_handle);
+  // (the handler is shared by all executors of the process)
+  AcquireFaultHandler();
 #endif
+
+  if (config_.use_fork_server) {
+    StartForkServer();
+  }
+
+  // the serialization benchmark needs a working timer
+  SelectTimerBackend();
+
+  // the templates were built with CPUID which serves as reference for the selection
+  if (config_.serialization_primitive == SerializationPrimitive::AUTO) {
+    SelectSerializationPrimitive();
+  } else {
+    if (!IsSerializationPrimitiveSupported(config_.serialization_primitive)) {
+      LOG_ERROR("The CPU does not support the serialization primitive " +
+          SerializationPrimitiveToString(config_.serialization_primitive) + ". Aborting!");
+      std::exit(1);
+    }
+    SetSerializationPrimitive(config_.serialization_primitive);
+  }
+
+  // the overhead of the timer depends on the serialization primitive hence it is
+  // calibrated last
+  TimerCalibration calibration;
+  if (CalibrateTimerBackend(timer_backend_, &calibration)) {
+    LOG_ERROR("Couldn't calibrate the timer " + TimerBackendToString(timer_backend_) +
+        ". Aborting!");
+    std::exit(1);
+  }
+  timer_overhead_ = std::llround(calibration.overhead);
+  LOG_INFO("Using timer " + TimerBackendToString(timer_backend_) + " (overhead: " +
+      std::to_string(timer_overhead_) + ", jitter: " + std::to_string(calibration.jitter) +
+      ")");
+  for (size_t i = 0; i < performance_counters_.size(); i++) {
+    counter_overheads_[i] = std::llround(calibration.counter_overheads[i]);
+    LOG_INFO("Recording " + MetricToString(performance_counters_[i].metric) + " (overhead: " +
+        std::to_string(counter_overheads_[i]) + ")");
+  }
+
+  // the calibration is done on timings; from now on the testing functions report the metric
+  if (config_.metric != Metric::CYCLES) {
+    for (size_t i = 0; i < performance_counters_.size(); i++) {
+      if (performance_counters_[i].metric == config_.metric) {
+        metric_result_index_ = static_cast<int>(i) + 1;
+      }
+    }
+  }
 }
 
 Executor::~Executor() {
+  if (config_.use_fork_server) {
+    StopForkServer();
+  }
+  ClosePerformanceCounters();
 #if DEBUGMODE == 0
   // if we are not in DEBUGMODE this will instead be inlined in Executor::ExecuteCodePage()
-  std::array<int, 4> signals_to_handle = {SIGSEGV, SIGILL, SIGFPE, SIGTRAP};
-  UnregisterFaultHandler<signals_to_handle.size()>(signals_to_handle);
+  ReleaseFaultHandler();
 #endif
+  // the memory lives at fixed addresses hence it must be released for the next executor
+  munmap(execution_code_pages_[0], code_pool_mapping_size_);
+  munmap(const_cast<uint64_t*>(execution_result_page_), kResultMemorySize);
+  for (void* page : execution_data_pages_) {
+    munmap(page, kPagesize);
+  }
 }
 
-int Executor::TestResetSequence(const byte_array& trigger_sequence,
-                                const byte_array& measurement_sequence,
-                                const byte_array& reset_sequence,
+int Executor::TestResetSequence(ByteView trigger_sequence,
+                                ByteView measurement_sequence,
+                                ByteView reset_sequence,
                                 int no_testruns,
                                 int reset_executions_amount,
                                 int64_t* cycles_difference) {
-  byte_array nop_sequence = CreateSequenceOfNOPs(reset_sequence.size());
+  PlanSamplesPerExecution(no_testruns);
+  // NOPs in place of the trigger sequence keep the layout of both code pages the same
+  byte_array nop_sequence = CreateSequenceOfNOPs(trigger_sequence.size());
   std::vector<int64_t> clean_runs;
   std::vector<int64_t> noisy_runs;
   clean_runs.reserve(no_testruns);
@@ -99,210 +323,561 @@ int Executor::TestResetSequence(const byte_array& trigger_sequence,
   // intuition:
   //  given a valid measure and trigger sequence:
   //  when reset;measure == trigger;reset;measure (or very small diff) -> reset sequence works
-  CreateResetTestrunCode(0, nop_sequence, measurement_sequence, reset_sequence,
-                         reset_executions_amount);
-  CreateResetTestrunCode(1, trigger_sequence, measurement_sequence, reset_sequence,
-                         reset_executions_amount);
-  for (int i = 0; i < no_testruns; i++) {
-    // get timing with reset sequence
-    uint64_t cycles_elapsed_reset_measure;
-    int error = ExecuteTestrun(0, &cycles_elapsed_reset_measure);
-    if (error) {
-      // abort
-      *cycles_difference = -1;
-      return 1;
-    }
-    clean_runs.push_back(cycles_elapsed_reset_measure);
+  int clean_codepage = CreateResetTestrunCode(nop_sequence, measurement_sequence,
+                                              reset_sequence, reset_executions_amount);
+  int noisy_codepage = CreateResetTestrunCode(trigger_sequence, measurement_sequence,
+                                              reset_sequence, reset_executions_amount);
+  // get timing with and without trigger sequence before the reset sequence
+  int error = CollectPairedTestrunSamples(clean_codepage, noisy_codepage, no_testruns,
+                                          &clean_runs, &noisy_runs);
+  if (error) {
+    // abort
+    *cycles_difference = -1;
+    return error;
   }
-
-  for (int i = 0; i < no_testruns; i++) {
-    // get timing without reset sequence
-    uint64_t cycles_elapsed_trigger_reset_measure;
-    int error = ExecuteTestrun(1, &cycles_elapsed_trigger_reset_measure);
-    if (error) {
-      // abort
-      *cycles_difference = -1;
-      return 1;
-    }
-    noisy_runs.push_back(cycles_elapsed_trigger_reset_measure);
-  }
-  *cycles_difference = static_cast<int64_t>(median<int64_t>(clean_runs) -
-      median<int64_t>(noisy_runs));
+  SampleStatistics statistics_clean;
+  SampleStatistics statistics_noisy;
+  SampleStatistics statistics_difference;
+  *cycles_difference = static_cast<int64_t>(ComputeDifferenceOfTestruns(
+      &clean_runs, &noisy_runs, &statistics_clean, &statistics_noisy, &statistics_difference));
   return 0;
 }
 
-int Executor::TestSequenceTriple(const byte_array& trigger_sequence,
-                                 const byte_array& measurement_sequence,
-                                 const byte_array& reset_sequence,
+int Executor::TestSequenceTriple(ByteView trigger_sequence,
+                                 ByteView measurement_sequence,
+                                 ByteView reset_sequence,
                                  int no_testruns,
                                  int64_t* cycles_difference) {
-  std::vector<int64_t> results;
-  CreateTestrunCode(0, trigger_sequence, reset_sequence, measurement_sequence, 1);
-  CreateTestrunCode(1, reset_sequence, trigger_sequence, measurement_sequence, 1);
-  for (int i = 0; i < no_testruns; i++) {
-    // get timing for first experiment
-    uint64_t cycles_elapsed_trigger_reset;
-    int error = ExecuteTestrun(0, &cycles_elapsed_trigger_reset);
-    if (error) {
-      // abort
-      *cycles_difference = -1;
-      return 1;
-    }
-
-    // get timing for second experiment
-    uint64_t cycles_elapsed_reset_trigger;
-    error = ExecuteTestrun(1, &cycles_elapsed_reset_trigger);
-    if (error) {
-      // abort
-      *cycles_difference = -1;
-      return 1;
-    }
-    int64_t cycles_difference_per_run = static_cast<int64_t>(cycles_elapsed_trigger_reset) -
-        static_cast<int64_t>(cycles_elapsed_reset_trigger);
-    results.push_back(cycles_difference_per_run);
+  PlanSamplesPerExecution(no_testruns);
+  int trigger_reset_codepage = CreateTestrunCode(trigger_sequence, reset_sequence,
+                                                 measurement_sequence, 1);
+  int reset_trigger_codepage = CreateTestrunCode(reset_sequence, trigger_sequence,
+                                                 measurement_sequence, 1);
+  std::vector<int64_t> results_trigger_reset;
+  std::vector<int64_t> results_reset_trigger;
+  results_trigger_reset.reserve(no_testruns);
+  results_reset_trigger.reserve(no_testruns);
+
+  int error = CollectPairedTestrunSamples(trigger_reset_codepage, reset_trigger_codepage,
+                                          no_testruns, &results_trigger_reset,
+                                          &results_reset_trigger);
+  if (error) {
+    // abort
+    *cycles_difference = -1;
+    return error;
   }
-  *cycles_difference = static_cast<int64_t>(median<int64_t>(results));
+  SampleStatistics statistics_trigger_reset;
+  SampleStatistics statistics_reset_trigger;
+  SampleStatistics statistics_difference;
+  *cycles_difference = static_cast<int64_t>(ComputeDifferenceOfTestruns(
+      &results_trigger_reset, &results_reset_trigger, &statistics_trigger_reset,
+      &statistics_reset_trigger, &statistics_difference));
   return 0;
 }
 
-int Executor::TestTriggerSequence(const byte_array& trigger_sequence,
-                                  const byte_array& measurement_sequence,
-                                  const byte_array& reset_sequence,
+int Executor::TestTriggerSequence(ByteView trigger_sequence,
+                                  ByteView measurement_sequence,
+                                  ByteView reset_sequence,
                                   bool execute_trigger_only_in_speculation,
                                   int no_testruns,
                                   int reset_executions_amount,
                                   int64_t* cycles_difference) {
-  // disabled for performance reasons (on 2020-09-03 by Osiris dev)
-  // can be enabled again without losing too much performance
-  byte_array nop_sequence;// = CreateSequenceOfNOPs(trigger_sequence.size());
-
+  bool is_sequential = config_.sequential_max_testruns > 0;
+  PlanSamplesPerExecution(is_sequential ? config_.sequential_batch_size : no_testruns);
   // vectors are preallocated and just get cleared on everyrun for performance
+  results_trigger.reserve(no_testruns);
+  results_notrigger.reserve(no_testruns);
   results_trigger.clear();
   results_notrigger.clear();
+
+  int trigger_codepage = CreateTriggerTestrunCode(trigger_sequence, measurement_sequence,
+                                                  reset_sequence,
+                                                  execute_trigger_only_in_speculation,
+                                                  reset_executions_amount);
+  int notrigger_codepage = CreateNoTriggerTestrunCode(trigger_sequence.size(),
+                                                      measurement_sequence, reset_sequence,
+                                                      execute_trigger_only_in_speculation,
+                                                      reset_executions_amount);
+
+  // get timing with and without trigger sequence
+  std::vector<std::vector<int64_t>>* counter_results_trigger = nullptr;
+  std::vector<std::vector<int64_t>>* counter_results_notrigger = nullptr;
+  int error;
+  if (is_sequential) {
+    error = CollectSamplesSequentially(trigger_codepage, notrigger_codepage, 0);
+  } else {
+    counter_results_trigger = PrepareCounterResults(&counter_results_trigger_);
+    counter_results_notrigger = PrepareCounterResults(&counter_results_notrigger_);
+    error = CollectPairedTestrunSamples(trigger_codepage, notrigger_codepage, no_testruns,
+                                        &results_trigger, &results_notrigger,
+                                        counter_results_trigger, counter_results_notrigger);
+  }
+  if (error) {
+    // abort
+    *cycles_difference = -1;
+    return error;
+  }
+  *cycles_difference = static_cast<int64_t>(ComputeDifferenceOfTestruns(
+      &results_notrigger, &results_trigger, &statistics_notrigger_, &statistics_trigger_,
+      &statistics_difference_));
+
+  counter_differences_.clear();
+  if (counter_results_trigger != nullptr) {
+    for (size_t i = 0; i < performance_counters_.size(); i++) {
+      counter_differences_.push_back(static_cast<int64_t>(
+          QuantileInPlace(&counter_results_notrigger_[i], 0.5) -
+              QuantileInPlace(&counter_results_trigger_[i], 0.5)));
+    }
+  }
+  return 0;
+}
+
+int Executor::TestTriggerSequenceWithCachedBaseline(ByteView trigger_sequence,
+                                                    ByteView measurement_sequence,
+                                                    ByteView reset_sequence,
+                                                    bool execute_trigger_only_in_speculation,
+                                                    int no_testruns,
+                                                    int reset_executions_amount,
+                                                    uint64_t baseline_key,
+                                                    int64_t* cycles_difference) {
+  bool is_sequential = config_.sequential_max_testruns > 0;
+  PlanSamplesPerExecution(is_sequential ? config_.sequential_batch_size : no_testruns);
   results_trigger.reserve(no_testruns);
   results_notrigger.reserve(no_testruns);
+  results_trigger.clear();
+  results_notrigger.clear();
 
+  int trigger_codepage = CreateTriggerTestrunCode(trigger_sequence, measurement_sequence,
+                                                  reset_sequence,
+                                                  execute_trigger_only_in_speculation,
+                                                  reset_executions_amount);
+
+  // only measure the run without trigger sequence if there is no usable cached value
+  size_t trigger_padding_length = config_.match_baseline_layout ? trigger_sequence.size() : 0;
+  auto cache_entry = baseline_cache_.find(baseline_key);
+  bool cache_hit = cache_entry != baseline_cache_.end() &&
+      execution_no_ - cache_entry->second.measured_at_execution < baseline_max_age_ &&
+      cache_entry->second.execute_trigger_only_in_speculation ==
+          execute_trigger_only_in_speculation &&
+      cache_entry->second.no_testruns == no_testruns &&
+      cache_entry->second.reset_executions_amount == reset_executions_amount &&
+      cache_entry->second.trigger_padding_length == trigger_padding_length;
+  int notrigger_codepage = -1;
+  if (!cache_hit) {
+    notrigger_codepage = CreateNoTriggerTestrunCode(trigger_sequence.size(),
+                                                    measurement_sequence, reset_sequence,
+                                                    execute_trigger_only_in_speculation,
+                                                    reset_executions_amount);
+  }
 
-  if (execute_trigger_only_in_speculation) {
-    CreateSpeculativeTriggerTestrunCode(0, measurement_sequence,
-                                        trigger_sequence,
-                                        reset_sequence, reset_executions_amount);
-    CreateSpeculativeTriggerTestrunCode(1, measurement_sequence,
-                                        nop_sequence,
-                                        reset_sequence, reset_executions_amount);
+  int error;
+  if (is_sequential) {
+    // the samples with trigger sequence are compared against the cached median
+    error = CollectSamplesSequentially(trigger_codepage, notrigger_codepage,
+                                       cache_hit ? cache_entry->second.statistics.median : 0);
+  } else if (cache_hit) {
+    error = CollectTestrunSamples(trigger_codepage, no_testruns, &results_trigger);
   } else {
-    CreateTestrunCode(0, reset_sequence, trigger_sequence, measurement_sequence,
-                      reset_executions_amount);
-    CreateTestrunCode(1, reset_sequence, nop_sequence, measurement_sequence,
-                      reset_executions_amount);
+    error = CollectPairedTestrunSamples(trigger_codepage, notrigger_codepage, no_testruns,
+                                        &results_trigger, &results_notrigger);
+  }
+  if (error) {
+    // abort
+    *cycles_difference = -1;
+    return error;
   }
 
-  // get timing with trigger sequence
-  for (int i = 0; i < no_testruns; i++) {
-    uint64_t cycles_elapsed_trigger;
-    int error = ExecuteTestrun(0, &cycles_elapsed_trigger);
+  if (cache_hit) {
+    statistics_trigger_ = ComputeSampleStatistics(&results_trigger);
+    statistics_notrigger_ = cache_entry->second.statistics;
+    statistics_difference_ = SampleStatistics();
+    *cycles_difference = static_cast<int64_t>(statistics_notrigger_.median -
+        statistics_trigger_.median);
+    return 0;
+  }
+  *cycles_difference = static_cast<int64_t>(ComputeDifferenceOfTestruns(
+      &results_notrigger, &results_trigger, &statistics_notrigger_, &statistics_trigger_,
+      &statistics_difference_));
+  // the age of the baseline is counted in executions s.t. it bounds the drift in between
+  baseline_cache_[baseline_key] = BaselineCacheEntry{statistics_notrigger_,
+                                                     execution_no_,
+                                                     execute_trigger_only_in_speculation,
+                                                     no_testruns,
+                                                     reset_executions_amount,
+                                                     trigger_padding_length};
+  return 0;
+}
+
+void Executor::SetEffectThresholds(int64_t negative_threshold, int64_t positive_threshold) {
+  assert(negative_threshold <= 0 && positive_threshold >= 0);
+  effect_negative_threshold_ = negative_threshold;
+  effect_positive_threshold_ = positive_threshold;
+}
+
+void Executor::SetBaselineMaxAge(uint64_t max_age_executions) {
+  baseline_max_age_ = max_age_executions;
+  ClearBaselineCache();
+}
+
+void Executor::ClearBaselineCache() {
+  baseline_cache_.clear();
+}
+
+int Executor::CreateTriggerTestrunCode(ByteView trigger_sequence,
+                                       ByteView measurement_sequence,
+                                       ByteView reset_sequence,
+                                       bool execute_trigger_only_in_speculation,
+                                       int reset_executions_amount) {
+  if (execute_trigger_only_in_speculation) {
+    return CreateSpeculativeTriggerTestrunCode(measurement_sequence, trigger_sequence,
+                                               reset_sequence, reset_executions_amount);
+  }
+  return CreateTestrunCode(reset_sequence, trigger_sequence, measurement_sequence,
+                           reset_executions_amount);
+}
+
+int Executor::CreateNoTriggerTestrunCode(size_t trigger_sequence_length,
+                                         ByteView measurement_sequence,
+                                         ByteView reset_sequence,
+                                         bool execute_trigger_only_in_speculation,
+                                         int reset_executions_amount) {
+  // disabled by default for performance reasons (on 2020-09-03 by Osiris dev) as the
+  // baseline then depends on the length of the trigger sequence
+  trigger_padding_.clear();
+  if (config_.match_baseline_layout) {
+    trigger_padding_ = CreateSequenceOfNOPs(trigger_sequence_length);
+  }
+
+  return CreateTriggerTestrunCode(trigger_padding_, measurement_sequence, reset_sequence,
+                                  execute_trigger_only_in_speculation, reset_executions_amount);
+}
+
+std::vector<std::vector<int64_t>>* Executor::PrepareCounterResults(
+    std::vector<std::vector<int64_t>>* counter_results) {
+  if (performance_counters_.empty()) {
+    return nullptr;
+  }
+  counter_results->resize(performance_counters_.size());
+  for (auto& results_of_counter : *counter_results) {
+    results_of_counter.clear();
+  }
+  return counter_results;
+}
+
+int Executor::CollectPairedTestrunSamples(int codepage_a, int codepage_b, int no_samples,
+                                          std::vector<int64_t>* results_a,
+                                          std::vector<int64_t>* results_b,
+                                          std::vector<std::vector<int64_t>>* counter_results_a,
+                                          std::vector<std::vector<int64_t>>* counter_results_b) {
+  if (config_.sample_order == SampleOrder::BLOCKED) {
+    int error = CollectTestrunSamples(codepage_a, no_samples, results_a, counter_results_a);
     if (error) {
-      // abort
-      *cycles_difference = -1;
-      return 1;
+      return error;
     }
-    if (cycles_elapsed_trigger <= 5000) {
-      results_trigger.emplace_back(cycles_elapsed_trigger);
+    return CollectTestrunSamples(codepage_b, no_samples, results_b, counter_results_b);
+  }
+
+  return CollectSamplesInBatches(codepage_a, codepage_b, no_samples, results_a, results_b,
+                                 counter_results_a, counter_results_b);
+}
+
+double Executor::ComputeDifferenceOfTestruns(std::vector<int64_t>* results_a,
+                                             std::vector<int64_t>* results_b,
+                                             SampleStatistics* statistics_a,
+                                             SampleStatistics* statistics_b,
+                                             SampleStatistics* statistics_difference) {
+  // the pairs get lost once the results are sorted
+  bool is_paired = config_.sample_order != SampleOrder::BLOCKED &&
+      results_a->size() == results_b->size();
+  *statistics_difference = SampleStatistics();
+  if (is_paired) {
+    paired_differences_.clear();
+    for (size_t i = 0; i < results_a->size(); i++) {
+      paired_differences_.push_back((*results_a)[i] - (*results_b)[i]);
     }
+    *statistics_difference = ComputeSampleStatistics(&paired_differences_);
   }
+  *statistics_a = ComputeSampleStatistics(results_a);
+  *statistics_b = ComputeSampleStatistics(results_b);
+  return is_paired ? statistics_difference->median : statistics_a->median - statistics_b->median;
+}
 
-  for (int i = 0; i < no_testruns; i++) {
-    // get timing without trigger sequence
-    uint64_t cycles_elapsed_notrigger;
-    int error = ExecuteTestrun(1, &cycles_elapsed_notrigger);
+int Executor::CollectSamplesSequentially(int trigger_codepage, int notrigger_codepage,
+                                         double baseline_median) {
+  SequentialEffectTest effect_test(config_.sequential_error_rate, effect_negative_threshold_,
+                                   effect_positive_threshold_);
+  int max_testruns = config_.sequential_max_testruns;
+  while (static_cast<int>(results_trigger.size()) < max_testruns &&
+      effect_test.GetDecision() == SequentialEffectTest::Decision::UNDECIDED) {
+    size_t batch_begin = results_trigger.size();
+    int batch_size = std::min(config_.sequential_batch_size,
+                              max_testruns - static_cast<int>(batch_begin));
+    int error = notrigger_codepage == -1
+        ? CollectTestrunSamples(trigger_codepage, batch_size, &results_trigger)
+        : CollectPairedTestrunSamples(trigger_codepage, notrigger_codepage, batch_size,
+                                      &results_trigger, &results_notrigger);
     if (error) {
-      // abort
-      *cycles_difference = -1;
-      return 1;
+      return error;
     }
-    if (cycles_elapsed_notrigger <= 5000) {
-      results_notrigger.emplace_back(cycles_elapsed_notrigger);
+    for (size_t i = batch_begin; i < results_trigger.size(); i++) {
+      double notrigger = notrigger_codepage == -1 ? baseline_median
+                                                  : static_cast<double>(results_notrigger[i]);
+      effect_test.AddDifference(notrigger - static_cast<double>(results_trigger[i]));
     }
   }
-  double median_trigger = median<int64_t>(results_trigger);
-  double median_notrigger = median<int64_t>(results_notrigger);
-  *cycles_difference = static_cast<int64_t>(median_notrigger - median_trigger);
   return 0;
 }
 
-void Executor::CreateResetTestrunCode(int codepage_no, const byte_array& trigger_sequence,
-                                      const byte_array& measurement_sequence,
-                                      const byte_array& reset_sequence,
-                                      int reset_executions_amount) {
-  ClearDataPage();
-  InitializeCodePage(codepage_no);
+void Executor::PlanSamplesPerExecution(int no_testruns) {
+  int executions = (no_testruns + config_.samples_per_execution - 1) /
+      config_.samples_per_execution;
+  planned_samples_per_execution_ = std::max(1, (no_testruns + executions - 1) / executions);
+}
 
-  // prolog
-  AddProlog(codepage_no);
-  AddInstructionToCodePage(codepage_no, trigger_sequence);
-  AddSerializeInstructionToCodePage(codepage_no);
+int Executor::CollectTestrunSamples(int codepage_no, int no_samples,
+                                    std::vector<int64_t>* results,
+                                    std::vector<std::vector<int64_t>>* counter_results) {
+  return CollectSamplesInBatches(codepage_no, -1, no_samples, results, nullptr,
+                                 counter_results, nullptr);
+}
 
-  // try to reset microarchitectural state again
-  assert(reset_executions_amount <= 100);  // else we need to increase guardian stack space
-  for (int i = 0; i < reset_executions_amount; i++) {
-    AddInstructionToCodePage(codepage_no, reset_sequence);
+int Executor::CollectSamplesInBatches(int codepage_a, int codepage_b, int no_samples,
+                                      std::vector<int64_t>* results_a,
+                                      std::vector<int64_t>* results_b,
+                                      std::vector<std::vector<int64_t>>* counter_results_a,
+                                      std::vector<std::vector<int64_t>>* counter_results_b) {
+  // one execution of each code page at a time s.t. drift affects both alike
+  int samples_per_execution = code_pages_samples_per_execution_[codepage_a];
+  int executions_per_round = 1;
+  if (codepage_b != -1) {
+    samples_per_execution = std::min(samples_per_execution,
+                                     code_pages_samples_per_execution_[codepage_b]);
+    executions_per_round = 2;
+  }
+  int rounds_per_batch = kMaxExecutionsPerBatch / executions_per_round;
+
+  int collected_samples = 0;
+  int consecutive_contaminated_batches = 0;
+  while (collected_samples < no_samples) {
+    int batch_samples = std::min(no_samples - collected_samples,
+                                 rounds_per_batch * samples_per_execution);
+    int batch_executions = (batch_samples + samples_per_execution - 1) /
+        samples_per_execution * executions_per_round;
+    int contamination = 0;
+    BeginExecutionBatch(batch_executions);
+    for (int round_begin = 0; round_begin < batch_samples;
+         round_begin += samples_per_execution) {
+      int round_samples = std::min(samples_per_execution, batch_samples - round_begin);
+      bool a_first = codepage_b == -1 || config_.sample_order == SampleOrder::INTERLEAVED ||
+          std::bernoulli_distribution()(sample_order_generator_);
+      int error = a_first
+          ? ExecuteAndRecordSamples(codepage_a, round_samples, results_a, counter_results_a,
+                                    &contamination)
+          : ExecuteAndRecordSamples(codepage_b, round_samples, results_b, counter_results_b,
+                                    &contamination);
+      if (!error && codepage_b != -1) {
+        error = a_first
+            ? ExecuteAndRecordSamples(codepage_b, round_samples, results_b, counter_results_b,
+                                      &contamination)
+            : ExecuteAndRecordSamples(codepage_a, round_samples, results_a, counter_results_a,
+                                      &contamination);
+      }
+      if (error) {
+        EndExecutionBatch();
+        return error;
+      }
+    }
+    contamination |= EndExecutionBatch();
+
+    uint64_t executions = static_cast<uint64_t>(batch_executions);
+    contamination_statistics_.execution_no += executions;
+    if (contamination != 0) {
+      if ((contamination & kContaminationContextSwitch) != 0) {
+        contamination_statistics_.context_switch_no += executions;
+      }
+      if ((contamination & kContaminationPageFault) != 0) {
+        contamination_statistics_.page_fault_no += executions;
+      }
+      if ((contamination & kContaminationFrequencyChange) != 0) {
+        contamination_statistics_.frequency_change_no += executions;
+      }
+      if (consecutive_contaminated_batches < kMaxConsecutiveContaminatedBatches) {
+        // take the samples of this batch again
+        consecutive_contaminated_batches++;
+        contamination_statistics_.discarded_no += executions;
+        DiscardLastSamples(results_a, counter_results_a, batch_samples);
+        if (codepage_b != -1) {
+          DiscardLastSamples(results_b, counter_results_b, batch_samples);
+        }
+        continue;
+      }
+    }
+    consecutive_contaminated_batches = 0;
+    collected_samples += batch_samples;
   }
-  AddSerializeInstructionToCodePage(codepage_no);
+  return 0;
+}
 
-  // time measurement sequence
-  AddTimerStartToCodePage(codepage_no);
-  AddInstructionToCodePage(codepage_no, measurement_sequence);
-  AddTimerEndToCodePage(codepage_no);
+int Executor::ExecuteAndRecordSamples(int codepage_no, int no_samples,
+                                      std::vector<int64_t>* results,
+                                      std::vector<std::vector<int64_t>>* counter_results,
+                                      int* contamination) {
+  uint64_t cycles_elapsed;
+  int execution_contamination;
+  int error = ExecuteTestrun(codepage_no, &cycles_elapsed, &execution_contamination);
+  if (error) {
+    return error;
+  }
+  *contamination |= execution_contamination;
+
+  // the code page stored the timing of every sample on the result page
+  // (the last one is additionally returned)
+  int sample_result_size = GetSampleResultSize();
+  int64_t metric_overhead = metric_result_index_ == 0
+                            ? timer_overhead_
+                            : counter_overheads_[metric_result_index_ - 1];
+  assert(no_samples <= code_pages_samples_per_execution_[codepage_no]);
+  for (int i = 0; i < no_samples; i++) {
+    volatile uint64_t* sample_result = execution_result_page_ + i * sample_result_size;
+    results->push_back(static_cast<int64_t>(sample_result[metric_result_index_]) -
+        metric_overhead);
+    if (counter_results != nullptr) {
+      for (size_t counter = 0; counter < performance_counters_.size(); counter++) {
+        (*counter_results)[counter].push_back(
+            static_cast<int64_t>(sample_result[counter + 1]) - counter_overheads_[counter]);
+      }
+    }
+  }
+  return 0;
+}
 
-  // return timing result and epilog
-  MakeTimerResultReturnValue(codepage_no);
-  AddEpilog(codepage_no);
+void Executor::DiscardLastSamples(std::vector<int64_t>* results,
+                                  std::vector<std::vector<int64_t>>* counter_results,
+                                  size_t no_samples) {
+  results->resize(results->size() - no_samples);
+  if (counter_results != nullptr) {
+    for (auto& results_of_counter : *counter_results) {
+      results_of_counter.resize(results_of_counter.size() - no_samples);
+    }
+  }
+}
 
-  // make sure that we do not exceed page boundaries
-  assert(code_pages_last_written_index_[codepage_no] < kPagesize);
+void Executor::BeginExecutionBatch(int no_executions) {
+  // the fork server guards and checks every execution itself
+  if (config_.use_fork_server) {
+    return;
+  }
+  ArmWatchdog(static_cast<int64_t>(config_.watchdog_timeout_ms) * no_executions);
+  if (config_.discard_contaminated_samples) {
+    TakeContaminationSnapshot(&batch_begin_snapshot_);
+  }
 }
 
-void Executor::CreateTestrunCode(int codepage_no, const byte_array& first_sequence,
-                                 const byte_array& second_sequence,
-                                 const byte_array& measurement_sequence,
-                                 int first_sequence_executions_amount) {
-  ClearDataPage();
-  InitializeCodePage(codepage_no);
+int Executor::EndExecutionBatch() {
+  if (config_.use_fork_server) {
+    return 0;
+  }
+  ArmWatchdog(0);
+  if (!config_.discard_contaminated_samples) {
+    return 0;
+  }
+  ContaminationSnapshot batch_end_snapshot;
+  TakeContaminationSnapshot(&batch_end_snapshot);
+  return GetContamination(batch_begin_snapshot_, batch_end_snapshot);
+}
 
-  // prolog
-  AddProlog(codepage_no);
-  AddSerializeInstructionToCodePage(codepage_no);
+int Executor::CreateResetTestrunCode(ByteView trigger_sequence,
+                                     ByteView measurement_sequence,
+                                     ByteView reset_sequence,
+                                     int reset_executions_amount) {
+  ClearDataPage();
 
-  // first sequence
-  // if we need more we also have to increase the guardian stack space
-  assert(first_sequence_executions_amount <= 100);
-  for (int i = 0; i < first_sequence_executions_amount; i++) {
-    AddInstructionToCodePage(codepage_no, first_sequence);
-  }
-  AddSerializeInstructionToCodePage(codepage_no);
+  // try to reset microarchitectural state again
+  assert(reset_executions_amount <= kMaxSequenceExecutions);
+  return StampCodePage(reset_testrun_template_,
+                       {CreateCodePageSlot(trigger_sequence, 1),
+                        CreateCodePageSlot(reset_sequence, reset_executions_amount),
+                        CreateCodePageSlot(measurement_sequence, 1)});
+}
 
-  // second sequence
-  AddInstructionToCodePage(codepage_no, second_sequence);
-  AddSerializeInstructionToCodePage(codepage_no);
+int Executor::CreateTestrunCode(ByteView first_sequence,
+                                ByteView second_sequence,
+                                ByteView measurement_sequence,
+                                int first_sequence_executions_amount) {
+  ClearDataPage();
 
-  // time measurement sequence
-  AddTimerStartToCodePage(codepage_no);
-  AddInstructionToCodePage(codepage_no, measurement_sequence);
-  AddTimerEndToCodePage(codepage_no);
+  assert(first_sequence_executions_amount <= kMaxSequenceExecutions);
+  return StampCodePage(testrun_template_,
+                       {CreateCodePageSlot(first_sequence, first_sequence_executions_amount),
+                        CreateCodePageSlot(second_sequence, 1),
+                        CreateCodePageSlot(measurement_sequence, 1)});
+}
 
-  // return timing result and epilog
-  MakeTimerResultReturnValue(codepage_no);
-  AddEpilog(codepage_no);
+int Executor::CreateSpeculativeTriggerTestrunCode(ByteView measurement_sequence,
+                                                  ByteView trigger_sequence,
+                                                  ByteView reset_sequence,
+                                                  int reset_executions_amount) {
+  ClearDataPage();
 
-  // make sure that we do not exceed page boundaries
-  assert(code_pages_last_written_index_[codepage_no] < kPagesize);
+  // we use this to generate a call which can be misprecided; target is behind the speculated code
+  // (the fragment following the trigger sequence starts with the JMP rel32 that redirects
+  // the speculation)
+  constexpr int32_t kRelativeJmpLength = 5;
+  int32_t call_displacement = trigger_sequence.size() + kRelativeJmpLength;
+  char call_displacement_encoded[sizeof(call_displacement)];
+  memcpy(call_displacement_encoded, &call_displacement, sizeof(call_displacement));
+
+  assert(reset_executions_amount <= kMaxSequenceExecutions);
+  return StampCodePage(
+      speculative_trigger_testrun_template_,
+      {CreateCodePageSlot(reset_sequence, reset_executions_amount),
+       CodePageSlot{call_displacement_encoded, sizeof(call_displacement_encoded), 1},
+       CreateCodePageSlot(trigger_sequence, 1),
+       CreateCodePageSlot(measurement_sequence, 1)});
 }
 
-void Executor::CreateSpeculativeTriggerTestrunCode(int codepage_no,
-                                                   const byte_array& measurement_sequence,
-                                                   const byte_array& trigger_sequence,
-                                                   const byte_array& reset_sequence,
-                                                   int reset_executions_amount) {
+void Executor::BuildCodePageTemplates() {
+  // shared by all test kinds
+  prolog_code_.clear();
+  AddProlog(&prolog_code_);
+  epilog_code_.clear();
+  MakeTimerResultReturnValue(&epilog_code_);
+  AddEpilog(&epilog_code_);
+
+  //
+  // CreateResetTestrunCode: trigger; reset (n times); timed measurement
+  //
+  std::vector<byte_array>& reset_testrun = reset_testrun_template_.fragments;
+  reset_testrun.assign(4, byte_array());
+  AddSampleBegin(&reset_testrun[0]);
+  // <trigger sequence>
+  AddSerializeInstruction(&reset_testrun[1]);
+  // <reset sequence> (n times)
+  AddSerializeInstruction(&reset_testrun[2]);
+  AddTimerStart(&reset_testrun[2]);
+  // <measurement sequence>
+  AddTimerEnd(&reset_testrun[3]);
+  AddSampleEnd(&reset_testrun[3]);
+
+  //
+  // CreateTestrunCode: first sequence (n times); second sequence; timed measurement
+  //
+  std::vector<byte_array>& testrun = testrun_template_.fragments;
+  testrun.assign(4, byte_array());
+  AddSampleBegin(&testrun[0]);
+  AddSerializeInstruction(&testrun[0]);
+  // <first sequence> (n times)
+  AddSerializeInstruction(&testrun[1]);
+  // <second sequence>
+  AddSerializeInstruction(&testrun[2]);
+  AddTimerStart(&testrun[2]);
+  // <measurement sequence>
+  AddTimerEnd(&testrun[3]);
+  AddSampleEnd(&testrun[3]);
+
+  //
+  // CreateSpeculativeTriggerTestrunCode: reset (n times); transient trigger; timed measurement
+  //
   // call rel32
   constexpr char INST_RELATIVE_CALL[] = "\xe8\xff\xff\xff\xff";
   // jmp rel32
@@ -314,29 +889,18 @@ void Executor::CreateSpeculativeTriggerTestrunCode(int codepage_no,
   // ret
   constexpr char INST_RET[] = "\xc3";
 
-  ClearDataPage();
-  InitializeCodePage(codepage_no);
-
-  // prolog
-  AddProlog(codepage_no);
-  AddSerializeInstructionToCodePage(codepage_no);
-
-  // reset microarchitectural state sequence
-  // if the number is higher we need to make sure that we have enough "unimportet guardian" stack space
-  assert(reset_executions_amount <= 100);
-  for (int i = 0; i < reset_executions_amount; i++) {
-    AddInstructionToCodePage(codepage_no, reset_sequence);
-  }
-  AddSerializeInstructionToCodePage(codepage_no);
-
+  std::vector<byte_array>& speculative_testrun = speculative_trigger_testrun_template_.fragments;
+  speculative_testrun.assign(5, byte_array());
+  AddSampleBegin(&speculative_testrun[0]);
+  AddSerializeInstruction(&speculative_testrun[0]);
+  // <reset sequence> (n times)
+  AddSerializeInstruction(&speculative_testrun[1]);
 
   //
   // use spectre-RSB to speculatively execute the trigger
   //
 
   // note that for all following calculations sizeof has the additional '\0', hence the - 1
-  // we use this to generate a call which can be misprecided; target is behind the speculated code
-  int32_t call_displacement = trigger_sequence.size() + sizeof(INST_RELATIVE_JMP) - 1;
   // we use this to redirect speculation to the same end as the manipulated stack
   int32_t jmp_displacement = sizeof(INST_LEA_RAX_DEREF_RIP_PLUS_OFFSET) - 1 +
       sizeof(INST_MOV_DEREF_RSP_RAX) - 1 + sizeof(INST_RET) - 1;
@@ -346,57 +910,951 @@ void Executor::CreateSpeculativeTriggerTestrunCode(int codepage_no,
       sizeof(INST_RET) - 1;
 
   byte_array jmp_displacement_encoded = NumberToBytesLE(jmp_displacement, 4);
-  byte_array call_displacement_encoded = NumberToBytesLE(call_displacement, 4);
   byte_array lea_rip_displacement_encoded = NumberToBytesLE(lea_rip_displacement, 4);
 
-  // only place opcode and add offset manually
-  AddInstructionToCodePage(codepage_no, INST_RELATIVE_CALL, 1);
-  AddInstructionToCodePage(codepage_no, call_displacement_encoded);
-
+  // only place opcode; the displacement depends on the trigger sequence and is written on stamping
+  AddInstruction(&speculative_testrun[1], INST_RELATIVE_CALL, 1);
+  // <call displacement>
 
   // speculation starts here as return address is mispredicted
-  AddInstructionToCodePage(codepage_no, trigger_sequence);
+  // <trigger sequence>
+
   // this is still only accessible during speculation to redirect speculation to the correct jumpout
   // only place opcode and add offset manually
-  AddInstructionToCodePage(codepage_no, INST_RELATIVE_JMP, 1);
-  AddInstructionToCodePage(codepage_no, jmp_displacement_encoded);
+  AddInstruction(&speculative_testrun[3], INST_RELATIVE_JMP, 1);
+  AddInstruction(&speculative_testrun[3], jmp_displacement_encoded);
   //
   // speculation ends here
   //
 
-
   // Target of CALL_DISPLACEMENT
   // change the return address on the stack to trigger the missspeculation of the RET
   // only place opcode and add offset manually
-  AddInstructionToCodePage(codepage_no, INST_LEA_RAX_DEREF_RIP_PLUS_OFFSET,
-                                      3);
-  AddInstructionToCodePage(codepage_no, lea_rip_displacement_encoded);
+  AddInstruction(&speculative_testrun[3], INST_LEA_RAX_DEREF_RIP_PLUS_OFFSET, 3);
+  AddInstruction(&speculative_testrun[3], lea_rip_displacement_encoded);
   // wanted return address is now in RAX hence we can manipulate the stack now
-  AddInstructionToCodePage(codepage_no, INST_MOV_DEREF_RSP_RAX,
-                                      4);
+  AddInstruction(&speculative_testrun[3], INST_MOV_DEREF_RSP_RAX, 4);
   // return address was manipulated hence RET will return to the correct code but
   // will be mispredicted
-  AddInstructionToCodePage(codepage_no, INST_RET, 1);
+  AddInstruction(&speculative_testrun[3], INST_RET, 1);
 
   // target of LEA_RIP_DISPLACEMENT (manipulated RET) and JMP_DISPLACEMENT
   // serialize after trigger
-  //page_idx = AddSerializeInstructionToCodePage(page_idx, codepage_no);
+  //AddSerializeInstruction(&speculative_testrun[3]);
 
   // time measurement sequence
-  AddTimerStartToCodePage(codepage_no);
-  AddInstructionToCodePage(codepage_no, measurement_sequence);
-  AddTimerEndToCodePage(codepage_no);
+  AddTimerStart(&speculative_testrun[3]);
+  // <measurement sequence>
+  AddTimerEnd(&speculative_testrun[4]);
+  AddSampleEnd(&speculative_testrun[4]);
+}
+
+void Executor::ClearCodePagePool() {
+  code_page_pool_index_.clear();
+}
+
+std::string SerializationPrimitiveToString(SerializationPrimitive serialization_primitive) {
+  switch (serialization_primitive) {
+    case SerializationPrimitive::AUTO:return "auto";
+    case SerializationPrimitive::CPUID:return "cpuid";
+    case SerializationPrimitive::LFENCE:return "lfence";
+    case SerializationPrimitive::SERIALIZE:return "serialize";
+  }
+  return "unknown";
+}
+
+std::string SampleOrderToString(SampleOrder sample_order) {
+  switch (sample_order) {
+    case SampleOrder::BLOCKED:return "blocked";
+    case SampleOrder::INTERLEAVED:return "interleaved";
+    case SampleOrder::RANDOMIZED:return "randomized";
+  }
+  return "unknown";
+}
+
+SerializationPrimitive Executor::GetSerializationPrimitive() const {
+  return serialization_primitive_;
+}
+
+bool Executor::IsSerializationPrimitiveSupported(
+    SerializationPrimitive serialization_primitive) {
+  switch (serialization_primitive) {
+    case SerializationPrimitive::CPUID:
+    case SerializationPrimitive::LFENCE:
+      // part of every x86-64 CPU
+      return true;
+    case SerializationPrimitive::SERIALIZE: {
+      // CPUID.(EAX=07H, ECX=0):EDX[bit 14]
+      unsigned int eax, ebx, ecx, edx;
+      if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+      }
+      return (edx & (1u << 14)) != 0;
+    }
+    case SerializationPrimitive::AUTO:
+      break;
+  }
+  return false;
+}
+
+void Executor::SetSerializationPrimitive(SerializationPrimitive serialization_primitive) {
+  assert(serialization_primitive != SerializationPrimitive::AUTO);
+  serialization_primitive_ = serialization_primitive;
+  BuildCodePageTemplates();
+  // pooled code still uses the previous primitive
+  ClearCodePagePool();
+}
+
+void Executor::SelectSerializationPrimitive() {
+  // CPUID is the reference as it is architecturally serializing on every CPU
+  SerializationBenchmark reference;
+  if (BenchmarkSerializationPrimitive(SerializationPrimitive::CPUID, &reference)) {
+    LOG_WARNING("Benchmarking the serialization primitives failed. Falling back to CPUID.");
+    SetSerializationPrimitive(SerializationPrimitive::CPUID);
+    return;
+  }
+  // absolute slack in cycles for the comparison with the reference
+  constexpr double kTolerance = 8;
+
+  SerializationPrimitive selected_primitive = SerializationPrimitive::CPUID;
+  double selected_cost = reference.cycles_per_sample;
+  for (SerializationPrimitive candidate : {SerializationPrimitive::LFENCE,
+                                           SerializationPrimitive::SERIALIZE}) {
+    if (!IsSerializationPrimitiveSupported(candidate)) {
+      continue;
+    }
+    SerializationBenchmark benchmark;
+    if (BenchmarkSerializationPrimitive(candidate, &benchmark)) {
+      continue;
+    }
+    LOG_DEBUG("serialization primitive " + SerializationPrimitiveToString(candidate) +
+        ": " + std::to_string(benchmark.cycles_per_sample) + " cycles per sample, shift " +
+        std::to_string(benchmark.reference_shift) + ", spread " +
+        std::to_string(benchmark.spread) + " (cpuid: " +
+        std::to_string(reference.cycles_per_sample) + ", " +
+        std::to_string(reference.reference_shift) + ", " + std::to_string(reference.spread) +
+        ")");
+    bool is_stable = benchmark.reference_shift <= reference.reference_shift + kTolerance &&
+        benchmark.spread <= 2 * reference.spread + kTolerance;
+    if (is_stable && benchmark.cycles_per_sample < selected_cost) {
+      selected_primitive = candidate;
+      selected_cost = benchmark.cycles_per_sample;
+    }
+  }
+  LOG_INFO("Using serialization primitive " + SerializationPrimitiveToString(selected_primitive));
+  SetSerializationPrimitive(selected_primitive);
+}
+
+int Executor::BenchmarkSerializationPrimitive(SerializationPrimitive serialization_primitive,
+                                              SerializationBenchmark* benchmark) {
+  constexpr int kBenchmarkSamples = 256;
+  // chain of dependent IMUL RAX, RAX; its latency leaks into the timed region if the
+  // serialization does not wait for it
+  constexpr char INST_IMUL_RAX_RAX[] = "\x48\x0f\xaf\xc0";
+  constexpr int kLongLatencyChainLength = 64;
+  byte_array long_latency_sequence;
+  for (int i = 0; i < kLongLatencyChainLength; i++) {
+    AddInstruction(&long_latency_sequence, INST_IMUL_RAX_RAX, 4);
+  }
+  byte_array empty_sequence;
+  byte_array measurement_sequence = CreateSequenceOfNOPs(1);
+
+  SetSerializationPrimitive(serialization_primitive);
+  PlanSamplesPerExecution(kBenchmarkSamples);
+  int plain_codepage = CreateTestrunCode(empty_sequence, empty_sequence,
+                                         measurement_sequence, 1);
+  int shifted_codepage = CreateTestrunCode(empty_sequence, long_latency_sequence,
+                                           measurement_sequence, 1);
+  std::vector<int64_t> plain_results;
+  std::vector<int64_t> shifted_results;
+  plain_results.reserve(kBenchmarkSamples);
+  shifted_results.reserve(kBenchmarkSamples);
+
+  // warm up caches and predictors
+  if (CollectTestrunSamples(plain_codepage, kBenchmarkSamples, &plain_results)) {
+    return 1;
+  }
+  plain_results.clear();
+
+  uint64_t start = __rdtsc();
+  if (CollectTestrunSamples(plain_codepage, kBenchmarkSamples, &plain_results)) {
+    return 1;
+  }
+  uint64_t end = __rdtsc();
+  if (CollectTestrunSamples(shifted_codepage, kBenchmarkSamples, &shifted_results)) {
+    return 1;
+  }
+
+  SampleStatistics plain_statistics = ComputeSampleStatistics(&plain_results);
+  benchmark->cycles_per_sample = static_cast<double>(end - start) / kBenchmarkSamples;
+  benchmark->reference_shift = std::abs(ComputeSampleStatistics(&shifted_results).median -
+      plain_statistics.median);
+  benchmark->spread = plain_statistics.median_absolute_deviation;
+  return 0;
+}
+
+/// returns true if the CPU implements the AMD flavor of x86 (AMD or Hygon)
+static bool IsAMDCPU() {
+  unsigned int max_leaf;
+  unsigned int vendor[3];
+  __get_cpuid(0, &max_leaf, &vendor[0], &vendor[2], &vendor[1]);
+  std::string vendor_id(reinterpret_cast<const char*>(vendor), sizeof(vendor));
+  return vendor_id == "AuthenticAMD" || vendor_id == "HygonGenuine";
+}
+
+std::string TimerBackendToString(TimerBackend timer_backend) {
+  switch (timer_backend) {
+    case TimerBackend::AUTO:return "auto";
+    case TimerBackend::RDTSC:return "rdtsc";
+    case TimerBackend::RDPRU:return "rdpru";
+    case TimerBackend::RDPMC:return "rdpmc";
+    case TimerBackend::CLOCK_GETTIME:return "clock_gettime";
+  }
+  return "unknown";
+}
+
+TimerBackend Executor::GetTimerBackend() const {
+  return timer_backend_;
+}
+
+int64_t Executor::GetTimerOverhead() const {
+  return timer_overhead_;
+}
+
+bool Executor::IsTimerBackendSupported(TimerBackend timer_backend) {
+  unsigned int eax, ebx, ecx, edx;
+  switch (timer_backend) {
+    case TimerBackend::RDTSC:
+      // CPUID.01H:EDX[bit 4] (RDTSC) and CPUID.80000001H:EDX[bit 27] (RDTSCP)
+      if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (edx & (1u << 4)) == 0) {
+        return false;
+      }
+      return __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) && (edx & (1u << 27)) != 0;
+    case TimerBackend::RDPRU:
+      // CPUID.80000008H:EBX[bit 4]
+      return __get_cpuid(0x80000008, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 4)) != 0;
+    case TimerBackend::RDPMC:
+      // the kernel has to grant user space access to the counter
+      if (cycle_counter_.fd == -1) {
+        OpenPerformanceCounter(Metric::CYCLES, &cycle_counter_);
+      }
+      return cycle_counter_.fd != -1;
+    case TimerBackend::CLOCK_GETTIME:
+      return true;
+    case TimerBackend::AUTO:
+      break;
+  }
+  return false;
+}
+
+void Executor::SetTimerBackend(TimerBackend timer_backend) {
+  assert(timer_backend != TimerBackend::AUTO);
+  if (timer_backend == TimerBackend::RDPMC && cycle_counter_.fd == -1 &&
+      !OpenPerformanceCounter(Metric::CYCLES, &cycle_counter_)) {
+    LOG_ERROR("Couldn't open the cycle counter for RDPMC. Aborting!");
+    std::exit(1);
+  }
+  timer_backend_ = timer_backend;
+  // the overhead of the previous backend does not apply anymore
+  timer_overhead_ = 0;
+  BuildCodePageTemplates();
+  // pooled code still uses the previous timer
+  ClearCodePagePool();
+  if (config_.use_fork_server) {
+    // the fork server has to open its own counters
+    StopForkServer();
+    StartForkServer();
+  }
+}
+
+void Executor::SelectTimerBackend() {
+  if (config_.timer_backend != TimerBackend::AUTO) {
+    if (!IsTimerBackendSupported(config_.timer_backend)) {
+      LOG_ERROR("The CPU does not support the timer " +
+          TimerBackendToString(config_.timer_backend) + ". Aborting!");
+      std::exit(1);
+    }
+    SetTimerBackend(config_.timer_backend);
+    return;
+  }
+
+  // APERF (RDPRU) is more stable than the TSC on AMD; clock_gettime is the last resort as
+  // its resolution is far too coarse for single instructions
+  std::vector<TimerBackend> candidates;
+  if (IsAMDCPU()) {
+    candidates = {TimerBackend::RDPRU, TimerBackend::RDTSC, TimerBackend::RDPMC,
+                  TimerBackend::CLOCK_GETTIME};
+  } else {
+    candidates = {TimerBackend::RDTSC, TimerBackend::RDPMC, TimerBackend::CLOCK_GETTIME};
+  }
+
+  for (TimerBackend candidate : candidates) {
+    if (!IsTimerBackendSupported(candidate)) {
+      LOG_DEBUG("timer " + TimerBackendToString(candidate) + " is not supported");
+      continue;
+    }
+    SetTimerBackend(candidate);
+    TimerCalibration calibration;
+    if (CalibrateTimerBackend(candidate, &calibration) || calibration.overhead <= 0) {
+      // faulted or the counter does not advance (e.g. virtualized counters)
+      LOG_DEBUG("timer " + TimerBackendToString(candidate) + " does not work");
+      continue;
+    }
+    LOG_DEBUG("timer " + TimerBackendToString(candidate) + ": overhead " +
+        std::to_string(calibration.overhead) + ", jitter " +
+        std::to_string(calibration.jitter));
+    return;
+  }
+  LOG_ERROR("None of the timers works on this CPU. Aborting!");
+  std::exit(1);
+}
+
+int Executor::CalibrateTimerBackend(TimerBackend timer_backend, TimerCalibration* calibration) {
+  if (timer_backend_ != timer_backend) {
+    SetTimerBackend(timer_backend);
+  }
+  // calibrate on the raw timings
+  timer_overhead_ = 0;
+  counter_overheads_.assign(performance_counters_.size(), 0);
+  int metric_result_index = metric_result_index_;
+  metric_result_index_ = 0;
+
+  byte_array empty_sequence;
+  PlanSamplesPerExecution(kTimerCalibrationSamples);
+  int codepage = CreateTestrunCode(empty_sequence, empty_sequence, empty_sequence, 1);
+  std::vector<int64_t> results;
+  results.reserve(kTimerCalibrationSamples);
+  std::vector<std::vector<int64_t>> counter_results(performance_counters_.size());
+
+  // warm up caches and predictors
+  int error = CollectTestrunSamples(codepage, kTimerCalibrationSamples, &results);
+  results.clear();
+  if (!error) {
+    error = CollectTestrunSamples(codepage, kTimerCalibrationSamples, &results,
+                                  &counter_results);
+  }
+  metric_result_index_ = metric_result_index;
+  if (error) {
+    return error;
+  }
+
+  SampleStatistics statistics = ComputeSampleStatistics(&results);
+  calibration->overhead = statistics.median;
+  calibration->jitter = statistics.median_absolute_deviation;
+  calibration->counter_overheads.clear();
+  for (auto& results_of_counter : counter_results) {
+    calibration->counter_overheads.push_back(QuantileInPlace(&results_of_counter, 0.5));
+  }
+  return 0;
+}
+
+std::string MetricToString(Metric metric) {
+  switch (metric) {
+    case Metric::CYCLES:return "cycles";
+    case Metric::INSTRUCTIONS:return "instructions";
+    case Metric::UOPS_RETIRED:return "uops-retired";
+    case Metric::L1D_MISSES:return "l1d-misses";
+    case Metric::L2_MISSES:return "l2-misses";
+    case Metric::LLC_MISSES:return "llc-misses";
+    case Metric::BRANCH_MISSES:return "branch-misses";
+    case Metric::MACHINE_CLEARS:return "machine-clears";
+    case Metric::DSB_SWITCHES:return "dsb-switches";
+  }
+  return "unknown";
+}
+
+Metric Executor::GetMetric() const {
+  return config_.metric;
+}
+
+std::vector<Metric> Executor::GetCounterMetrics() const {
+  std::vector<Metric> metrics;
+  for (const PerformanceCounter& counter : performance_counters_) {
+    metrics.push_back(counter.metric);
+  }
+  return metrics;
+}
+
+const std::vector<int64_t>& Executor::GetCounterDifferences() const {
+  return counter_differences_;
+}
+
+const SampleStatistics& Executor::GetTriggerStatistics() const {
+  return statistics_trigger_;
+}
+
+const SampleStatistics& Executor::GetNoTriggerStatistics() const {
+  return statistics_notrigger_;
+}
+
+const SampleStatistics& Executor::GetDifferenceStatistics() const {
+  return statistics_difference_;
+}
+
+/// Returns the perf event counting a metric on this CPU
+/// \param metric metric to count
+/// \param type outputs the perf event type
+/// \param config outputs the perf event config
+/// \return false if the CPU has no such event
+static bool GetPerformanceEvent(Metric metric, uint32_t* type, uint64_t* config) {
+  // raw events are model-specific; the encodings are taken from the Intel SDM (Skylake and
+  // later) and the AMD PPR (family 17h and later)
+  bool is_amd = IsAMDCPU();
+  *type = PERF_TYPE_HARDWARE;
+  switch (metric) {
+    case Metric::CYCLES:
+      *config = PERF_COUNT_HW_CPU_CYCLES;
+      return true;
+    case Metric::INSTRUCTIONS:
+      *config = PERF_COUNT_HW_INSTRUCTIONS;
+      return true;
+    case Metric::LLC_MISSES:
+      *config = PERF_COUNT_HW_CACHE_MISSES;
+      return true;
+    case Metric::BRANCH_MISSES:
+      *config = PERF_COUNT_HW_BRANCH_MISSES;
+      return true;
+    case Metric::L1D_MISSES:
+      *type = PERF_TYPE_HW_CACHE;
+      *config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      return true;
+    case Metric::UOPS_RETIRED:
+      *type = PERF_TYPE_RAW;
+      // Intel: UOPS_RETIRED.RETIRE_SLOTS; AMD: Retired Ops (PMCx0C1)
+      *config = is_amd ? 0x00c1 : 0x02c2;
+      return true;
+    case Metric::L2_MISSES:
+      *type = PERF_TYPE_RAW;
+      // Intel: L2_RQSTS.MISS; AMD: L2CacheReqStat.LsRdBlkC|IcFillMiss (PMCx064)
+      *config = is_amd ? 0x0964 : 0x3f24;
+      return true;
+    case Metric::MACHINE_CLEARS:
+      *type = PERF_TYPE_RAW;
+      // MACHINE_CLEARS.COUNT (counter mask 1 and edge detect count every clear once)
+      *config = 0x01c3 | (1ull << 18) | (1ull << 24);
+      return !is_amd;
+    case Metric::DSB_SWITCHES:
+      *type = PERF_TYPE_RAW;
+      // DSB2MITE_SWITCHES.PENALTY_CYCLES
+      *config = 0x02ab;
+      return !is_amd;
+  }
+  return false;
+}
+
+bool Executor::OpenPerformanceCounter(Metric metric, PerformanceCounter* counter) {
+  struct perf_event_attr attributes{};
+  uint32_t type;
+  uint64_t config;
+  if (!GetPerformanceEvent(metric, &type, &config)) {
+    return false;
+  }
+  attributes.type = type;
+  attributes.config = config;
+  attributes.size = sizeof(attributes);
+  // keep the counter on the PMU s.t. its index does not change between executions
+  attributes.pinned = 1;
+  attributes.exclude_kernel = 1;
+  attributes.exclude_hv = 1;
+  int fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+  if (fd == -1) {
+    return false;
+  }
+  // user space may only execute RDPMC while the first page of the event is mapped
+  void* page = mmap(nullptr, kPagesize, PROT_READ, MAP_SHARED, fd, 0);
+  if (page == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+  const auto* event_page = static_cast<const volatile perf_event_mmap_page*>(page);
+  if (!event_page->cap_user_rdpmc || event_page->index == 0) {
+    munmap(page, kPagesize);
+    close(fd);
+    return false;
+  }
+  *counter = PerformanceCounter{metric, fd, page};
+  return true;
+}
+
+void Executor::ClosePerformanceCounter(PerformanceCounter* counter) {
+  if (counter->fd == -1) {
+    return;
+  }
+  munmap(counter->page, kPagesize);
+  close(counter->fd);
+  counter->fd = -1;
+  counter->page = nullptr;
+}
+
+void Executor::OpenPerformanceCounters() {
+  // the metric is always recorded (CYCLES is taken by the timer)
+  std::vector<Metric> metrics;
+  if (config_.metric != Metric::CYCLES) {
+    metrics.push_back(config_.metric);
+  }
+  for (Metric metric : config_.recorded_metrics) {
+    if (metric != Metric::CYCLES &&
+        std::find(metrics.begin(), metrics.end(), metric) == metrics.end()) {
+      metrics.push_back(metric);
+    }
+  }
+  if (metrics.size() > kMaxPerformanceCounters) {
+    LOG_ERROR("At most " + std::to_string(kMaxPerformanceCounters) +
+        " performance counters can be recorded. Aborting!");
+    std::exit(1);
+  }
+
+  performance_counters_.clear();
+  for (Metric metric : metrics) {
+    PerformanceCounter counter{};
+    if (!OpenPerformanceCounter(metric, &counter)) {
+      LOG_ERROR("Couldn't open the performance counter for " + MetricToString(metric) +
+          " (unsupported by the CPU or no user space access to RDPMC). Aborting!");
+      std::exit(1);
+    }
+    performance_counters_.push_back(counter);
+  }
+  counter_overheads_.assign(performance_counters_.size(), 0);
+}
+
+void Executor::ClosePerformanceCounters() {
+  ClosePerformanceCounter(&cycle_counter_);
+  for (PerformanceCounter& counter : performance_counters_) {
+    ClosePerformanceCounter(&counter);
+  }
+  CloseFrequencyCounters();
+}
+
+void Executor::OpenFrequencyCounters() {
+  struct perf_event_attr attributes{};
+  attributes.type = PERF_TYPE_HARDWARE;
+  attributes.size = sizeof(attributes);
+  attributes.read_format = PERF_FORMAT_GROUP;
+  attributes.exclude_kernel = 1;
+  attributes.exclude_hv = 1;
+  attributes.config = PERF_COUNT_HW_CPU_CYCLES;
+  int leader_fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+  if (leader_fd == -1) {
+    LOG_DEBUG("Cycle counters are not available; frequency transitions are not detected");
+    return;
+  }
+  attributes.config = PERF_COUNT_HW_REF_CPU_CYCLES;
+  int member_fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, leader_fd,
+                                           0));
+  if (member_fd == -1) {
+    LOG_DEBUG("Reference cycle counter is not available; frequency transitions are not "
+              "detected");
+    close(leader_fd);
+    return;
+  }
+  frequency_counters_fd_ = leader_fd;
+  reference_cycles_fd_ = member_fd;
+  frequency_ratio_ = 0;
+}
+
+void Executor::CloseFrequencyCounters() {
+  if (frequency_counters_fd_ == -1) {
+    return;
+  }
+  close(reference_cycles_fd_);
+  close(frequency_counters_fd_);
+  frequency_counters_fd_ = -1;
+  reference_cycles_fd_ = -1;
+}
+
+void Executor::TakeContaminationSnapshot(ContaminationSnapshot* snapshot) const {
+  struct rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  snapshot->context_switches = usage.ru_nvcsw + usage.ru_nivcsw;
+  snapshot->page_faults = usage.ru_minflt + usage.ru_majflt;
+  snapshot->cycles = 0;
+  snapshot->reference_cycles = 0;
+  if (frequency_counters_fd_ != -1) {
+    // PERF_FORMAT_GROUP: number of events followed by their values
+    uint64_t group_values[3];
+    if (read(frequency_counters_fd_, group_values, sizeof(group_values)) ==
+        sizeof(group_values)) {
+      snapshot->cycles = group_values[1];
+      snapshot->reference_cycles = group_values[2];
+    }
+  }
+}
+
+int Executor::GetContamination(const ContaminationSnapshot& before,
+                               const ContaminationSnapshot& after) {
+  int contamination = 0;
+  if (after.context_switches != before.context_switches) {
+    contamination |= kContaminationContextSwitch;
+  }
+  if (after.page_faults != before.page_faults) {
+    contamination |= kContaminationPageFault;
+  }
+  uint64_t reference_cycles = after.reference_cycles - before.reference_cycles;
+  if (reference_cycles != 0) {
+    double ratio = static_cast<double>(after.cycles - before.cycles) /
+        static_cast<double>(reference_cycles);
+    if (frequency_ratio_ != 0 &&
+        std::abs(ratio / frequency_ratio_ - 1) > kMaxFrequencyRatioDeviation) {
+      contamination |= kContaminationFrequencyChange;
+    }
+    if (contamination == 0) {
+      frequency_ratio_ = frequency_ratio_ == 0
+                         ? ratio
+                         : frequency_ratio_ + kFrequencyRatioUpdateWeight *
+                             (ratio - frequency_ratio_);
+    }
+  }
+  return contamination;
+}
+
+void Executor::PrepareCounters() {
+  // the kernel may move an event to another counter
+  if (timer_backend_ == TimerBackend::RDPMC) {
+    const auto* event_page = static_cast<const volatile perf_event_mmap_page*>(
+        cycle_counter_.page);
+    execution_control_page_[kControlSlotCounterIndex] = event_page->index - 1;
+  }
+  for (size_t i = 0; i < performance_counters_.size(); i++) {
+    const auto* event_page = static_cast<const volatile perf_event_mmap_page*>(
+        performance_counters_[i].page);
+    execution_control_page_[kControlSlotPerformanceCounterIndexes + i] = event_page->index - 1;
+  }
+}
+
+int Executor::GetSampleResultSize() const {
+  return 1 + static_cast<int>(performance_counters_.size());
+}
+
+uint64_t Executor::ReadMonotonicClock() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + now.tv_nsec;
+}
+
+Executor::CodePageSlot Executor::CreateCodePageSlot(ByteView sequence,
+                                                    int repetitions) {
+  return CodePageSlot{reinterpret_cast<const char*>(sequence.data()), sequence.size(),
+                      repetitions};
+}
+
+int Executor::StampCodePage(const CodePageTemplate& code_template,
+                            std::initializer_list<CodePageSlot> slots) {
+  constexpr char INST_NOP = '\x90';
+  assert(slots.size() + 1 == code_template.fragments.size());
+
+  // identify the code by its template, the slot contents and the number of samples
+  const CodePageTemplate* template_address = &code_template;
+  code_identity_.clear();
+  AppendToCodeIdentity(&template_address, sizeof(template_address));
+  AppendToCodeIdentity(&planned_samples_per_execution_, sizeof(planned_samples_per_execution_));
+  for (const CodePageSlot& slot : slots) {
+    AppendToCodeIdentity(&slot.repetitions, sizeof(slot.repetitions));
+    AppendToCodeIdentity(&slot.length, sizeof(slot.length));
+    AppendToCodeIdentity(slot.bytes, slot.length);
+  }
+  uint64_t code_key = CalculateHashFNV1a(code_identity_.data(), code_identity_.size());
+
+  // reuse the code if it is still in the pool; the identity is compared as well as a
+  // collision of the keys would silently execute the wrong code
+  code_page_use_counter_++;
+  auto pooled_codepage = code_page_pool_index_.find(code_key);
+  if (pooled_codepage != code_page_pool_index_.end() &&
+      code_pages_identity_[pooled_codepage->second] == code_identity_) {
+    code_pages_last_used_[pooled_codepage->second] = code_page_use_counter_;
+    return pooled_codepage->second;
+  }
+  int codepage_no = AcquireCodePage();
+  auto evicted_code = code_page_pool_index_.find(code_pages_key_[codepage_no]);
+  if (evicted_code != code_page_pool_index_.end() && evicted_code->second == codepage_no) {
+    code_page_pool_index_.erase(evicted_code);
+  }
+  code_page_pool_index_[code_key] = codepage_no;
+  code_pages_key_[codepage_no] = code_key;
+  code_pages_identity_[codepage_no] = code_identity_;
+  code_pages_last_used_[codepage_no] = code_page_use_counter_;
+
+  size_t previous_code_end = code_pages_last_written_index_[codepage_no];
+  code_pages_last_written_index_[codepage_no] = 0;
+
+  // prolog
+  AddInstructionToCodePage(codepage_no, prolog_code_);
+
+  // sample body consisting of the fixed fragments and the variable slots in between
+  size_t sample_begin = code_pages_last_written_index_[codepage_no];
+  size_t sample_padding = 0;
+  if (config_.code_alignment > 0) {
+    // the last slot holds the timed measurement sequence; padding in front of the body aligns
+    // it and padding behind the body keeps it aligned in every copy of the body
+    size_t timed_slot_offset = 0;
+    size_t body_length = 0;
+    const CodePageSlot* body_slot = slots.begin();
+    for (const byte_array& fragment : code_template.fragments) {
+      body_length += fragment.size();
+      if (body_slot != slots.end()) {
+        if (body_slot + 1 == slots.end()) {
+          timed_slot_offset = body_length;
+        }
+        body_length += body_slot->length * body_slot->repetitions;
+        body_slot++;
+      }
+    }
+    size_t alignment = config_.code_alignment;
+    size_t leading_padding = (alignment - (sample_begin + timed_slot_offset) % alignment) %
+        alignment;
+    sample_padding = (alignment - (leading_padding + body_length) % alignment) % alignment;
+    sample_padding_.clear();
+    AddPadding(&sample_padding_, leading_padding);
+    AddInstructionToCodePage(codepage_no, sample_padding_);
+  }
+  const CodePageSlot* slot = slots.begin();
+  for (const byte_array& fragment : code_template.fragments) {
+    AddInstructionToCodePage(codepage_no, fragment);
+    if (slot != slots.end()) {
+      for (int i = 0; i < slot->repetitions; i++) {
+        AddInstructionToCodePage(codepage_no, slot->bytes, slot->length);
+      }
+      slot++;
+    }
+  }
+  if (sample_padding > 0) {
+    sample_padding_.clear();
+    AddPadding(&sample_padding_, sample_padding);
+    AddInstructionToCodePage(codepage_no, sample_padding_);
+  }
+  RepeatSampleBody(codepage_no, sample_begin, sample_padding);
 
   // return timing result and epilog
-  MakeTimerResultReturnValue(codepage_no);
-  AddEpilog(codepage_no);
+  AddInstructionToCodePage(codepage_no, epilog_code_);
+
+  // the rest of the page still contains NOPs (see InitializeCodePage) hence we only have to
+  // overwrite what is left of the previous code
+  size_t code_end = code_pages_last_written_index_[codepage_no];
+  if (code_end < previous_code_end) {
+    memset(execution_code_pages_[codepage_no] + code_end, INST_NOP,
+           previous_code_end - code_end);
+  }
 
   // make sure that we do not exceed page boundaries
   assert(code_pages_last_written_index_[codepage_no] < kPagesize);
+  return codepage_no;
+}
+
+void Executor::AppendToCodeIdentity(const void* data, size_t size) {
+  const auto* bytes = static_cast<const std::byte*>(data);
+  code_identity_.insert(code_identity_.end(), bytes, bytes + size);
+}
+
+int Executor::AcquireCodePage() {
+  // pages are reused round-robin, skipping pages that were executed recently s.t. we do not
+  // overwrite code that could still be in flight or in the instruction cache
+  // (self-modifying code penalties)
+  int pool_size = static_cast<int>(execution_code_pages_.size());
+  uint64_t min_reuse_distance = pool_size / 2;
+  for (int i = 0; i < pool_size; i++) {
+    int codepage_no = next_code_page_;
+    next_code_page_ = (next_code_page_ + 1) % pool_size;
+    if (code_page_use_counter_ - code_pages_last_used_[codepage_no] > min_reuse_distance) {
+      return codepage_no;
+    }
+  }
+  // unreachable as at most pool_size/2 pages can be used recently
+  return next_code_page_;
+}
+
+void Executor::RepeatSampleBody(int codepage_no, size_t sample_begin, size_t sample_padding) {
+  // the sample body ends with the stores of its results (see AddSampleEnd) whose
+  // displacements are patched for every copy
+  constexpr size_t displacement_length = 4;
+  uint32_t sample_result_bytes = GetSampleResultSize() * sizeof(uint64_t);
+  int max_samples = static_cast<int>(kPagesize / sample_result_bytes);
+
+  // repeat the sample body; all jumps inside of it are relative hence it can be copied as-is
+  char* codepage = execution_code_pages_[codepage_no];
+  size_t sample_length = code_pages_last_written_index_[codepage_no] - sample_begin;
+  // keep enough space for the epilog
+  size_t reserved_epilog_space = epilog_code_.size() + 1;
+  int samples = 1;
+  while (samples < planned_samples_per_execution_ && samples < max_samples &&
+      code_pages_last_written_index_[codepage_no] + sample_length + reserved_epilog_space <
+          kPagesize) {
+    size_t sample_copy_begin = code_pages_last_written_index_[codepage_no];
+    memcpy(codepage + sample_copy_begin, codepage + sample_begin, sample_length);
+    code_pages_last_written_index_[codepage_no] += sample_length;
+
+    size_t sample_copy_end = code_pages_last_written_index_[codepage_no] - sample_padding;
+    for (size_t displacement_distance : sample_result_displacements_) {
+      char* displacement = codepage + sample_copy_end - displacement_distance;
+      uint32_t result_address;
+      memcpy(&result_address, displacement, displacement_length);
+      result_address += samples * sample_result_bytes;
+      memcpy(displacement, &result_address, displacement_length);
+    }
+    samples++;
+  }
+  code_pages_samples_per_execution_[codepage_no] = samples;
+}
+
+int Executor::ExecuteTestrun(int codepage_no, uint64_t* cycles_elapsed, int* contamination) {
+  execution_no_++;
+  if (config_.use_fork_server) {
+    return ExecuteTestrunInForkServer(codepage_no, cycles_elapsed, contamination);
+  }
+  // guarded and checked for contamination per batch (see BeginExecutionBatch)
+  *contamination = 0;
+  PrepareCounters();
+  return ExecuteCodePage(execution_code_pages_[codepage_no], &fault_state_, cycles_elapsed);
+}
+
+int Executor::ExecuteTestrunInProcess(int codepage_no, uint64_t* cycles_elapsed,
+                                      int* contamination) {
+  PrepareCounters();
+  ArmWatchdog(config_.watchdog_timeout_ms);
+  if (!config_.discard_contaminated_samples) {
+    *contamination = 0;
+    int error = ExecuteCodePage(execution_code_pages_[codepage_no], &fault_state_,
+                                cycles_elapsed);
+    ArmWatchdog(0);
+    return error;
+  }
+  ContaminationSnapshot before;
+  ContaminationSnapshot after;
+  TakeContaminationSnapshot(&before);
+  int error = ExecuteCodePage(execution_code_pages_[codepage_no], &fault_state_,
+                              cycles_elapsed);
+  TakeContaminationSnapshot(&after);
+  ArmWatchdog(0);
+  *contamination = GetContamination(before, after);
+  return error;
+}
+
+///
+/// messages exchanged with the fork server
+///
+struct ForkServerRequest {
+  int codepage_no;
+};
+
+struct ForkServerResponse {
+  int error;
+  int contamination;
+  uint64_t cycles_elapsed;
+  int signal;
+  int fault_code;
+  uintptr_t fault_address;
+};
+
+void Executor::StartForkServer() {
+  int socket_fds[2];
+  // SEQPACKET keeps message boundaries and reports a dead peer instead of blocking
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, socket_fds) != 0) {
+    LOG_ERROR("Couldn't create connection to the fork server. Aborting!");
+    std::exit(1);
+  }
+
+  // flush buffered output as it would be duplicated in the fork server otherwise
+  std::cout.flush();
+  pid_t pid = fork();
+  if (pid == -1) {
+    LOG_ERROR("Couldn't fork the fork server. Aborting!");
+    std::exit(1);
+  }
+  if (pid == 0) {
+    close(socket_fds[0]);
+    // do not outlive the executor if it gets killed
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    RunForkServer(socket_fds[1]);
+  }
+  close(socket_fds[1]);
+  fork_server_pid_ = pid;
+  fork_server_socket_fd_ = socket_fds[0];
+}
+
+void Executor::StopForkServer() {
+  if (fork_server_pid_ == -1) {
+    return;
+  }
+  // closing the connection terminates the fork server
+  close(fork_server_socket_fd_);
+  waitpid(fork_server_pid_, nullptr, 0);
+  fork_server_pid_ = -1;
+  fork_server_socket_fd_ = -1;
 }
 
-int Executor::ExecuteTestrun(int codepage_no, uint64_t* cycles_elapsed) {
-  return ExecuteCodePage(execution_code_pages_[codepage_no], cycles_elapsed);
+void Executor::RunForkServer(int socket_fd) {
+  // the counters of the executor do not count for this process
+  if (timer_backend_ == TimerBackend::RDPMC) {
+    ClosePerformanceCounter(&cycle_counter_);
+    if (!OpenPerformanceCounter(Metric::CYCLES, &cycle_counter_)) {
+      std::_Exit(1);
+    }
+  }
+  for (PerformanceCounter& counter : performance_counters_) {
+    Metric metric = counter.metric;
+    ClosePerformanceCounter(&counter);
+    if (!OpenPerformanceCounter(metric, &counter)) {
+      std::_Exit(1);
+    }
+  }
+  if (frequency_counters_fd_ != -1) {
+    CloseFrequencyCounters();
+    OpenFrequencyCounters();
+  }
+
+  // the process state every execution must leave intact (TLS pointer and GS base)
+  uint64_t fs_base;
+  uint64_t gs_base;
+  syscall(SYS_arch_prctl, ARCH_GET_FS, &fs_base);
+  syscall(SYS_arch_prctl, ARCH_GET_GS, &gs_base);
+
+  ForkServerRequest request;
+  while (recv(socket_fd, &request, sizeof(request), 0) == sizeof(request)) {
+    ForkServerResponse response{};
+    response.error = ExecuteTestrunInProcess(request.codepage_no, &response.cycles_elapsed,
+                                             &response.contamination);
+    if (response.error) {
+      response.signal = fault_state_.last_signal.load();
+      response.fault_code = fault_state_.last_si_code.load();
+      response.fault_address = fault_state_.last_si_addr.load();
+    }
+
+    uint64_t current_fs_base;
+    uint64_t current_gs_base;
+    syscall(SYS_arch_prctl, ARCH_GET_FS, &current_fs_base);
+    syscall(SYS_arch_prctl, ARCH_GET_GS, &current_gs_base);
+    if (current_fs_base != fs_base || current_gs_base != gs_base) {
+      // this process can not be trusted anymore; the executor forks a clean one
+      std::_Exit(1);
+    }
+    if (send(socket_fd, &response, sizeof(response), MSG_NOSIGNAL) != sizeof(response)) {
+      break;
+    }
+  }
+  std::_Exit(0);
+}
+
+int Executor::ExecuteTestrunInForkServer(int codepage_no, uint64_t* cycles_elapsed,
+                                         int* contamination) {
+  ForkServerRequest request{codepage_no};
+  ForkServerResponse response;
+  if (send(fork_server_socket_fd_, &request, sizeof(request), MSG_NOSIGNAL) ==
+      sizeof(request) &&
+      recv(fork_server_socket_fd_, &response, sizeof(response), 0) == sizeof(response)) {
+    if (response.error) {
+      RecordFault(&fault_state_, response.signal, response.fault_code, response.fault_address);
+    }
+    *cycles_elapsed = response.cycles_elapsed;
+    *contamination = response.contamination;
+    return response.error;
+  }
+
+  // the fork server died (or corrupted itself) during the execution; replace it
+  fault_state_.fork_server_crash_no.fetch_add(1, std::memory_order_relaxed);
+  StopForkServer();
+  StartForkServer();
+  *cycles_elapsed = -1;
+  *contamination = 0;
+  return 1;
 }
 
 void Executor::ClearDataPage() {
@@ -420,7 +1878,7 @@ void Executor::InitializeCodePage(int codepage_no) {
   code_pages_last_written_index_[codepage_no] = 0;
 }
 
-void Executor::AddProlog(int codepage_no) {
+void Executor::AddProlog(byte_array* code) {
   // NOTE: everything in this function must be mirrored by AddEpilog
   constexpr char INST_PUSH_RBX_RSP_RBP[] = "\x53\x54\x55";
   constexpr char INST_PUSH_R12_R13_R14_R15[] = "\x41\x54\x41\x55\x41\x56\x41\x57";
@@ -428,34 +1886,47 @@ void Executor::AddProlog(int codepage_no) {
   constexpr char INST_STMXCSR_RSP[] = "\x0f\xae\x1c\x24";
   constexpr char INST_FSTCW_RSP[] = "\x9b\xd9\x3c\x24";
   constexpr char INST_MOV_RBP_RSP[] = "\x48\x89\xe5";
-  constexpr char INST_SUB_RSP_0x1000[] = "\x48\x81\xec\x00\x10\x00\x00";
 
 
   // safe all callee-saved registers (according to System V amd64 ABI)
-  AddInstructionToCodePage(codepage_no, INST_PUSH_RBX_RSP_RBP,
-                                                 3);
-  AddInstructionToCodePage(codepage_no, INST_PUSH_R12_R13_R14_R15,
-                                          8);
+  AddInstruction(code, INST_PUSH_RBX_RSP_RBP, 3);
+  AddInstruction(code, INST_PUSH_R12_R13_R14_R15, 8);
 
   // save MXCSR register (misconfigured MXCSR can lead to floating point exceptions)
-  AddInstructionToCodePage(codepage_no, INST_SUB_RSP_0x8,
-                                          4);
-  AddInstructionToCodePage(codepage_no, INST_STMXCSR_RSP,
-                                          4);
+  AddInstruction(code, INST_SUB_RSP_0x8, 4);
+  AddInstruction(code, INST_STMXCSR_RSP, 4);
 
   // save x87 FPU control word (according to System V amd64 ABI)
-  AddInstructionToCodePage(codepage_no, INST_SUB_RSP_0x8,
-                                          4);
-  AddInstructionToCodePage(codepage_no, INST_FSTCW_RSP,
-                                          4);
+  AddInstruction(code, INST_SUB_RSP_0x8, 4);
+  AddInstruction(code, INST_FSTCW_RSP, 4);
 
   // save stackpointer in RBP (in case some instruction changes the RSP value)
-  AddInstructionToCodePage(codepage_no, INST_MOV_RBP_RSP, 3);
+  AddInstruction(code, INST_MOV_RBP_RSP, 3);
+}
+
+void Executor::AddSampleBegin(byte_array* code) {
+  constexpr char INST_MOV_RSP_RBP[] = "\x48\x89\xec";
+  constexpr char INST_SUB_RSP_IMM32[] = "\x48\x81\xec";
+  constexpr char INST_FLDCW_RBP[] = "\xd9\x6d\x00";
+  constexpr char INST_LDMXCSR_RBP_PLUS_0x8[] = "\x0f\xae\x55\x08";
+  constexpr char INST_CLD[] = "\xfc";
 
   // create room on stack that is big enough in case some instructions trashes stack values
-  // (e.g. PUSH/POP)
-  AddInstructionToCodePage(codepage_no, INST_SUB_RSP_0x1000, 7);
+  // (e.g. PUSH/POP), 4 KiB per 100 executions of a sequence
+  constexpr uint64_t kStackGuardSize = 0x1000 * kMaxSequenceExecutions / 100;
+  AddInstruction(code, INST_MOV_RSP_RBP, 3);
+  AddInstruction(code, INST_SUB_RSP_IMM32, 3);
+  AddInstruction(code, NumberToBytesLE(kStackGuardSize, 4));
+
+  // restore the state saved by the prolog as the previous sample could have changed it
+  AddInstruction(code, INST_FLDCW_RBP, 3);
+  AddInstruction(code, INST_LDMXCSR_RBP_PLUS_0x8, 4);
+  AddInstruction(code, INST_CLD, 1);
+
+  AddInitializeMemoryRegisters(code);
+}
 
+void Executor::AddInitializeMemoryRegisters(byte_array* code) {
   // initialize registers R8, RAX, RDI, RSI, RDX and XMM0 to point to memory locations
   // NOTE: this must match the memory registers in the code generation
   // last 4 bytes encode the immediate in little endian
@@ -464,29 +1935,73 @@ void Executor::AddProlog(int codepage_no) {
   constexpr char INST_MOV_RDI_0xffffffff[] = "\x48\xc7\xc7\xff\xff\xff\xff";
   constexpr char INST_MOV_RSI_0xffffffff[] = "\x48\xc7\xc6\xff\xff\xff\xff";
   constexpr char INST_MOV_RDX_0xffffffff[] = "\x48\xc7\xc2\xff\xff\xff\xff";
-  byte_array encoded_immediate = NumberToBytesLE(kMemoryBegin, 4);
+  byte_array encoded_immediate = NumberToBytesLE(config_.data_memory_begin, 4);
   constexpr char INST_MOVQ_XMM0_R8[] = "\x66\x49\x0f\x6e\xc0";
 
   // add only the first 3 instruction bytes and add the encoded address manually
-  AddInstructionToCodePage(codepage_no, INST_MOV_R8_0xffffffff, 3);
-  AddInstructionToCodePage(codepage_no, encoded_immediate);
+  AddInstruction(code, INST_MOV_R8_0xffffffff, 3);
+  AddInstruction(code, encoded_immediate);
 
-  AddInstructionToCodePage(codepage_no, INST_MOV_RAX_0xffffffff, 3);
-  AddInstructionToCodePage(codepage_no, encoded_immediate);
+  AddInstruction(code, INST_MOV_RAX_0xffffffff, 3);
+  AddInstruction(code, encoded_immediate);
 
-  AddInstructionToCodePage(codepage_no, INST_MOV_RDI_0xffffffff, 3);
-  AddInstructionToCodePage(codepage_no, encoded_immediate);
+  AddInstruction(code, INST_MOV_RDI_0xffffffff, 3);
+  AddInstruction(code, encoded_immediate);
 
-  AddInstructionToCodePage(codepage_no, INST_MOV_RSI_0xffffffff, 3);
-  AddInstructionToCodePage(codepage_no, encoded_immediate);
+  AddInstruction(code, INST_MOV_RSI_0xffffffff, 3);
+  AddInstruction(code, encoded_immediate);
 
-  AddInstructionToCodePage(codepage_no, INST_MOV_RDX_0xffffffff, 3);
-  AddInstructionToCodePage(codepage_no, encoded_immediate);
+  AddInstruction(code, INST_MOV_RDX_0xffffffff, 3);
+  AddInstruction(code, encoded_immediate);
 
-  AddInstructionToCodePage(codepage_no, INST_MOVQ_XMM0_R8, 5);
+  AddInstruction(code, INST_MOVQ_XMM0_R8, 5);
 }
 
-void Executor::AddEpilog(int codepage_no) {
+void Executor::AddSampleEnd(byte_array* code) {
+  // mov [disp32], r11
+  constexpr char INST_MOV_DEREF_DISP32_R11[] = "\x4c\x89\x1c\x25\xff\xff\xff\xff";
+  constexpr char INST_MOV_ECX_DEREF_DISP32[] = "\x8b\x0c\x25";
+  constexpr char INST_RDPMC[] = "\x0f\x33";
+  constexpr char INST_SHL_RDX_32_OR_RAX_RDX[] = "\x48\xc1\xe2\x20\x48\x09\xd0";
+  constexpr char INST_SUB_RAX_DEREF_DISP32[] = "\x48\x2b\x04\x25";
+  constexpr char INST_MOV_DEREF_DISP32_RAX[] = "\x48\x89\x04\x25";
+  constexpr size_t displacement_length = 4;
+
+  // the stores of the first sample are patched for all copies in RepeatSampleBody hence
+  // they must stay at the end of the sample body
+  std::vector<size_t> displacement_positions;
+  for (size_t i = 0; i < performance_counters_.size(); i++) {
+    AddInstruction(code, INST_MOV_ECX_DEREF_DISP32, 3);
+    AddInstruction(code, NumberToBytesLE(
+        control_memory_begin_ + (kControlSlotPerformanceCounterIndexes + i) * sizeof(uint64_t),
+        displacement_length));
+    AddInstruction(code, INST_RDPMC, 2);
+    AddInstruction(code, INST_SHL_RDX_32_OR_RAX_RDX, 7);
+    AddInstruction(code, INST_SUB_RAX_DEREF_DISP32, 4);
+    AddInstruction(code, NumberToBytesLE(
+        control_memory_begin_ + (kControlSlotPerformanceCounterStarts + i) * sizeof(uint64_t),
+        displacement_length));
+    // delta of counter i is value i + 1 of the sample result
+    AddInstruction(code, INST_MOV_DEREF_DISP32_RAX, 4);
+    displacement_positions.push_back(code->size());
+    AddInstruction(code, NumberToBytesLE(result_memory_begin_ + (i + 1) * sizeof(uint64_t),
+                                         displacement_length));
+  }
+
+  // store timing result of the first sample
+  AddInstruction(code, INST_MOV_DEREF_DISP32_R11,
+                 sizeof(INST_MOV_DEREF_DISP32_R11) - 1 - displacement_length);
+  displacement_positions.push_back(code->size());
+  AddInstruction(code, NumberToBytesLE(result_memory_begin_, displacement_length));
+
+  // the same for all templates
+  sample_result_displacements_.clear();
+  for (size_t position : displacement_positions) {
+    sample_result_displacements_.push_back(code->size() - position);
+  }
+}
+
+void Executor::AddEpilog(byte_array* code) {
   // NOTE: everything in this function must be mirrored by AddProlog
   constexpr char INST_CLD[] = "\xfc";
   constexpr char INST_POP_R15_R14_R13_R12[] = "\x41\x5f\x41\x5e\x41\x5d\x41\x5c";
@@ -498,72 +2013,197 @@ void Executor::AddEpilog(int codepage_no) {
   constexpr char INST_FLDCW_RSP[] = "\xd9\x2c\x24";
 
   // System-V abi specifies that DF is always zero upon function return
-  AddInstructionToCodePage(codepage_no, INST_CLD, 1);
+  AddInstruction(code, INST_CLD, 1);
   // restore stack
-  AddInstructionToCodePage(codepage_no, INST_MOV_RSP_RBP, 3);
+  AddInstruction(code, INST_MOV_RSP_RBP, 3);
 
   // restore x87 FPU control word
-  AddInstructionToCodePage(codepage_no, INST_FLDCW_RSP, 3);
-  AddInstructionToCodePage(codepage_no, INST_ADD_RSP_0x8, 4);
+  AddInstruction(code, INST_FLDCW_RSP, 3);
+  AddInstruction(code, INST_ADD_RSP_0x8, 4);
 
   // restore MXCSR register
-  AddInstructionToCodePage(codepage_no, INST_LDMXCSR_RSP, 4);
-  AddInstructionToCodePage(codepage_no, INST_ADD_RSP_0x8, 4);
+  AddInstruction(code, INST_LDMXCSR_RSP, 4);
+  AddInstruction(code, INST_ADD_RSP_0x8, 4);
 
   // restore registers
-  AddInstructionToCodePage(codepage_no, INST_POP_R15_R14_R13_R12, 8);
-  AddInstructionToCodePage(codepage_no, INST_POP_RBP_RSP_RBX, 3);
+  AddInstruction(code, INST_POP_R15_R14_R13_R12, 8);
+  AddInstruction(code, INST_POP_RBP_RSP_RBX, 3);
 
   // insert return
-  AddInstructionToCodePage(codepage_no, INST_RET, 1);
+  AddInstruction(code, INST_RET, 1);
 }
 
-void Executor::AddSerializeInstructionToCodePage(int codepage_no) {
-  // insert CPUID to serialize instruction stream
+void Executor::AddSerializeInstruction(byte_array* code) {
   constexpr char INST_XOR_EAX_EAX_CPUID[] = "\x31\xc0\x0f\xa2";
-  AddInstructionToCodePage(codepage_no, INST_XOR_EAX_EAX_CPUID, 4);
+  constexpr char INST_MFENCE_LFENCE[] = "\x0f\xae\xf0\x0f\xae\xe8";
+  constexpr char INST_SERIALIZE[] = "\x0f\x01\xe8";
+
+  switch (serialization_primitive_) {
+    case SerializationPrimitive::CPUID:
+      // insert CPUID to serialize instruction stream
+      AddInstruction(code, INST_XOR_EAX_EAX_CPUID, 4);
+      break;
+    case SerializationPrimitive::LFENCE:
+      // MFENCE waits for all memory operations, LFENCE for all instructions to complete
+      AddInstruction(code, INST_MFENCE_LFENCE, 6);
+      break;
+    case SerializationPrimitive::SERIALIZE:
+      AddInstruction(code, INST_SERIALIZE, 3);
+      break;
+    case SerializationPrimitive::AUTO:
+      assert(false);
+      break;
+  }
 }
 
-void Executor::AddTimerStartToCodePage(int codepage_no) {
+void Executor::AddTimerStart(byte_array* code) {
   constexpr char INST_MFENCE[] = "\x0f\xae\xf0";
-  constexpr char INST_XOR_EAX_EAX_CPUID[] = "\x31\xc0\x0f\xa2";
   // note that we can use R10 as it is caller-saved
   constexpr char INST_MOV_R10_RAX[] = "\x49\x89\xc2";
+  constexpr char INST_MOV_ECX_DEREF_DISP32[] = "\x8b\x0c\x25";
+  constexpr char INST_RDPMC[] = "\x0f\x33";
+  constexpr char INST_SHL_RDX_32_OR_RAX_RDX[] = "\x48\xc1\xe2\x20\x48\x09\xd0";
+  constexpr char INST_MOV_DEREF_DISP32_RAX[] = "\x48\x89\x04\x25";
+
+  // the performance counters enclose the timed region s.t. they do not disturb the timing
+  // (their constant share of the timer instructions is removed by the calibration)
+  for (size_t i = 0; i < performance_counters_.size(); i++) {
+    AddInstruction(code, INST_MOV_ECX_DEREF_DISP32, 3);
+    AddInstruction(code, NumberToBytesLE(
+        control_memory_begin_ + (kControlSlotPerformanceCounterIndexes + i) * sizeof(uint64_t),
+        4));
+    AddInstruction(code, INST_RDPMC, 2);
+    AddInstruction(code, INST_SHL_RDX_32_OR_RAX_RDX, 7);
+    AddInstruction(code, INST_MOV_DEREF_DISP32_RAX, 4);
+    AddInstruction(code, NumberToBytesLE(
+        control_memory_begin_ + (kControlSlotPerformanceCounterStarts + i) * sizeof(uint64_t),
+        4));
+  }
 
-  AddInstructionToCodePage(codepage_no, INST_MFENCE, 3);
-  AddInstructionToCodePage(codepage_no, INST_XOR_EAX_EAX_CPUID, 4);
-#if defined(INTEL)
-  constexpr char INST_RDTSC[] = "\x0f\x31";
-  AddInstructionToCodePage(codepage_no, INST_RDTSC, 2);
-#elif defined(AMD)
-  constexpr char INST_MOV_ECX_1_RDPRU[] = "\xb9\x01\x00\x00\x00\x0f\x01\xfd";
-  // for AMD we use RDPRU to read the APERF register which makes a more stable timer than RDTSC
-  AddInstructionToCodePage(codepage_no, INST_MOV_ECX_1_RDPRU, 8);
-#endif
-  // move result to R10 s.t. we can use it later in AddTimerEndToCodePage
-  AddInstructionToCodePage(codepage_no, INST_MOV_R10_RAX,3);
+  AddInstruction(code, INST_MFENCE, 3);
+  AddSerializeInstruction(code);
+  AddTimerRead(code, false);
+  // move result to R10 s.t. we can use it later in AddTimerEnd
+  AddInstruction(code, INST_MOV_R10_RAX, 3);
+  if (timer_backend_ == TimerBackend::CLOCK_GETTIME) {
+    // the call destroyed the memory registers
+    AddInitializeMemoryRegisters(code);
+  }
 }
 
-void Executor::AddTimerEndToCodePage(int codepage_no) {
-  constexpr char INST_XOR_EAX_EAX_CPUID[] = "\x31\xc0\x0f\xa2";
+void Executor::AddTimerEnd(byte_array* code) {
+  constexpr char INST_MFENCE[] = "\x0f\xae\xf0";
+  constexpr char INST_LFENCE[] = "\x0f\xae\xe8";
   constexpr char INST_SUB_RAX_R10[] = "\x4c\x29\xd0";
   // note that we can use R11 as it is caller-saved
   constexpr char INST_MOV_R11_RAX[] = "\x49\x89\xc3";
 
-#if defined(INTEL)
+  switch (timer_backend_) {
+    case TimerBackend::RDTSC:
+      // RDTSCP waits for all previous instructions itself
+      break;
+    case TimerBackend::RDPRU:
+      AddInstruction(code, INST_MFENCE, 3);
+      AddSerializeInstruction(code);
+      break;
+    case TimerBackend::RDPMC:
+    case TimerBackend::CLOCK_GETTIME:
+      // wait for the measurement sequence to complete
+      AddInstruction(code, INST_LFENCE, 3);
+      break;
+    case TimerBackend::AUTO:
+      assert(false);
+      break;
+  }
+  AddTimerRead(code, true);
+  AddInstruction(code, INST_SUB_RAX_R10, 3);
+  AddInstruction(code, INST_MOV_R11_RAX, 3);
+  AddSerializeInstruction(code);
+}
+
+void Executor::AddTimerRead(byte_array* code, bool is_timer_end) {
   constexpr char INST_RDTSCP[] = "\x0f\x01\xf9";
-  AddInstructionToCodePage(codepage_no, INST_RDTSCP, 3);
-#elif defined(AMD)
-  // for AMD we use RDPRU to read the APERF register which makes a more stable timer than RDTSC
-  constexpr char INST_MFENCE[] = "\x0f\xae\xf0";
+  constexpr char INST_RDTSC[] = "\x0f\x31";
   constexpr char INST_MOV_ECX_1_RDPRU[] = "\xb9\x01\x00\x00\x00\x0f\x01\xfd";
-  AddInstructionToCodePage(codepage_no, INST_MFENCE, 3);
-  AddInstructionToCodePage(codepage_no, INST_XOR_EAX_EAX_CPUID, 4);
-  AddInstructionToCodePage(codepage_no, INST_MOV_ECX_1_RDPRU, 8);
-#endif
-  AddInstructionToCodePage(codepage_no, INST_SUB_RAX_R10, 3);
-  AddInstructionToCodePage(codepage_no, INST_MOV_R11_RAX, 3);
-  AddInstructionToCodePage(codepage_no, INST_XOR_EAX_EAX_CPUID, 4);
+  constexpr char INST_MOV_ECX_DEREF_DISP32[] = "\x8b\x0c\x25";
+  constexpr char INST_RDPMC[] = "\x0f\x33";
+  // combine EDX:EAX s.t. the difference does not wrap after 2^32 ticks
+  constexpr char INST_SHL_RDX_32_OR_RAX_RDX[] = "\x48\xc1\xe2\x20\x48\x09\xd0";
+
+  constexpr char INST_CLD[] = "\xfc";
+  constexpr char INST_MOV_DEREF_DISP32_RSP[] = "\x48\x89\x24\x25";
+  constexpr char INST_MOV_DEREF_DISP32_R10[] = "\x4c\x89\x14\x25";
+  constexpr char INST_MOV_RSP_IMM32[] = "\x48\xc7\xc4";
+  constexpr char INST_MOV_RAX_IMM64[] = "\x48\xb8";
+  constexpr char INST_CALL_RAX[] = "\xff\xd0";
+  constexpr char INST_MOV_R10_DEREF_DISP32[] = "\x4c\x8b\x14\x25";
+  constexpr char INST_MOV_RSP_DEREF_DISP32[] = "\x48\x8b\x24\x25";
+  byte_array saved_rsp_address = NumberToBytesLE(
+      control_memory_begin_ + kControlSlotSavedRSP * sizeof(uint64_t), 4);
+  byte_array saved_r10_address = NumberToBytesLE(
+      control_memory_begin_ + kControlSlotSavedR10 * sizeof(uint64_t), 4);
+
+  switch (timer_backend_) {
+    case TimerBackend::RDTSC:
+      // RDTSCP at the end as it waits for the measurement sequence to complete
+      if (is_timer_end) {
+        AddInstruction(code, INST_RDTSCP, 3);
+      } else {
+        AddInstruction(code, INST_RDTSC, 2);
+      }
+      AddInstruction(code, INST_SHL_RDX_32_OR_RAX_RDX, 7);
+      break;
+    case TimerBackend::RDPRU:
+      // read the APERF register which makes a more stable timer than RDTSC on AMD
+      AddInstruction(code, INST_MOV_ECX_1_RDPRU, 8);
+      AddInstruction(code, INST_SHL_RDX_32_OR_RAX_RDX, 7);
+      break;
+    case TimerBackend::RDPMC:
+      // the index of the counter is only known at runtime (see PrepareCounters)
+      AddInstruction(code, INST_MOV_ECX_DEREF_DISP32, 3);
+      AddInstruction(code, NumberToBytesLE(
+          control_memory_begin_ + kControlSlotCounterIndex * sizeof(uint64_t), 4));
+      AddInstruction(code, INST_RDPMC, 2);
+      AddInstruction(code, INST_SHL_RDX_32_OR_RAX_RDX, 7);
+      break;
+    case TimerBackend::CLOCK_GETTIME:
+      // call ReadMonotonicClock on the timer stack as the tested code may have changed RSP
+      // and the stack content below it must stay intact
+      AddInstruction(code, INST_CLD, 1);
+      AddInstruction(code, INST_MOV_DEREF_DISP32_RSP, 4);
+      AddInstruction(code, saved_rsp_address);
+      AddInstruction(code, INST_MOV_DEREF_DISP32_R10, 4);
+      AddInstruction(code, saved_r10_address);
+      AddInstruction(code, INST_MOV_RSP_IMM32, 3);
+      AddInstruction(code, NumberToBytesLE(result_memory_begin_ + kResultMemorySize, 4));
+      AddInstruction(code, INST_MOV_RAX_IMM64, 2);
+      AddInstruction(code, NumberToBytesLE(reinterpret_cast<uintptr_t>(&ReadMonotonicClock),
+                                           8));
+      AddInstruction(code, INST_CALL_RAX, 2);
+      AddInstruction(code, INST_MOV_R10_DEREF_DISP32, 4);
+      AddInstruction(code, saved_r10_address);
+      AddInstruction(code, INST_MOV_RSP_DEREF_DISP32, 4);
+      AddInstruction(code, saved_rsp_address);
+      break;
+    case TimerBackend::AUTO:
+      assert(false);
+      break;
+  }
+}
+
+void Executor::MakeTimerResultReturnValue(byte_array* code) {
+  constexpr char MOV_RAX_R11[] = "\x4c\x89\xd8";
+  AddInstruction(code, MOV_RAX_R11, 3);
+}
+
+void Executor::AddInstruction(byte_array* code, const char* instruction_bytes,
+                              size_t instruction_length) {
+  const auto* bytes = reinterpret_cast<const std::byte*>(instruction_bytes);
+  code->insert(code->end(), bytes, bytes + instruction_length);
+}
+
+void Executor::AddInstruction(byte_array* code, const byte_array& instruction_bytes) {
+  code->insert(code->end(), instruction_bytes.begin(), instruction_bytes.end());
 }
 
 void Executor::AddInstructionToCodePage(int codepage_no,
@@ -575,7 +2215,8 @@ void Executor::AddInstructionToCodePage(int codepage_no,
     sstream << "Problematic code page is at address 0x"
             << std::hex << reinterpret_cast<int64_t>(execution_code_pages_[codepage_no]);
     LOG_DEBUG(sstream.str());
-    LOG_ERROR("Generated code exceeds page boundary");
+    LOG_ERROR("Generated code exceeds page boundary (" +
+      std::to_string(page_idx + instruction_length) + "/" + std::to_string(kPagesize) + ")");
     std::abort();
   }
 
@@ -586,150 +2227,413 @@ void Executor::AddInstructionToCodePage(int codepage_no,
 
 void Executor::AddInstructionToCodePage(int codepage_no,
                                           const byte_array& instruction_bytes) {
-  size_t page_idx = code_pages_last_written_index_[codepage_no];
-  if (page_idx + instruction_bytes.size() >= kPagesize) {
-    std::stringstream sstream;
-    sstream << "Problematic code page is at address 0x"
-      << std::hex << reinterpret_cast<int64_t>(execution_code_pages_[codepage_no]);
-    LOG_DEBUG(sstream.str());
-    LOG_ERROR("Generated code exceeds page boundary (" +
-      std::to_string(page_idx + instruction_bytes.size()) + "/" + std::to_string(kPagesize) + ")");
-    std::abort();
-  }
-
-  size_t new_page_idx = page_idx;
-  assert(codepage_no < static_cast<int>(execution_code_pages_.size()));
-  for (std::byte b : instruction_bytes) {
-    execution_code_pages_[codepage_no][new_page_idx] = std::to_integer<int>(b);
-    new_page_idx++;
-  }
-  code_pages_last_written_index_[codepage_no] = new_page_idx;
-}
-
-void Executor::MakeTimerResultReturnValue(int codepage_no) {
-  constexpr char MOV_RAX_R11[] = "\x4c\x89\xd8";
-  assert(code_pages_last_written_index_[codepage_no] + 3 < kPagesize);
-
-  AddInstructionToCodePage(codepage_no, MOV_RAX_R11, 3);
+  AddInstructionToCodePage(codepage_no, reinterpret_cast<const char*>(instruction_bytes.data()),
+                           instruction_bytes.size());
 }
 
 byte_array Executor::CreateSequenceOfNOPs(size_t length) {
   constexpr auto INST_NOP_AS_DECIMAL = static_cast<unsigned char>(0x90);
-  byte_array nops;
-  std::byte nop_byte{INST_NOP_AS_DECIMAL};
-  for (size_t i = 0; i < length; i++) {
-    nops.push_back(nop_byte);
+  return byte_array(length, std::byte{INST_NOP_AS_DECIMAL});
+}
+
+void Executor::AddPadding(byte_array* code, size_t length) {
+  // recommended multi-byte NOPs (Intel SDM, Vol. 2B, NOP) indexed by their length - 1
+  constexpr const char* INST_MULTI_BYTE_NOPS[] = {
+      "\x90",
+      "\x66\x90",
+      "\x0f\x1f\x00",
+      "\x0f\x1f\x40\x00",
+      "\x0f\x1f\x44\x00\x00",
+      "\x66\x0f\x1f\x44\x00\x00",
+      "\x0f\x1f\x80\x00\x00\x00\x00",
+      "\x0f\x1f\x84\x00\x00\x00\x00\x00",
+      "\x66\x0f\x1f\x84\x00\x00\x00\x00\x00"};
+  constexpr size_t kMaxNOPLength = std::size(INST_MULTI_BYTE_NOPS);
+  while (length > 0) {
+    size_t nop_length = std::min(length, kMaxNOPLength);
+    AddInstruction(code, INST_MULTI_BYTE_NOPS[nop_length - 1], nop_length);
+    length -= nop_length;
   }
-  return nops;
 }
 
 //
 // fault handling logic
 //
-static jmp_buf fault_handler_jump_buf;
 
-// Fault counters
-static int sigsegv_no = 0;
-static int sigfpe_no = 0;
-static int sigill_no = 0;
-static int sigtrap_no = 0;
+// Generated code is called through osiris_call_code_page which saves the callee-saved
+// registers, MXCSR and the x87 control word on the stack and stores the resulting stack
+// pointer in *saved_rsp (cleared again once the code page returned). On a fault, the fault
+// handler resumes the thread at osiris_code_page_exit with that stack pointer, i.e., as if the
+// code page had returned. Returning from the handler restores the signal mask as part of
+// sigreturn, hence recovering from a fault costs no syscall besides the signal delivery.
+extern "C" uint64_t osiris_call_code_page(void* codepage, volatile uint64_t* saved_rsp);
+extern "C" char osiris_code_page_exit[];
+asm(R"(
+    .text
+    .globl osiris_call_code_page
+    .type osiris_call_code_page, @function
+osiris_call_code_page:
+    push %rbx
+    push %rbp
+    push %r12
+    push %r13
+    push %r14
+    push %r15
+    sub $24, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    mov %rsi, 8(%rsp)
+    mov %rsp, (%rsi)
+    call *%rdi
+    .globl osiris_code_page_exit
+osiris_code_page_exit:
+    mov 8(%rsp), %rsi
+    movq $0, (%rsi)
+    cld
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    add $24, %rsp
+    pop %r15
+    pop %r14
+    pop %r13
+    pop %r12
+    pop %rbp
+    pop %rbx
+    ret
+    .size osiris_call_code_page, .-osiris_call_code_page
+)");
+
+// stack pointer osiris_call_code_page resumes the thread with after a fault
+// (0 while the thread does not execute generated code)
+static thread_local volatile uint64_t code_page_saved_rsp = 0;
+
+// set by the fault handler if the code page of the thread faulted
+static thread_local volatile bool code_page_faulted = false;
+
+// fault state of the executor whose code page the thread currently executes
+// (nullptr while the thread does not execute generated code)
+static thread_local FaultState* current_fault_state = nullptr;
+
+// set by the fault handler if the watchdog of the thread fired between two executions of a
+// batch; the remaining executions of the batch count as hanging
+static thread_local volatile bool watchdog_expired = false;
+
+// number of executors that rely on the fault handler being registered
+static std::mutex fault_handler_users_mutex;
+static int fault_handler_users = 0;
+
+// size of the alternate stack the fault handler runs on
+constexpr size_t kAlternateSignalStackSize = 64 * 1024;
+
+// signal sent by the watchdog timer when an execution exceeds its time budget
+constexpr int kWatchdogSignal = SIGALRM;
+
+// signals that we catch and treat as failed executions
+constexpr std::array<int, 6> kFaultSignals = {SIGSEGV, SIGILL, SIGFPE, SIGTRAP, SIGBUS,
+                                              kWatchdogSignal};
+
+// EFLAGS bits the generated code may leave set that must not leak into the recovered thread
+// (trap, direction and alignment check flag)
+constexpr greg_t kEflagsResetMask = (1 << 8) | (1 << 10) | (1 << 18);
+
+namespace {
+
+///
+/// alternate signal stack of a thread (the generated code may leave RSP pointing anywhere,
+/// hence the fault handler must not run on the stack of the faulting code)
+///
+class AlternateSignalStack {
+ public:
+  AlternateSignalStack() : memory_(new char[kAlternateSignalStackSize]) {
+    stack_t signal_stack{};
+    signal_stack.ss_sp = memory_.get();
+    signal_stack.ss_size = kAlternateSignalStackSize;
+    signal_stack.ss_flags = 0;
+    if (sigaltstack(&signal_stack, nullptr) != 0) {
+      LOG_ERROR("Couldn't install alternate signal stack. Aborting!");
+      std::exit(1);
+    }
+  }
+
+  ~AlternateSignalStack() {
+    stack_t signal_stack{};
+    signal_stack.ss_flags = SS_DISABLE;
+    sigaltstack(&signal_stack, nullptr);
+  }
+
+ private:
+  std::unique_ptr<char[]> memory_;
+};
+
+///
+/// one-shot timer of a thread that sends kWatchdogSignal to this thread
+///
+class WatchdogTimer {
+ public:
+  WatchdogTimer() {
+    struct sigevent timer_event{};
+    timer_event.sigev_notify = SIGEV_THREAD_ID;
+    timer_event.sigev_signo = kWatchdogSignal;
+    timer_event.sigev_notify_thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+    if (timer_create(CLOCK_MONOTONIC, &timer_event, &timer_) != 0) {
+      LOG_ERROR("Couldn't create watchdog timer. Aborting!");
+      std::exit(1);
+    }
+    owner_pid_ = getpid();
+  }
+
+  ~WatchdogTimer() {
+    // a forked child inherits this object but not the timer; its id might already name a
+    // timer of the child
+    if (IsOwnedByThisProcess()) {
+      timer_delete(timer_);
+    }
+  }
+
+  /// POSIX timers are not inherited by fork(), i.e., the timer of an object created before
+  /// a fork does not exist in the child
+  bool IsOwnedByThisProcess() const {
+    return owner_pid_ == getpid();
+  }
+
+  /// arms the timer (0 disarms it)
+  void Arm(int64_t timeout_ms) {
+    struct itimerspec timer_value{};
+    timer_value.it_value.tv_sec = timeout_ms / 1000;
+    timer_value.it_value.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    if (timer_settime(timer_, 0, &timer_value, nullptr) != 0) {
+      // without the watchdog a hanging code page would block this thread forever
+      LOG_ERROR("Couldn't arm watchdog timer. Aborting!");
+      std::exit(1);
+    }
+  }
+
+ private:
+  timer_t timer_;
+  pid_t owner_pid_;
+};
+
+// the watchdog of the thread (created on first use)
+thread_local std::unique_ptr<WatchdogTimer> watchdog_timer;
+
+}  // namespace
 
-void Executor::PrintFaultCount() {
+void Executor::ArmWatchdog(int64_t timeout_ms) {
+  if (watchdog_timer != nullptr && !watchdog_timer->IsOwnedByThisProcess()) {
+    // inherited from the parent (e.g. by a worker of the parallel search) whose timer does not
+    // exist in this process
+    watchdog_timer.reset();
+  }
+  if (timeout_ms == 0) {
+    if (watchdog_timer != nullptr) {
+      watchdog_timer->Arm(0);
+    }
+    return;
+  }
+  if (watchdog_timer == nullptr) {
+    watchdog_timer = std::make_unique<WatchdogTimer>();
+  }
+  watchdog_expired = false;
+  watchdog_timer->Arm(timeout_ms);
+}
+
+double Executor::BenchmarkFaultRecovery(ByteView faulting_sequence,
+                                        int no_executions) {
+  byte_array empty_sequence;
+  PlanSamplesPerExecution(1);
+  int codepage = CreateTestrunCode(empty_sequence, empty_sequence, faulting_sequence, 1);
+  uint64_t begin = ReadMonotonicClock();
+  BeginExecutionBatch(no_executions);
+  for (int i = 0; i < no_executions; i++) {
+    uint64_t cycles_elapsed;
+    int contamination;
+    if (ExecuteTestrun(codepage, &cycles_elapsed, &contamination) != 1) {
+      EndExecutionBatch();
+      return 0;
+    }
+  }
+  EndExecutionBatch();
+  uint64_t elapsed_ns = ReadMonotonicClock() - begin;
+  return static_cast<double>(no_executions) * 1e9 / static_cast<double>(elapsed_ns);
+}
+
+void Executor::PrintFaultCount() const {
+  std::stringstream last_fault_address;
+  last_fault_address << std::hex << fault_state_.last_si_addr.load();
   std::cout << "=== Faultcounters of Executor ===" << std::endl
-            << "\tSIGSEGV: " << sigsegv_no << std::endl
-            << "\tSIGFPE: " << sigfpe_no << std::endl
-            << "\tSIGILL: " << sigill_no << std::endl
-            << "\tSIGTRAP: " << sigtrap_no << std::endl
+            << "\tSIGSEGV: " << fault_state_.sigsegv_no.load() << std::endl
+            << "\tSIGFPE: " << fault_state_.sigfpe_no.load() << std::endl
+            << "\tSIGILL: " << fault_state_.sigill_no.load() << std::endl
+            << "\tSIGTRAP: " << fault_state_.sigtrap_no.load() << std::endl
+            << "\tSIGBUS: " << fault_state_.sigbus_no.load() << std::endl
+            << "\tHANG: " << fault_state_.hang_no.load() << std::endl
+            << "\tfork server crashes: " << fault_state_.fork_server_crash_no.load()
+            << std::endl
+            << "\tlast fault: signal " << fault_state_.last_signal.load()
+            << " (si_code: " << fault_state_.last_si_code.load()
+            << ", si_addr: 0x" << last_fault_address.str() << ")" << std::endl
             << "=================================" << std::endl;
 }
 
-void Executor::FaultHandler(int sig) {
+void Executor::PrintContaminationRate() const {
+  const ContaminationStatistics& statistics = contamination_statistics_;
+  double discarded_percentage = statistics.execution_no == 0
+      ? 0
+      : 100.0 * static_cast<double>(statistics.discarded_no) /
+          static_cast<double>(statistics.execution_no);
+  std::cout << "=== Contamination of Executions ===" << std::endl
+            << "\texecutions: " << statistics.execution_no << std::endl
+            << "\tcontext switches: " << statistics.context_switch_no << std::endl
+            << "\tpage faults: " << statistics.page_fault_no << std::endl
+            << "\tfrequency changes: " << statistics.frequency_change_no << std::endl
+            << "\tdiscarded: " << statistics.discarded_no << " (" << discarded_percentage
+            << "%)" << std::endl
+            << "===================================" << std::endl;
+}
+
+const ContaminationStatistics& Executor::GetContaminationStatistics() const {
+  return contamination_statistics_;
+}
+
+const FaultState& Executor::GetFaultState() const {
+  return fault_state_;
+}
+
+void Executor::FaultHandler(int sig, siginfo_t* siginfo, void* ucontext) {
   // NOTE: this function and Executor::ExecuteCodePage must both be static functions
-  //       for the signal handling + jmp logic to work
+  //       for the signal handling + recovery logic to work
+  FaultState* fault_state = current_fault_state;
+  if (fault_state == nullptr || code_page_saved_rsp == 0) {
+    if (sig == kWatchdogSignal) {
+      // the budget of the batch ran out between two of its executions
+      watchdog_expired = true;
+      return;
+    }
+    // the fault was not caused by generated code; fall back to the default action which is
+    // taken as soon as the faulting instruction is executed again
+    signal(sig, SIG_DFL);
+    return;
+  }
+
+  RecordFault(fault_state, sig, siginfo->si_code, reinterpret_cast<uintptr_t>(siginfo->si_addr));
+  code_page_faulted = true;
+
+  // resume as if the code page had returned (see osiris_call_code_page)
+  auto* context = static_cast<ucontext_t*>(ucontext);
+  context->uc_mcontext.gregs[REG_RSP] = static_cast<greg_t>(code_page_saved_rsp);
+  context->uc_mcontext.gregs[REG_RIP] = reinterpret_cast<greg_t>(osiris_code_page_exit);
+  context->uc_mcontext.gregs[REG_RAX] = -1;
+  context->uc_mcontext.gregs[REG_EFL] &= ~kEflagsResetMask;
+}
+
+void Executor::RecordFault(FaultState* fault_state, int sig, int fault_code,
+                           uintptr_t fault_address) {
+  // NOTE: this function is called by the fault handler and must be async-signal-safe
   switch (sig) {
-    case SIGSEGV:sigsegv_no++;
+    case SIGSEGV:fault_state->sigsegv_no.fetch_add(1, std::memory_order_relaxed);
       break;
-    case SIGFPE:sigfpe_no++;
+    case SIGFPE:fault_state->sigfpe_no.fetch_add(1, std::memory_order_relaxed);
       break;
-    case SIGILL:sigill_no++;
+    case SIGILL:fault_state->sigill_no.fetch_add(1, std::memory_order_relaxed);
       break;
-    case SIGTRAP:sigtrap_no++;
+    case SIGTRAP:fault_state->sigtrap_no.fetch_add(1, std::memory_order_relaxed);
+      break;
+    case SIGBUS:fault_state->sigbus_no.fetch_add(1, std::memory_order_relaxed);
+      break;
+    case kWatchdogSignal:fault_state->hang_no.fetch_add(1, std::memory_order_relaxed);
       break;
     default:std::abort();
   }
-
-  // jump back to the previously stored fallback point
-  longjmp(fault_handler_jump_buf, 1);
+  fault_state->last_signal.store(sig, std::memory_order_relaxed);
+  fault_state->last_si_code.store(fault_code, std::memory_order_relaxed);
+  fault_state->last_si_addr.store(fault_address, std::memory_order_relaxed);
 }
 
 template<size_t size>
 void Executor::RegisterFaultHandler(std::array<int, size> signals_to_handle) {
+  struct sigaction action{};
+  action.sa_sigaction = Executor::FaultHandler;
+  // restart syscalls interrupted by a watchdog that fired after the execution finished
+  action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART;
+  // block all handled signals while the handler runs; a nested handler (e.g. the watchdog
+  // firing during a SIGSEGV) would otherwise rewrite the context of the outer one s.t. the
+  // outer one never returns and its signal stays blocked for the rest of the thread
+  sigemptyset(&action.sa_mask);
+  for (int sig : signals_to_handle) {
+    sigaddset(&action.sa_mask, sig);
+  }
   for (int sig : signals_to_handle) {
-    signal(sig, Executor::FaultHandler);
+    sigaction(sig, &action, nullptr);
   }
 }
 
 template<size_t size>
 void Executor::UnregisterFaultHandler(std::array<int, size> signals_to_handle) {
+  struct sigaction action{};
+  action.sa_handler = SIG_DFL;
+  sigemptyset(&action.sa_mask);
   for (int sig : signals_to_handle) {
-    signal(sig, SIG_DFL);
+    sigaction(sig, &action, nullptr);
+  }
+}
+
+void Executor::AcquireFaultHandler() {
+  std::lock_guard<std::mutex> lock(fault_handler_users_mutex);
+  if (fault_handler_users++ == 0) {
+    RegisterFaultHandler<kFaultSignals.size()>(kFaultSignals);
+  }
+}
+
+void Executor::ReleaseFaultHandler() {
+  std::lock_guard<std::mutex> lock(fault_handler_users_mutex);
+  if (--fault_handler_users == 0) {
+    UnregisterFaultHandler<kFaultSignals.size()>(kFaultSignals);
   }
 }
 
 __attribute__((no_sanitize("address")))
-int Executor::ExecuteCodePage(void* codepage, uint64_t* cycles_elapsed) {
+int Executor::ExecuteCodePage(void* codepage, FaultState* fault_state,
+                              uint64_t* cycles_elapsed) {
   /// NOTE: this function and Executor::FaultHandler must both be static functions
   ///       for the signal handling + jmp logic to work
 
+  // the fault handler of this thread runs on its own stack (installed on first use)
+  static thread_local AlternateSignalStack alternate_signal_stack;
+
+  if (watchdog_expired) {
+    // a previous execution of the batch used up the budget of the remaining ones
+    RecordFault(fault_state, kWatchdogSignal, SI_TIMER, 0);
+    *cycles_elapsed = -1;
+    return kTestrunHang;
+  }
 
 #if DEBUGMODE == 1
-  // list of signals that we catch and throw as errors
-  // (without DEBUGMODE the array is defined in the error case)
-  std::array<int, 4> signals_to_handle = {SIGSEGV, SIGILL, SIGFPE, SIGTRAP};
   // register fault handler (if not in debugmode we do this in constructor/destructor as
-  //    this has a huge impact on the runtime)
-  RegisterFaultHandler<signals_to_handle.size()>(signals_to_handle);
+  //    this has a huge impact on the runtime); it is reference counted as executors of other
+  //    threads might be executing code right now
+  AcquireFaultHandler();
 #endif
 
-  if (!setjmp(fault_handler_jump_buf)) {
-    // jump to codepage
-    uint64_t cycle_diff = ((uint64_t(*)()) codepage)();
-    // set return argument
-    *cycles_elapsed = cycle_diff;
+  code_page_faulted = false;
+  current_fault_state = fault_state;
+  // jump to codepage (returns here even if the code faults)
+  uint64_t cycle_diff = osiris_call_code_page(codepage, &code_page_saved_rsp);
+  current_fault_state = nullptr;
 
 #if DEBUGMODE == 1
-    // unregister signal handler (if not in debugmode we do this in constructor/destructor as
-    // this has a huge impact on the runtime)
-    UnregisterFaultHandler<signals_to_handle.size()>(signals_to_handle);
-#endif
-
-    return 0;
-  } else {
-    // if we reach this; the code has caused a fault
-
-    // unmask the signal again as we reached this point directly from the signal handler
-#if DEBUGMODE == 0
-    // only allocate the array in case of an error to safe execution time
-    // list of signals that we catch and throw as errors
-    std::array<int, 4> signals_to_handle = {SIGSEGV, SIGILL, SIGFPE, SIGTRAP};
-#endif
-    sigset_t signal_set;
-    sigemptyset(&signal_set);
-    for (int sig : signals_to_handle) {
-      sigaddset(&signal_set, sig);
-    }
-    sigprocmask(SIG_UNBLOCK, &signal_set, nullptr);
-
-#if DEBUGMODE == 1
-    // unregister signal handler (if not in debugmode we do this in constructor/destructor as
-    // this has a huge impact on the runtime)
-    UnregisterFaultHandler<signals_to_handle.size()>(signals_to_handle);
+  // unregister signal handler (if not in debugmode we do this in constructor/destructor as
+  // this has a huge impact on the runtime)
+  ReleaseFaultHandler();
 #endif
 
+  if (code_page_faulted) {
     // report that we crashed
     *cycles_elapsed = -1;
-    return 1;
+    return fault_state->last_signal.load(std::memory_order_relaxed) == kWatchdogSignal
+           ? kTestrunHang : 1;
   }
+  *cycles_elapsed = cycle_diff;
+  return 0;
 }
 
 }  // namespace osiris
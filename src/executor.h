@@ -16,14 +16,255 @@
 #ifndef OSIRIS_SRC_EXECUTOR_H_
 #define OSIRIS_SRC_EXECUTOR_H_
 
+#include <signal.h>
+#include <sys/types.h>
+
+#include <array>
+#include <atomic>
+#include <initializer_list>
+#include <random>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "code_generator.h"
+#include "statistics.h"
 
 namespace osiris {
 
 constexpr size_t kPagesize = 4096;
 
+///
+/// mark the start of the memory range where generated code stores the timing results of
+/// batched executions (kept apart from the memory range accessed by instructions).
+/// It is placed relative to ExecutorConfig::data_memory_begin; this is the default location.
+///
+constexpr uint64_t kResultMemoryBegin = 0x13380000;
+
+///
+/// maximum number of timed samples that a single execution of a code page can produce
+///
+constexpr int kMaxSamplesPerExecution = kPagesize / sizeof(uint64_t);
+
+///
+/// maximum number of back-to-back executions of a sequence in generated code (the generated
+/// code reserves enough stack space for stack-manipulating sequences executed this often)
+///
+constexpr int kMaxSequenceExecutions = 200;
+
+///
+/// maximum alignment of the timed region (see ExecutorConfig::code_alignment)
+///
+constexpr int kMaxCodeAlignment = 256;
+
+///
+/// returned by the testing functions of the Executor if an execution of a code page exceeded
+/// the watchdog timeout (other faults return 1)
+///
+constexpr int kTestrunHang = 2;
+
+///
+/// default age (in executions of code pages) after which a cached baseline is measured again
+/// (see Executor::TestTriggerSequenceWithCachedBaseline)
+///
+constexpr uint64_t kDefaultBaselineMaxAge = 2048;
+
+///
+/// order in which the samples of the two code pages of a test are taken
+///
+enum class SampleOrder {
+  BLOCKED,  // all samples of the first code page, then all of the second one
+  INTERLEAVED,  // alternate between both code pages (one execution of each at a time)
+  RANDOMIZED  // like INTERLEAVED but the order within every pair of executions is random
+};
+
+/// Returns the command line name of a sample order
+/// \param sample_order sample order
+/// \return name (e.g. "interleaved")
+std::string SampleOrderToString(SampleOrder sample_order);
+
+///
+/// instructions used to serialize the instruction stream around the timed region
+///
+enum class SerializationPrimitive {
+  AUTO,  // choose the cheapest primitive that still gives stable timings at startup
+  CPUID,
+  LFENCE,  // MFENCE followed by LFENCE
+  SERIALIZE
+};
+
+/// Returns the command line name of a serialization primitive
+/// \param serialization_primitive serialization primitive
+/// \return name (e.g. "lfence")
+std::string SerializationPrimitiveToString(SerializationPrimitive serialization_primitive);
+
+///
+/// counter used to time the measurement sequence
+///
+enum class TimerBackend {
+  AUTO,  // choose by CPU vendor and supported features at startup
+  RDTSC,  // time stamp counter (RDTSC/RDTSCP)
+  RDPRU,  // APERF via RDPRU (AMD)
+  RDPMC,  // core cycle counter programmed via perf_event_open and read with RDPMC
+  CLOCK_GETTIME  // clock_gettime(CLOCK_MONOTONIC) in nanoseconds (slow fallback)
+};
+
+/// Returns the command line name of a timer backend
+/// \param timer_backend timer backend
+/// \return name (e.g. "rdtsc")
+std::string TimerBackendToString(TimerBackend timer_backend);
+
+///
+/// observable of the measurement sequence. CYCLES is taken by the timer; all other metrics are
+/// hardware performance counters read with RDPMC around the measurement sequence.
+///
+enum class Metric {
+  CYCLES,
+  INSTRUCTIONS,
+  UOPS_RETIRED,
+  L1D_MISSES,  // L1D read misses
+  L2_MISSES,
+  LLC_MISSES,
+  BRANCH_MISSES,
+  MACHINE_CLEARS,  // Intel only
+  DSB_SWITCHES  // switches from the DSB to the legacy decode pipeline (Intel only)
+};
+
+/// Returns the command line name of a metric
+/// \param metric metric
+/// \return name (e.g. "uops-retired")
+std::string MetricToString(Metric metric);
+
+///
+/// maximum number of performance counters recorded per sample
+///
+constexpr int kMaxPerformanceCounters = 8;
+
+///
+/// runtime configuration of the Executor
+///
+struct ExecutorConfig {
+  /// number of timed samples that a single execution of a code page produces
+  /// (the sample body is repeated back to back as long as it fits into the code page)
+  int samples_per_execution = 1;
+
+  /// number of code pages that are used round-robin (recently generated code is reused from the
+  /// pool and pages are not overwritten right after they were executed)
+  int code_page_pool_size = 64;
+
+  /// start of the memory range accessed by instructions (must be page aligned and, together
+  /// with the result page, below 2^31 as it is encoded as a sign-extended 32-bit immediate)
+  uint64_t data_memory_begin = kMemoryBegin;
+
+  /// execute the code pages in a forked child process (fork server) instead of in-process.
+  /// Faults that corrupt process state or kill the process only cost a new child.
+  bool use_fork_server = false;
+
+  /// time budget of a single execution of a code page in milliseconds. The watchdog is armed
+  /// once per batch of executions with the budget of the whole batch; executions exceeding it
+  /// are aborted like faulting ones (0 disables the watchdog).
+  int watchdog_timeout_ms = 1000;
+
+  /// instructions used to serialize the instruction stream around the timed region
+  SerializationPrimitive serialization_primitive = SerializationPrimitive::AUTO;
+
+  /// counter used to time the measurement sequence (a target architecture given at compile
+  /// time only changes the default)
+#if defined(INTEL)
+  TimerBackend timer_backend = TimerBackend::RDTSC;
+#elif defined(AMD)
+  TimerBackend timer_backend = TimerBackend::RDPRU;
+#else
+  TimerBackend timer_backend = TimerBackend::AUTO;
+#endif
+
+  /// observable reported by the testing functions (and hence compared against thresholds)
+  Metric metric = Metric::CYCLES;
+
+  /// performance counters recorded per sample in addition to the metric
+  /// (see Executor::GetCounterDifferences)
+  std::vector<Metric> recorded_metrics;
+
+  /// hard cap on the samples per code page of TestTriggerSequence(WithCachedBaseline) in
+  /// adaptive sampling mode which replaces their fixed no_testruns (0 disables the mode).
+  /// Samples are taken in batches until a sequential test decides whether the trigger
+  /// sequence has an effect on the metric.
+  int sequential_max_testruns = 0;
+
+  /// probability of a wrong decision of the sequential test (both false effects and missed
+  /// effects)
+  double sequential_error_rate = 0.01;
+
+  /// order in which the samples of the two code pages of a test are taken; interleaving them
+  /// cancels out slow drift (e.g. of the frequency) in the paired differences
+  SampleOrder sample_order = SampleOrder::INTERLEAVED;
+
+  /// number of samples per code page taken between two decisions of the sequential test
+  int sequential_batch_size = 5;
+
+  /// discard the samples of executions that were contaminated by a context switch, a page
+  /// fault or a frequency transition and take them again
+  bool discard_contaminated_samples = true;
+
+  /// alignment (power of two, at most kMaxCodeAlignment) of the timed measurement sequence
+  /// inside the code page. Every sample is padded with NOPs s.t. the timed region of all
+  /// variants of a test shares the same fetch windows and uop cache lines (0 disables it).
+  int code_alignment = 64;
+
+  /// fill the trigger slot of the code page without trigger sequence with NOPs of the same
+  /// length instead of leaving it empty s.t. both variants have the same layout (the baseline
+  /// cache then only serves triggers of the same length)
+  bool match_baseline_layout = false;
+
+  /// back the code page pool with huge pages (MAP_HUGETLB) to keep the generated code in a
+  /// single iTLB entry (falls back to regular pages if no huge page is available)
+  bool use_huge_pages = false;
+};
+
+///
+/// faults caught while executing the code pages of one Executor. The counters are written by
+/// the fault handler of the thread executing the code and can be read from any thread.
+///
+struct FaultState {
+  std::atomic<uint64_t> sigsegv_no{0};
+  std::atomic<uint64_t> sigfpe_no{0};
+  std::atomic<uint64_t> sigill_no{0};
+  std::atomic<uint64_t> sigtrap_no{0};
+  std::atomic<uint64_t> sigbus_no{0};
+
+  /// executions aborted by the watchdog (see ExecutorConfig::watchdog_timeout_ms)
+  std::atomic<uint64_t> hang_no{0};
+
+  /// executions that killed or corrupted the fork server (see ExecutorConfig::use_fork_server)
+  std::atomic<uint64_t> fork_server_crash_no{0};
+
+  /// signal, si_code and si_addr of the last fault
+  std::atomic<int> last_signal{0};
+  std::atomic<int> last_si_code{0};
+  std::atomic<uintptr_t> last_si_addr{0};
+};
+
+///
+/// executions of code pages whose samples were contaminated by events outside of the tested
+/// code (see ExecutorConfig::discard_contaminated_samples). The executions of a batch are
+/// checked together; each of them counts once for every kind of event that occurred during the
+/// batch.
+///
+struct ContaminationStatistics {
+  uint64_t execution_no = 0;
+
+  /// executions during which the thread was descheduled (e.g. for an interrupt handler thread)
+  uint64_t context_switch_no = 0;
+
+  /// executions during which the kernel handled a page fault
+  uint64_t page_fault_no = 0;
+
+  /// executions whose ratio of core to reference cycles deviated from the usual one
+  uint64_t frequency_change_no = 0;
+
+  /// executions of contaminated batches whose samples were discarded and taken again
+  uint64_t discarded_no = 0;
+};
 
 ///
 /// Generates code for testing the effects of sequence triples.
@@ -31,7 +272,7 @@ constexpr size_t kPagesize = 4096;
 ///
 class Executor {
  public:
-  Executor();
+  explicit Executor(const ExecutorConfig& config = ExecutorConfig());
   ~Executor();
 
   /// run with and without reset sequence and return the timing difference in cycles_difference
@@ -41,10 +282,10 @@ class Executor {
   /// \param no_testruns number of test iterations
   /// \param reset_executions_amount amount of executions of the reset sequence
   /// \param cycles_difference outputs resulting difference in CPU cycles
-  /// \return 0 on success
-  int TestResetSequence(const byte_array& trigger_sequence,
-                        const byte_array& measurement_sequence,
-                        const byte_array& reset_sequence,
+  /// \return 0 on success, kTestrunHang if an execution hung, 1 on other faults
+  int TestResetSequence(ByteView trigger_sequence,
+                        ByteView measurement_sequence,
+                        ByteView reset_sequence,
                         int no_testruns,
                         int reset_executions_amount,
                         int64_t* cycles_difference);
@@ -57,76 +298,378 @@ class Executor {
   /// \param no_testruns number of test iterations
   /// \param reset_executions_amount amount of executions of the reset sequence
   /// \param cycles_difference outputs resulting difference in CPU cycles
-  /// \return 0 on success
-  int TestTriggerSequence(const byte_array& trigger_sequence,
-                          const byte_array& measurement_sequence,
-                          const byte_array& reset_sequence,
+  /// \return 0 on success, kTestrunHang if an execution hung, 1 on other faults
+  int TestTriggerSequence(ByteView trigger_sequence,
+                          ByteView measurement_sequence,
+                          ByteView reset_sequence,
                           bool execute_trigger_only_in_speculation,
                           int no_testruns,
                           int reset_executions_amount,
                           int64_t* cycles_difference);
 
+  /// same as TestTriggerSequence but reuses the timing of the run without trigger sequence.
+  /// That baseline only depends on the reset and measurement sequence, hence it is cached under
+  /// baseline_key and remeasured once it is older than the configured maximum age (counted in
+  /// executions of code pages) to bound the drift. Callers should order their tests s.t. tests
+  /// sharing a key are consecutive as the cache is useless otherwise.
+  /// Unlike the other tests, a cache hit is not paired (only the trigger sequence is sampled and
+  /// compared against the cached median), hence its results need a second confirmation round
+  /// \param trigger_sequence trigger sequence to test
+  /// \param measurement_sequence  measurement sequence to test
+  /// \param reset_sequence reset sequence to test
+  /// \param execute_trigger_only_in_speculation execute the trigger sequence only transiently
+  /// \param no_testruns number of test iterations
+  /// \param reset_executions_amount amount of executions of the reset sequence
+  /// \param baseline_key key identifying the (reset, measurement) pair (chosen by the caller)
+  /// \param cycles_difference outputs resulting difference in CPU cycles
+  /// \return 0 on success, kTestrunHang if an execution hung, 1 on other faults
+  int TestTriggerSequenceWithCachedBaseline(ByteView trigger_sequence,
+                                            ByteView measurement_sequence,
+                                            ByteView reset_sequence,
+                                            bool execute_trigger_only_in_speculation,
+                                            int no_testruns,
+                                            int reset_executions_amount,
+                                            uint64_t baseline_key,
+                                            int64_t* cycles_difference);
+
+  /// Sets the differences the sequential test of the adaptive sampling mode distinguishes
+  /// from "no effect" (see ExecutorConfig::sequential_max_testruns)
+  /// \param negative_threshold negative difference that counts as effect
+  /// \param positive_threshold positive difference that counts as effect
+  void SetEffectThresholds(int64_t negative_threshold, int64_t positive_threshold);
+
+  /// sets after how many executions of code pages a cached baseline gets measured again
+  /// \param max_age_executions maximum age of a cached baseline (0 disables caching)
+  void SetBaselineMaxAge(uint64_t max_age_executions);
+
+  ///
+  /// drops all cached baselines (e.g. when the measurement sequence changes)
+  ///
+  void ClearBaselineCache();
+
   /// returns the delta between trigger;reset;measure and reset;trigger;measure
   /// \param trigger_sequence trigger sequence to test
   /// \param measurement_sequence  measurement sequence to test
   /// \param reset_sequence reset sequence to test
   /// \param no_testruns number of test iterations
   /// \param cycles_difference outputs resulting difference in CPU cycles
-  /// \return 0 on success
-  int TestSequenceTriple(const byte_array& trigger_sequence,
-                         const byte_array& measurement_sequence,
-                         const byte_array& reset_sequence,
+  /// \return 0 on success, kTestrunHang if an execution hung, 1 on other faults
+  int TestSequenceTriple(ByteView trigger_sequence,
+                         ByteView measurement_sequence,
+                         ByteView reset_sequence,
                          int no_testruns,
                          int64_t* cycles_difference);
 
   /// prints current number of faults per signal
-  static void PrintFaultCount();
+  void PrintFaultCount() const;
+
+  /// Measures how fast the executor recovers from faults by repeatedly executing a code page
+  /// whose measurement sequence faults
+  /// \param faulting_sequence sequence that faults on every execution
+  /// \param no_executions number of executions
+  /// \return executions (and hence faults) per second; 0 if an execution did not fault
+  double BenchmarkFaultRecovery(ByteView faulting_sequence, int no_executions);
+
+  /// prints the rate of contaminated executions
+  void PrintContaminationRate() const;
+
+  ///
+  /// returns the contaminated executions of this executor
+  ///
+  const ContaminationStatistics& GetContaminationStatistics() const;
+
+  ///
+  /// returns the faults caught by this executor
+  ///
+  const FaultState& GetFaultState() const;
+
+  ///
+  /// returns the serialization primitive used by the generated code
+  ///
+  SerializationPrimitive GetSerializationPrimitive() const;
+
+  /// checks whether the CPU supports a serialization primitive
+  /// \param serialization_primitive primitive to check (must not be AUTO)
+  /// \return true if the primitive can be used
+  static bool IsSerializationPrimitiveSupported(SerializationPrimitive serialization_primitive);
+
+  ///
+  /// returns the timer backend used by the generated code
+  ///
+  TimerBackend GetTimerBackend() const;
+
+  ///
+  /// returns the timing of an empty measurement which is subtracted from every timing
+  ///
+  int64_t GetTimerOverhead() const;
+
+  /// checks whether a timer backend can be used
+  /// \param timer_backend backend to check (must not be AUTO)
+  /// \return true if the backend can be used
+  bool IsTimerBackendSupported(TimerBackend timer_backend);
+
+  ///
+  /// returns the observable reported by the testing functions
+  ///
+  Metric GetMetric() const;
+
+  ///
+  /// returns the metrics of the performance counters recorded per sample
+  ///
+  std::vector<Metric> GetCounterMetrics() const;
+
+  ///
+  /// returns the difference of every recorded performance counter (same order and sign as
+  /// cycles_difference) of the last call to TestTriggerSequence (not available in adaptive
+  /// sampling mode)
+  ///
+  const std::vector<int64_t>& GetCounterDifferences() const;
+
+  ///
+  /// returns the statistics of the samples with and without trigger sequence of the last call
+  /// to TestTriggerSequence(WithCachedBaseline) (the latter may stem from the baseline cache)
+  ///
+  const SampleStatistics& GetTriggerStatistics() const;
+  const SampleStatistics& GetNoTriggerStatistics() const;
+
+  ///
+  /// returns the statistics of the paired differences (without minus with trigger sequence) of
+  /// the last call to TestTriggerSequence(WithCachedBaseline) (no_samples is 0 if the samples
+  /// were not paired)
+  ///
+  const SampleStatistics& GetDifferenceStatistics() const;
 
  private:
+  ///
+  /// precomputed code of one test kind. Generating a test only copies the fixed fragments and
+  /// writes the variable parts (sequences and displacements) into the slots between them.
+  ///
+  struct CodePageTemplate {
+    std::vector<byte_array> fragments;
+  };
+
+  ///
+  /// variable part of a code page (see CodePageTemplate)
+  ///
+  struct CodePageSlot {
+    const char* bytes;
+    size_t length;
+    int repetitions;
+  };
+
   /// Create code which executes the trigger followed by the reset followed
   ///  by a timed measurement sequence
-  /// \param codepage_no index of the codepage to use
   /// \param trigger_sequence trigger sequence to test
   /// \param measurement_sequence  measurement sequence to test
   /// \param reset_sequence reset sequence to test
   /// \param reset_executions_amount amount of executions of the reset sequence
-  void CreateResetTestrunCode(int codepage_no, const byte_array& trigger_sequence,
-                              const byte_array& measurement_sequence,
-                              const byte_array& reset_sequence,
-                              int reset_executions_amount);
+  /// \return index of the codepage holding the code
+  int CreateResetTestrunCode(ByteView trigger_sequence,
+                             ByteView measurement_sequence,
+                             ByteView reset_sequence,
+                             int reset_executions_amount);
 
   /// Create code which executes the "first" sequence n-times followed by the "second" sequence
   ///  and followed by a timed measurement sequence
-  /// \param codepage_no index of the codepage to use
   /// \param trigger_sequence trigger sequence to test
   /// \param measurement_sequence  measurement sequence to test
   /// \param reset_sequence reset sequence to test
   /// \param first_sequence_executions_amount amount of executions of the first sequence
-  void CreateTestrunCode(int codepage_no, const byte_array& first_sequence,
-                         const byte_array& second_sequence,
-                         const byte_array& measurement_sequence,
-                         int first_sequence_executions_amount);
+  /// \return index of the codepage holding the code
+  int CreateTestrunCode(ByteView first_sequence,
+                        ByteView second_sequence,
+                        ByteView measurement_sequence,
+                        int first_sequence_executions_amount);
 
   /// Create code which executes the reset sequence n-times followed by a transient execution
   ///  of the trigger sequence and followed by a timed measurement sequence
-  /// \param codepage_no index of the codepage to use
   /// \param trigger_sequence trigger sequence to test
   /// \param measurement_sequence  measurement sequence to test
   /// \param reset_sequence reset sequence to test
   /// \param reset_executions_amount amount of executions of the reset sequence
-  void CreateSpeculativeTriggerTestrunCode(int codepage_no,
-                                           const byte_array& measurement_sequence,
-                                           const byte_array& trigger_sequence,
-                                           const byte_array& reset_sequence,
-                                           int reset_executions_amount);
+  /// \return index of the codepage holding the code
+  int CreateSpeculativeTriggerTestrunCode(ByteView measurement_sequence,
+                                          ByteView trigger_sequence,
+                                          ByteView reset_sequence,
+                                          int reset_executions_amount);
+
+  /// Creates the testrun code for the run with trigger sequence
+  /// \param trigger_sequence trigger sequence to test
+  /// \param measurement_sequence  measurement sequence to test
+  /// \param reset_sequence reset sequence to test
+  /// \param execute_trigger_only_in_speculation execute the trigger sequence only transiently
+  /// \param reset_executions_amount amount of executions of the reset sequence
+  /// \return index of the codepage holding the code
+  int CreateTriggerTestrunCode(ByteView trigger_sequence,
+                               ByteView measurement_sequence,
+                               ByteView reset_sequence,
+                               bool execute_trigger_only_in_speculation,
+                               int reset_executions_amount);
+
+  /// Creates the testrun code for the run without trigger sequence
+  /// \param trigger_sequence_length length of the trigger sequence it is compared against
+  ///     (see ExecutorConfig::match_baseline_layout)
+  /// \param measurement_sequence  measurement sequence to test
+  /// \param reset_sequence reset sequence to test
+  /// \param execute_trigger_only_in_speculation execute the trigger sequence only transiently
+  /// \param reset_executions_amount amount of executions of the reset sequence
+  /// \return index of the codepage holding the code
+  int CreateNoTriggerTestrunCode(size_t trigger_sequence_length,
+                                 ByteView measurement_sequence,
+                                 ByteView reset_sequence,
+                                 bool execute_trigger_only_in_speculation,
+                                 int reset_executions_amount);
+
+  /// Clears the per-counter result vectors and sizes them for the recorded performance counters
+  /// \param counter_results result vectors
+  /// \return counter_results or nullptr if no performance counter is recorded
+  std::vector<std::vector<int64_t>>* PrepareCounterResults(
+      std::vector<std::vector<int64_t>>* counter_results);
+
+  /// Takes no_samples samples of both code pages in the order given by config_.sample_order.
+  /// Unless the order is SampleOrder::BLOCKED, the samples with the same index are taken at
+  /// about the same time and form a pair.
+  /// \param codepage_a first codepage
+  /// \param codepage_b second codepage
+  /// \param no_samples number of samples to take per codepage
+  /// \param results_a vector the samples of the first codepage get appended to
+  /// \param results_b vector the samples of the second codepage get appended to
+  /// \param counter_results_a if given, the performance counter deltas of the first codepage
+  /// \param counter_results_b if given, the performance counter deltas of the second codepage
+  /// \return 0 if no failure (e.g. SIGSEGV, SIGILL, SIGFPE) occurred
+  int CollectPairedTestrunSamples(
+      int codepage_a, int codepage_b, int no_samples,
+      std::vector<int64_t>* results_a, std::vector<int64_t>* results_b,
+      std::vector<std::vector<int64_t>>* counter_results_a = nullptr,
+      std::vector<std::vector<int64_t>>* counter_results_b = nullptr);
+
+  /// Computes the difference of the metric between two code pages: the median of the paired
+  /// differences if the samples were interleaved, else the difference of both medians
+  /// \param results_a samples of the first codepage (get sorted)
+  /// \param results_b samples of the second codepage (get sorted)
+  /// \param statistics_a outputs the statistics of the first codepage
+  /// \param statistics_b outputs the statistics of the second codepage
+  /// \param statistics_difference outputs the statistics of the paired differences (empty if
+  ///     the samples were not interleaved)
+  /// \return difference of the first minus the second codepage
+  double ComputeDifferenceOfTestruns(std::vector<int64_t>* results_a,
+                                     std::vector<int64_t>* results_b,
+                                     SampleStatistics* statistics_a,
+                                     SampleStatistics* statistics_b,
+                                     SampleStatistics* statistics_difference);
+
+  /// Samples the code pages with and without trigger sequence into results_trigger and
+  /// results_notrigger in batches until the sequential test decides or
+  /// config_.sequential_max_testruns is reached
+  /// \param trigger_codepage codepage with trigger sequence
+  /// \param notrigger_codepage codepage without trigger sequence (-1 to compare against
+  ///     baseline_median instead)
+  /// \param baseline_median median without trigger sequence if notrigger_codepage is -1
+  /// \return 0 if no failure (e.g. SIGSEGV, SIGILL, SIGFPE) occurred
+  int CollectSamplesSequentially(int trigger_codepage, int notrigger_codepage,
+                                 double baseline_median);
+
+  /// Chooses how many samples the next generated code pages take per execution s.t. no_testruns
+  /// samples are split evenly over the least possible number of executions
+  /// \param no_testruns number of samples the next test needs per code page
+  void PlanSamplesPerExecution(int no_testruns);
+
+  /// Executes the codepage until no_samples timed samples were taken and appends them to results
+  /// \param codepage_no codepage to use
+  /// \param no_samples number of samples to take
+  /// \param results vector the samples (of the metric) get appended to
+  /// \param counter_results if given, the deltas of performance counter i get appended to
+  ///     entry i
+  /// \return 0 if no failure (e.g. SIGSEGV, SIGILL, SIGFPE) occurred
+  int CollectTestrunSamples(int codepage_no, int no_samples, std::vector<int64_t>* results,
+                            std::vector<std::vector<int64_t>>* counter_results = nullptr);
+
+  /// Takes no_samples samples of one code page or of two code pages (one execution of each at
+  /// a time) in batches of executions. The executions of a batch share one arming of the
+  /// watchdog and one contamination check; a contaminated batch is taken again.
+  /// \param codepage_a first codepage
+  /// \param codepage_b second codepage (-1 to only take samples of the first one)
+  /// \param no_samples number of samples to take per codepage
+  /// \param results_a vector the samples of the first codepage get appended to
+  /// \param results_b vector the samples of the second codepage get appended to
+  /// \param counter_results_a if given, the performance counter deltas of the first codepage
+  /// \param counter_results_b if given, the performance counter deltas of the second codepage
+  /// \return 0 if no failure (e.g. SIGSEGV, SIGILL, SIGFPE) occurred
+  int CollectSamplesInBatches(int codepage_a, int codepage_b, int no_samples,
+                              std::vector<int64_t>* results_a, std::vector<int64_t>* results_b,
+                              std::vector<std::vector<int64_t>>* counter_results_a,
+                              std::vector<std::vector<int64_t>>* counter_results_b);
+
+  /// Executes the codepage once and appends the first no_samples of its samples to results
+  /// \param codepage_no codepage to use
+  /// \param no_samples number of samples to keep (at most the samples per execution)
+  /// \param results vector the samples (of the metric) get appended to
+  /// \param counter_results if given, the deltas of performance counter i get appended to
+  ///     entry i
+  /// \param contamination the kContamination* flags reported for the execution get or-ed into it
+  /// \return 0 if no failure (e.g. SIGSEGV, SIGILL, SIGFPE) occurred
+  int ExecuteAndRecordSamples(int codepage_no, int no_samples, std::vector<int64_t>* results,
+                              std::vector<std::vector<int64_t>>* counter_results,
+                              int* contamination);
+
+  /// Removes the samples of a discarded batch
+  /// \param results samples (of the metric) of a codepage
+  /// \param counter_results if given, the performance counter deltas of the codepage
+  /// \param no_samples number of samples to remove from the end
+  static void DiscardLastSamples(std::vector<int64_t>* results,
+                                 std::vector<std::vector<int64_t>>* counter_results,
+                                 size_t no_samples);
+
+  /// Arms the watchdog with the budget of no_executions executions and takes the contamination
+  /// snapshot the batch is checked against (no-op for the fork server which guards and checks
+  /// every execution itself)
+  /// \param no_executions number of executions of the batch
+  void BeginExecutionBatch(int no_executions);
+
+  /// Disarms the watchdog armed by BeginExecutionBatch
+  /// \return bitmask of kContamination* flags of the events that occurred during the batch
+  int EndExecutionBatch();
 
   /// Tests the timing difference. Assumes that one of the Create...Code functions
   /// was previously called on the codepage
   /// \param codepage_no codepage to use
   /// \param cycles_elapsed  median cycle difference over all testruns between
   ///                        trigger sequence and no trigger sequence
+  /// \param contamination outputs the kContamination* flags of the execution if it ran in the
+  ///     fork server (always 0 otherwise as in-process executions are checked per batch)
   /// \return 0 if no failure (e.g. SIGSEGV, SIGILL, SIGFPE) occurred
-  int ExecuteTestrun(int codepage_no, uint64_t* cycles_elapsed);
+  int ExecuteTestrun(int codepage_no, uint64_t* cycles_elapsed, int* contamination);
+
+  ///
+  /// forks the child process that executes the code pages (see ExecutorConfig::use_fork_server)
+  ///
+  void StartForkServer();
+
+  ///
+  /// terminates the fork server and waits for it
+  ///
+  void StopForkServer();
+
+  /// Main loop of the fork server: executes the requested code pages until the connection
+  /// is closed. Exits without reply if an execution corrupted the process state.
+  /// \param socket_fd connection to the executor
+  [[noreturn]] void RunForkServer(int socket_fd);
+
+  /// Executes the codepage in the fork server. Restarts the fork server if it died.
+  /// \param codepage_no codepage to use
+  /// \param cycles_elapsed outputs the cycles returned by the codepage
+  /// \param contamination outputs the kContamination* flags of the execution
+  /// \return 0 if no failure (e.g. SIGSEGV, SIGILL, SIGFPE) occurred
+  int ExecuteTestrunInForkServer(int codepage_no, uint64_t* cycles_elapsed,
+                                 int* contamination);
+
+  /// Executes a code page of this process under its own watchdog and checks it for
+  /// contamination (the fork server handles a single execution per request)
+  /// \param codepage_no codepage to use
+  /// \param cycles_elapsed outputs the cycles returned by the codepage
+  /// \param contamination outputs the kContamination* flags of the execution
+  /// \return 0 if no failure (e.g. SIGSEGV, SIGILL, SIGFPE) occurred
+  int ExecuteTestrunInProcess(int codepage_no, uint64_t* cycles_elapsed, int* contamination);
 
   ///
   /// Clears the data page by overwriting its content with nullbytes
@@ -138,31 +681,248 @@ class Executor {
   /// \param codepage_no code page to use
   void InitializeCodePage(int codepage_no);
 
-  /// adds a serializing instruction to the page
-  /// \param codepage_no code page to use
-  void AddSerializeInstructionToCodePage(int codepage_no);
+  ///
+  /// precomputes the code of all test kinds (see CodePageTemplate)
+  ///
+  void BuildCodePageTemplates();
+
+  ///
+  /// forgets all code in the pool s.t. it is generated again (e.g. after the templates changed)
+  ///
+  void ClearCodePagePool();
+
+  ///
+  /// costs and stability of the timings of a serialization primitive
+  ///
+  struct SerializationBenchmark {
+    /// cycles spent per timed sample (including everything outside of the timed region)
+    double cycles_per_sample;
+    /// timing difference of the measurement caused by a long-latency sequence in front of
+    /// the serialization (should be 0 if the primitive serializes properly)
+    double reference_shift;
+    /// median absolute deviation of the timings
+    double spread;
+  };
+
+  ///
+  /// overhead and jitter of a timer backend
+  ///
+  struct TimerCalibration {
+    /// median timing of an empty measurement
+    double overhead;
+    /// median absolute deviation of the timing of an empty measurement
+    double jitter;
+    /// median delta of every performance counter for an empty measurement
+    std::vector<double> counter_overheads;
+  };
+
+  ///
+  /// hardware performance counter of this process that user space reads with RDPMC
+  ///
+  struct PerformanceCounter {
+    Metric metric;
+    /// perf event and its mapped perf_event_mmap_page (-1/nullptr if not opened)
+    int fd;
+    void* page;
+  };
+
+  /// Switches the generated code to the given timer backend
+  /// \param timer_backend backend to use (must not be AUTO)
+  void SetTimerBackend(TimerBackend timer_backend);
+
+  ///
+  /// calibrates the configured timer backend (or all candidates for AUTO) and switches to it
+  ///
+  void SelectTimerBackend();
+
+  /// Measures overhead and jitter of the given timer backend
+  /// \param timer_backend backend to calibrate (must not be AUTO)
+  /// \param calibration outputs the results
+  /// \return 0 if the backend works (i.e. no fault occurred)
+  int CalibrateTimerBackend(TimerBackend timer_backend, TimerCalibration* calibration);
+
+  /// Opens a performance counter of the calling thread that can be read with RDPMC
+  /// \param metric metric to count (CYCLES counts core cycles)
+  /// \param counter outputs the opened counter
+  /// \return true if the counter can be read from user space
+  static bool OpenPerformanceCounter(Metric metric, PerformanceCounter* counter);
+
+  /// Closes a performance counter opened by OpenPerformanceCounter (no-op if not opened)
+  /// \param counter counter to close
+  static void ClosePerformanceCounter(PerformanceCounter* counter);
+
+  ///
+  /// flags of the events that contaminated an execution (see GetContamination)
+  ///
+  static constexpr int kContaminationContextSwitch = 1 << 0;
+  static constexpr int kContaminationPageFault = 1 << 1;
+  static constexpr int kContaminationFrequencyChange = 1 << 2;
+
+  ///
+  /// counts of the events that contaminate an execution at one point in time
+  ///
+  struct ContaminationSnapshot {
+    uint64_t context_switches;
+    uint64_t page_faults;
+    /// core and reference cycles of the thread (0 if the counters are not available)
+    uint64_t cycles;
+    uint64_t reference_cycles;
+  };
+
+  ///
+  /// opens the core and reference cycle counters of the calling thread as a perf event group
+  /// (silently leaves them closed if the CPU or the kernel does not provide them)
+  ///
+  void OpenFrequencyCounters();
+
+  ///
+  /// closes the counters opened by OpenFrequencyCounters (no-op if not opened)
+  ///
+  void CloseFrequencyCounters();
+
+  /// Reads the counts of the contaminating events of the calling thread
+  /// \param snapshot outputs the counts
+  void TakeContaminationSnapshot(ContaminationSnapshot* snapshot) const;
+
+  /// Determines which contaminating events occurred between two snapshots
+  /// \param before snapshot taken before the execution
+  /// \param after snapshot taken after the execution
+  /// \return bitmask of kContamination* flags (0 if the execution is clean)
+  int GetContamination(const ContaminationSnapshot& before, const ContaminationSnapshot& after);
+
+  ///
+  /// opens the counters of all recorded metrics (aborts if the CPU does not support one)
+  ///
+  void OpenPerformanceCounters();
+
+  ///
+  /// closes all counters opened by the executor (including the one of the RDPMC timer)
+  ///
+  void ClosePerformanceCounters();
+
+  ///
+  /// updates the counter indexes the generated code relies on (called before every execution)
+  ///
+  void PrepareCounters();
+
+  ///
+  /// returns the number of uint64_t values each sample stores on the result page
+  ///
+  int GetSampleResultSize() const;
+
+  /// Switches the generated code to the given serialization primitive
+  /// \param serialization_primitive primitive to use (must not be AUTO)
+  void SetSerializationPrimitive(SerializationPrimitive serialization_primitive);
+
+  ///
+  /// benchmarks all supported serialization primitives and switches to the cheapest one that
+  /// gives timings as stable as CPUID
+  ///
+  void SelectSerializationPrimitive();
+
+  /// Benchmarks the given serialization primitive (see SerializationBenchmark)
+  /// \param serialization_primitive primitive to benchmark (must not be AUTO)
+  /// \param benchmark outputs the results
+  /// \return 0 if no failure occurred
+  int BenchmarkSerializationPrimitive(SerializationPrimitive serialization_primitive,
+                                      SerializationBenchmark* benchmark);
+
+  /// Writes the code of a test to a codepage of the pool by copying the precomputed fragments of
+  /// the template and writing the variable parts into the slots between them.
+  /// If the same code is still in the pool, its codepage is returned without writing it again.
+  /// \param code_template template of the test kind
+  /// \param slots variable parts; slot i is placed behind fragment i of the template
+  /// \return index of the codepage holding the code
+  int StampCodePage(const CodePageTemplate& code_template,
+                    std::initializer_list<CodePageSlot> slots);
+
+  /// Appends raw bytes to the identity of the code that is currently stamped
+  /// \param data bytes to append
+  /// \param size number of bytes
+  void AppendToCodeIdentity(const void* data, size_t size);
 
-  /// thrashes registers RDX, RAX, R10
+  ///
+  /// returns the next codepage of the pool that may be overwritten
+  ///
+  int AcquireCodePage();
+
+  /// Creates a slot that holds the given sequence
+  /// \param sequence sequence to place in the slot (must outlive the slot)
+  /// \param repetitions number of times the sequence is written
+  /// \return slot referencing the sequence
+  static CodePageSlot CreateCodePageSlot(ByteView sequence, int repetitions);
+
+  /// Repeats the sample body (which must end with AddSampleEnd) as often as planned and as it
+  /// fits into the code page and the result page
   /// \param codepage_no code page to use
-  void AddTimerStartToCodePage(int codepage_no);
+  /// \param sample_begin offset of the sample body inside the code page
+  /// \param sample_padding number of padding bytes behind AddSampleEnd at the end of the body
+  void RepeatSampleBody(int codepage_no, size_t sample_begin, size_t sample_padding);
+
+  /// adds the serializing instruction(s) of the current serialization primitive
+  /// (thrashes RAX, RBX, RCX and RDX in case of CPUID)
+  /// \param code code to append to
+  void AddSerializeInstruction(byte_array* code);
+
+  /// reads the start values of all performance counters and starts the timer
+  /// thrashes registers RDX, RAX, RCX, R10 (all caller-saved registers for CLOCK_GETTIME,
+  /// hence the memory registers are initialized again afterwards)
+  /// \param code code to append to
+  void AddTimerStart(byte_array* code);
 
-  /// thrashes registers RDX, RAX
+  /// thrashes registers RDX, RAX, RCX (all caller-saved registers except R10 and R11 for
+  /// CLOCK_GETTIME)
   /// resulting timing difference will be stored in R11 afterwards
-  /// \param codepage_no code page to use
-  void AddTimerEndToCodePage(int codepage_no);
+  /// \param code code to append to
+  void AddTimerEnd(byte_array* code);
+
+  /// reads the counter of the current timer backend into RAX
+  /// \param code code to append to
+  /// \param is_timer_end whether the read ends the timed region
+  void AddTimerRead(byte_array* code, bool is_timer_end);
+
+  /// initializes registers R8, RAX, RDI, RSI, RDX and XMM0 to point to the data memory
+  /// \param code code to append to
+  void AddInitializeMemoryRegisters(byte_array* code);
+
+  ///
+  /// returns CLOCK_MONOTONIC in nanoseconds (called by the generated code of CLOCK_GETTIME)
+  ///
+  static uint64_t ReadMonotonicClock();
 
   /// thrashes register RAX
-  /// \param codepage_no code page to use
-  void MakeTimerResultReturnValue(int codepage_no);
+  /// \param code code to append to
+  void MakeTimerResultReturnValue(byte_array* code);
 
-  /// Adds prolog to the codepage (i.e. saves callee-saved registers, creates large stackspace
-  /// and initializes registers
-  /// \param codepage_no code page to use
-  void AddProlog(int codepage_no);
+  /// Adds prolog (i.e. saves callee-saved registers, MXCSR and FPU control word)
+  /// \param code code to append to
+  void AddProlog(byte_array* code);
 
-  /// Adds Epilog to the codepage (i.e. restores registers and stack)
-  /// \param codepage_no code page to use
-  void AddEpilog(int codepage_no);
+  /// Starts a new timed sample (i.e. resets stack, MXCSR, FPU control word and DF and
+  /// initializes the memory registers). Everything until AddSampleEnd forms the sample body.
+  /// \param code code to append to
+  void AddSampleBegin(byte_array* code);
+
+  /// Stores the timing result and the performance counter deltas of the current sample on the
+  /// result page (thrashes RAX, RCX and RDX)
+  /// \param code code to append to
+  void AddSampleEnd(byte_array* code);
+
+  /// Adds Epilog (i.e. restores registers and stack)
+  /// \param code code to append to
+  void AddEpilog(byte_array* code);
+
+  /// adds instruction bytes to code
+  /// \param code code to append to
+  /// \param instruction_bytes bytes what should be written
+  /// \param instruction_length number of bytes that should be written
+  static void AddInstruction(byte_array* code, const char* instruction_bytes,
+                             size_t instruction_length);
+
+  /// adds instruction bytes to code
+  /// \param code code to append to
+  /// \param instruction_bytes bytes what should be written
+  static void AddInstruction(byte_array* code, const byte_array& instruction_bytes);
 
   /// adds instruction bytes to codepage
   /// \param codepage_no code page to use
@@ -181,15 +941,37 @@ class Executor {
   /// \return nop sled as byte array
   byte_array CreateSequenceOfNOPs(size_t length);
 
+  /// Appends as few (multi-byte) NOP instructions as possible that span the given length
+  /// \param code code to append to
+  /// \param length number of bytes
+  static void AddPadding(byte_array* code, size_t length);
+
   template<size_t size>
   static void RegisterFaultHandler(std::array<int, size> signals_to_handle);
 
   template<size_t size>
   static void UnregisterFaultHandler(std::array<int, size> signals_to_handle);
+
+  ///
+  /// registers the fault handler unless another executor of the process already did
+  ///
+  static void AcquireFaultHandler();
+
+  ///
+  /// unregisters the fault handler if no other executor of the process uses it anymore
+  ///
+  static void ReleaseFaultHandler();
   // NOTE: FaultHandler and ExecuteCodePage must both be static functions
-  //       for the signal handling + jmp logic to work
-  static void FaultHandler(int sig);
-  static int ExecuteCodePage(void* codepage, uint64_t* cycles_elapsed);
+  //       for the signal handling + recovery logic to work
+  static void FaultHandler(int sig, siginfo_t* siginfo, void* ucontext);
+  // counts a fault and remembers its details (async-signal-safe)
+  static void RecordFault(FaultState* fault_state, int sig, int fault_code,
+                          uintptr_t fault_address);
+  static int ExecuteCodePage(void* codepage, FaultState* fault_state, uint64_t* cycles_elapsed);
+
+  /// Arms the watchdog of the calling thread (creating it on first use)
+  /// \param timeout_ms time until it fires (0 disarms it)
+  static void ArmWatchdog(int64_t timeout_ms);
 
   ///
   /// acts as read/write memory for instructions
@@ -197,14 +979,166 @@ class Executor {
   std::array<void*, 2> execution_data_pages_;
 
   ///
-  /// rwx page where we generate and execute code
+  /// pool of rwx pages where we generate and execute code and the size of its mapping
+  /// (rounded up to whole huge pages if the pool is backed by huge pages)
   ///
-  std::array<char*, 2> execution_code_pages_;
+  std::vector<char*> execution_code_pages_;
+  size_t code_pool_mapping_size_;
 
   ///
+  /// scratch buffers for the alignment padding of a sample and the trigger slot of the
+  /// variant without trigger sequence (see ExecutorConfig)
+  ///
+  byte_array sample_padding_;
+  byte_array trigger_padding_;
+
   ///
+  /// end of the generated code on each code page (everything behind it is NOP)
   ///
-  std::array<size_t, 2> code_pages_last_written_index_;
+  std::vector<size_t> code_pages_last_written_index_;
+
+  ///
+  /// number of timed samples one execution of the code page produces
+  ///
+  std::vector<int> code_pages_samples_per_execution_;
+
+  ///
+  /// key of the code on each code page and index from keys to code pages (see StampCodePage)
+  ///
+  std::vector<uint64_t> code_pages_key_;
+  std::unordered_map<uint64_t, int> code_page_pool_index_;
+
+  ///
+  /// everything that identifies the code on each code page (compared on a hit of the key) and
+  /// the identity of the code that is currently stamped (preallocated for performance)
+  ///
+  std::vector<byte_array> code_pages_identity_;
+  byte_array code_identity_;
+
+  ///
+  /// value of code_page_use_counter_ when the code page was requested the last time
+  ///
+  std::vector<uint64_t> code_pages_last_used_;
+  uint64_t code_page_use_counter_;
+
+  ///
+  /// next code page to overwrite (round-robin)
+  ///
+  int next_code_page_;
+
+  ///
+  /// number of samples per execution that the next generated code pages should take
+  /// (see PlanSamplesPerExecution)
+  ///
+  int planned_samples_per_execution_;
+
+  ///
+  /// precomputed code shared by all test kinds
+  ///
+  byte_array prolog_code_;
+  byte_array epilog_code_;
+
+  ///
+  /// precomputed code per test kind
+  ///
+  CodePageTemplate reset_testrun_template_;
+  CodePageTemplate testrun_template_;
+  CodePageTemplate speculative_trigger_testrun_template_;
+
+  ///
+  /// memory where generated code stores the timing result of each sample
+  ///
+  volatile uint64_t* execution_result_page_;
+  uint64_t result_memory_begin_;
+
+  ///
+  /// page behind the result page holding values read by the generated code
+  /// (see kControlSlot... in executor.cc)
+  ///
+  volatile uint64_t* execution_control_page_;
+  uint64_t control_memory_begin_;
+
+  ExecutorConfig config_;
+
+  ///
+  /// serialization primitive of the generated code (never AUTO)
+  ///
+  SerializationPrimitive serialization_primitive_;
+
+  ///
+  /// timer backend of the generated code (never AUTO) and its calibrated overhead
+  ///
+  TimerBackend timer_backend_;
+  int64_t timer_overhead_;
+
+  ///
+  /// core cycle counter read by the RDPMC backend
+  ///
+  PerformanceCounter cycle_counter_;
+
+  ///
+  /// perf event group of the core (leader) and reference cycles of the thread executing the
+  /// code (-1 if not opened) and the usual ratio of both (0 until the first clean execution)
+  ///
+  int frequency_counters_fd_;
+  int reference_cycles_fd_;
+  double frequency_ratio_;
+
+  ///
+  /// contaminated executions of this executor
+  ///
+  ContaminationStatistics contamination_statistics_;
+
+  ///
+  /// contamination snapshot taken at the begin of the current batch of executions
+  ///
+  ContaminationSnapshot batch_begin_snapshot_;
+
+  ///
+  /// performance counters recorded per sample and their calibrated overheads
+  ///
+  std::vector<PerformanceCounter> performance_counters_;
+  std::vector<int64_t> counter_overheads_;
+
+  ///
+  /// value of the result page of each sample returned as metric (0 is the timing result;
+  /// i > 0 is performance counter i - 1)
+  ///
+  int metric_result_index_;
+
+  ///
+  /// distances of the displacements of all result stores to the end of the sample body
+  /// (see AddSampleEnd and RepeatSampleBody)
+  ///
+  std::vector<size_t> sample_result_displacements_;
+
+  ///
+  /// performance counter deltas of the current test and differences of the last one
+  ///
+  std::vector<std::vector<int64_t>> counter_results_trigger_;
+  std::vector<std::vector<int64_t>> counter_results_notrigger_;
+  std::vector<int64_t> counter_differences_;
+
+  ///
+  /// randomizes the order of the code pages for SampleOrder::RANDOMIZED
+  ///
+  std::mt19937 sample_order_generator_;
+
+  ///
+  /// paired differences of the current test (see ComputeDifferenceOfTestruns)
+  ///
+  std::vector<int64_t> paired_differences_;
+
+  ///
+  /// faults caught while executing the code pages of this executor
+  ///
+  FaultState fault_state_;
+
+  ///
+  /// process and connection of the fork server (-1 if not running)
+  ///
+  pid_t fork_server_pid_;
+  int fork_server_socket_fd_;
 
   ///
   /// results for the trigger testruns (preallocated for performance)
@@ -217,6 +1151,39 @@ class Executor {
   /// used in TestTriggerSequence
   ///
   std::vector<int64_t> results_notrigger;
+
+  ///
+  /// statistics of the last call to TestTriggerSequence(WithCachedBaseline)
+  ///
+  SampleStatistics statistics_trigger_;
+  SampleStatistics statistics_notrigger_;
+  SampleStatistics statistics_difference_;
+
+  ///
+  /// cached timing of a run without trigger sequence
+  /// used in TestTriggerSequenceWithCachedBaseline
+  ///
+  struct BaselineCacheEntry {
+    SampleStatistics statistics;
+    uint64_t measured_at_execution;
+    bool execute_trigger_only_in_speculation;
+    int no_testruns;
+    int reset_executions_amount;
+    size_t trigger_padding_length;
+  };
+  std::unordered_map<uint64_t, BaselineCacheEntry> baseline_cache_;
+  uint64_t baseline_max_age_;
+
+  ///
+  /// executions of code pages so far (the age of a cached baseline is counted in executions)
+  ///
+  uint64_t execution_no_;
+
+  ///
+  /// differences that count as effect for the sequential test (see SetEffectThresholds)
+  ///
+  int64_t effect_negative_threshold_;
+  int64_t effect_positive_threshold_;
 };
 
 }  // namespace osiris
@@ -0,0 +1,89 @@
+// Copyright 2021 Daniel Weber, Ahmad Ibrahim, Hamed Nemati, Michael Schwarz, Christian Rossow
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+
+
+#include "hang_blacklist.h"
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "logger.h"
+#include "utils.h"
+
+namespace osiris {
+
+const char kHangBlacklistHeaderline[] = "measurement-uid;trigger-uid;reset-uid";
+
+void HangBlacklist::Open(const std::string& filename) {
+  filename_ = filename;
+  hanging_triples_.clear();
+  std::ifstream blacklist_file(filename);
+  if (!blacklist_file.is_open()) {
+    std::ofstream new_blacklist_file(filename);
+    if (!new_blacklist_file.is_open()) {
+      LOG_ERROR("Couldn't open " + filename + " for writing. Aborting!");
+      std::exit(1);
+    }
+    new_blacklist_file << kHangBlacklistHeaderline << std::endl;
+    return;
+  }
+  std::string line;
+  std::getline(blacklist_file, line);
+  if (line != kHangBlacklistHeaderline) {
+    LOG_ERROR("Mismatch in the header line of the hang blacklist " + filename + ". Aborting!");
+    std::exit(1);
+  }
+  while (std::getline(blacklist_file, line)) {
+    std::vector<std::string> line_splitted = SplitString(line, ';');
+    uint64_t uids[3];
+    bool is_valid = line_splitted.size() == 3;
+    for (size_t i = 0; is_valid && i < 3; i++) {
+      is_valid = ParseUnsignedNumber(line_splitted[i], 16, &uids[i]);
+    }
+    if (!is_valid) {
+      // a worker might have been killed while appending its last line
+      LOG_WARNING("Ignoring malformed line in the hang blacklist " + filename);
+      continue;
+    }
+    hanging_triples_.emplace(uids[0], uids[1], uids[2]);
+  }
+}
+
+void HangBlacklist::Add(uint64_t measurement_uid, uint64_t trigger_uid, uint64_t reset_uid) {
+  if (!hanging_triples_.emplace(measurement_uid, trigger_uid, reset_uid).second ||
+      filename_.empty()) {
+    return;
+  }
+  // the line is written at once s.t. the appends of concurrent workers do not interleave
+  std::stringstream line;
+  line << std::hex << measurement_uid << ";" << trigger_uid << ";" << reset_uid << std::endl;
+  std::ofstream blacklist_file(filename_, std::ios::app);
+  if (!blacklist_file.is_open()) {
+    LOG_WARNING("Couldn't append to the hang blacklist " + filename_);
+    return;
+  }
+  blacklist_file << line.str() << std::flush;
+}
+
+bool HangBlacklist::IsEmpty() const {
+  return hanging_triples_.empty();
+}
+
+bool HangBlacklist::Contains(uint64_t measurement_uid, uint64_t trigger_uid,
+                             uint64_t reset_uid) const {
+  return hanging_triples_.count({measurement_uid, trigger_uid, reset_uid}) != 0;
+}
+
+}  // namespace osiris
@@ -0,0 +1,61 @@
+// Copyright 2021 Daniel Weber, Ahmad Ibrahim, Hamed Nemati, Michael Schwarz, Christian Rossow
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+
+
+#ifndef OSIRIS_SRC_HANG_BLACKLIST_H_
+#define OSIRIS_SRC_HANG_BLACKLIST_H_
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <tuple>
+
+namespace osiris {
+
+///
+/// Persistent set of (measurement, trigger, reset) triples whose execution exceeded the watchdog
+/// timeout. The triples are identified by UIDs s.t. the file stays valid for other instruction
+/// files. Every process appends the hangs it observes to the file, hence later stages, the
+/// workers of a parallel search and later runs skip them.
+///
+class HangBlacklist {
+ public:
+  /// Loads the triples recorded in the file and appends all triples added later to it
+  /// (the file is created if it does not exist yet)
+  /// \param filename blacklist file
+  void Open(const std::string& filename);
+
+  /// Adds a triple and records it in the file given to Open (if any)
+  /// \param measurement_uid UID of the measurement sequence
+  /// \param trigger_uid UID of the trigger sequence
+  /// \param reset_uid UID of the reset sequence
+  void Add(uint64_t measurement_uid, uint64_t trigger_uid, uint64_t reset_uid);
+
+  /// \return true if no triple is blacklisted
+  bool IsEmpty() const;
+
+  /// \param measurement_uid UID of the measurement sequence
+  /// \param trigger_uid UID of the trigger sequence
+  /// \param reset_uid UID of the reset sequence
+  /// \return true if the triple must not be executed
+  bool Contains(uint64_t measurement_uid, uint64_t trigger_uid, uint64_t reset_uid) const;
+
+ private:
+  std::string filename_;
+  std::set<std::tuple<uint64_t, uint64_t, uint64_t>> hanging_triples_;
+};
+
+}  // namespace osiris
+
+#endif //OSIRIS_SRC_HANG_BLACKLIST_H_
@@ -0,0 +1,111 @@
+// Copyright 2021 Daniel Weber, Ahmad Ibrahim, Hamed Nemati, Michael Schwarz, Christian Rossow
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+
+
+#include "noise_profile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#include "logger.h"
+#include "utils.h"
+
+namespace osiris {
+
+const char kNoiseProfileHeaderline[] = "measurement-uid;baseline;noise";
+
+// the metric is an integer hence it can not be more precise than 1
+constexpr double kMinimumNoise = 1;
+
+// same ratio as between the default reset tolerance (20) and threshold (50)
+constexpr double kResetToleranceFraction = 0.4;
+
+NoiseProfile::NoiseProfile() : noise_multiple_(5), relative_effect_size_(0.1) {}
+
+bool NoiseProfile::Load(const std::string& filename) {
+  std::ifstream profile_file(filename);
+  if (!profile_file.is_open()) {
+    return false;
+  }
+  std::string line;
+  std::getline(profile_file, line);
+  if (line != kNoiseProfileHeaderline) {
+    LOG_ERROR("Mismatch in the header line of the noise profile " + filename + ". Aborting!");
+    std::exit(1);
+  }
+  entries_.clear();
+  while (std::getline(profile_file, line)) {
+    std::vector<std::string> line_splitted = SplitString(line, ';');
+    uint64_t measurement_uid;
+    double baseline;
+    double noise;
+    if (line_splitted.size() != 3 ||
+        !ParseUnsignedNumber(line_splitted[0], 16, &measurement_uid) ||
+        !ParseFiniteNumber(line_splitted[1], &baseline) ||
+        !ParseFiniteNumber(line_splitted[2], &noise) || noise < 0) {
+      LOG_ERROR("Malformed line in the noise profile " + filename + ". Aborting!");
+      std::exit(1);
+    }
+    entries_[measurement_uid] = NoiseProfileEntry{baseline, noise};
+  }
+  return true;
+}
+
+void NoiseProfile::Save(const std::string& filename) const {
+  std::ofstream profile_file(filename);
+  if (!profile_file.is_open()) {
+    LOG_ERROR("Couldn't open " + filename + " for writing. Aborting!");
+    std::exit(1);
+  }
+  profile_file << kNoiseProfileHeaderline << std::endl;
+  for (const auto& [measurement_uid, entry] : entries_) {
+    profile_file << std::hex << measurement_uid << std::dec << ";" << entry.baseline << ";"
+                 << entry.noise << std::endl;
+  }
+}
+
+void NoiseProfile::SetThresholdParameters(double noise_multiple, double relative_effect_size) {
+  noise_multiple_ = noise_multiple;
+  relative_effect_size_ = relative_effect_size;
+}
+
+void NoiseProfile::SetEntry(uint64_t measurement_uid, const NoiseProfileEntry& entry) {
+  entries_[measurement_uid] = entry;
+}
+
+bool NoiseProfile::IsEmpty() const {
+  return entries_.empty();
+}
+
+int64_t NoiseProfile::GetThreshold(uint64_t measurement_uid, int64_t default_threshold) const {
+  auto entry = entries_.find(measurement_uid);
+  if (entry == entries_.end()) {
+    return default_threshold;
+  }
+  double threshold = std::max(noise_multiple_ * std::max(entry->second.noise, kMinimumNoise),
+                              relative_effect_size_ * std::abs(entry->second.baseline));
+  return static_cast<int64_t>(std::ceil(threshold));
+}
+
+int64_t NoiseProfile::GetResetTolerance(uint64_t measurement_uid,
+                                        int64_t default_tolerance) const {
+  if (entries_.find(measurement_uid) == entries_.end()) {
+    return default_tolerance;
+  }
+  return static_cast<int64_t>(std::ceil(kResetToleranceFraction *
+      static_cast<double>(GetThreshold(measurement_uid, 0))));
+}
+
+}  // namespace osiris
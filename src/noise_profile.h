@@ -0,0 +1,88 @@
+// Copyright 2021 Daniel Weber, Ahmad Ibrahim, Hamed Nemati, Michael Schwarz, Christian Rossow
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+
+
+#ifndef OSIRIS_SRC_NOISE_PROFILE_H_
+#define OSIRIS_SRC_NOISE_PROFILE_H_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace osiris {
+
+///
+/// measured behavior of a measurement sequence without any trigger sequence
+///
+struct NoiseProfileEntry {
+  /// median of the metric of the measurement sequence
+  double baseline;
+
+  /// spread (normal-consistent MAD) of the test result if there is no effect at all
+  double noise;
+};
+
+///
+/// Persistent per-measurement-sequence noise profile from which the detection thresholds are
+/// derived. The threshold of a profiled sequence is the larger one of noise_multiple times its
+/// noise and relative_effect_size times its baseline.
+///
+class NoiseProfile {
+ public:
+  NoiseProfile();
+
+  /// Loads a profile written by Save
+  /// \param filename profile file
+  /// \return false if the file does not exist
+  bool Load(const std::string& filename);
+
+  /// Writes the profile to a file
+  /// \param filename profile file
+  void Save(const std::string& filename) const;
+
+  /// Sets how thresholds are derived from the profile
+  /// \param noise_multiple multiple of the noise that counts as effect
+  /// \param relative_effect_size fraction of the baseline that counts as effect
+  void SetThresholdParameters(double noise_multiple, double relative_effect_size);
+
+  /// Adds or replaces the entry of a measurement sequence
+  /// \param measurement_uid UID of the measurement sequence
+  /// \param entry entry
+  void SetEntry(uint64_t measurement_uid, const NoiseProfileEntry& entry);
+
+  /// \return true if no measurement sequence is profiled
+  bool IsEmpty() const;
+
+  /// Returns the detection threshold of a measurement sequence
+  /// \param measurement_uid UID of the measurement sequence
+  /// \param default_threshold threshold used if the sequence is not profiled
+  /// \return absolute difference of the metric that counts as effect
+  int64_t GetThreshold(uint64_t measurement_uid, int64_t default_threshold) const;
+
+  /// Returns the tolerance of the reset test of a measurement sequence (a reset sequence works
+  /// if it removes the effect up to this difference)
+  /// \param measurement_uid UID of the measurement sequence
+  /// \param default_tolerance tolerance used if the sequence is not profiled
+  /// \return tolerance
+  int64_t GetResetTolerance(uint64_t measurement_uid, int64_t default_tolerance) const;
+
+ private:
+  std::unordered_map<uint64_t, NoiseProfileEntry> entries_;
+  double noise_multiple_;
+  double relative_effect_size_;
+};
+
+}  // namespace osiris
+
+#endif //OSIRIS_SRC_NOISE_PROFILE_H_
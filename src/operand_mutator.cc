@@ -0,0 +1,331 @@
+// Copyright 2021 Daniel Weber, Ahmad Ibrahim, Hamed Nemati, Michael Schwarz, Christian Rossow
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+
+
+#include "operand_mutator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <utility>
+
+#include "code_generator.h"
+#include "logger.h"
+
+namespace osiris {
+
+// immediates besides the one of the instruction list: zero, one, all ones, only the sign bit,
+// the largest positive value and the size of a cache line
+constexpr size_t kNoImmediateCandidates = 6;
+
+// displacements of memory operands based on a memory register. Even the widest accesses
+// (64 bytes) stay inside the data memory with them.
+constexpr int64_t kDisplacementCandidates[] = {0, 0x8, 0x40, 0x1000};
+constexpr int64_t kMaxDisplacement = 0x1000;
+static_assert(kMaxDisplacement + 64 <= static_cast<int64_t>(kMemoryEnd - kMemoryBegin),
+              "displaced memory accesses must stay inside the data memory");
+
+// the reg and the rm field of the ModRM byte
+constexpr size_t kNoRegisterFields = 2;
+
+constexpr uint8_t kAddressSizePrefix = 0x67;
+constexpr uint8_t kREXPrefixMask = 0xf0;
+constexpr uint8_t kREXPrefix = 0x40;
+constexpr uint8_t kREXExtendsReg = 0x4;
+constexpr uint8_t kREXExtendsRm = 0x1;
+
+// legacy prefixes which may precede the REX prefix
+constexpr uint8_t kLegacyPrefixes[] = {0xf0, 0xf2, 0xf3, 0x2e, 0x36, 0x3e, 0x26, 0x64, 0x65,
+                                       0x66, 0x67};
+
+// registers pointing to the data memory (see Executor::AddInitializeMemoryRegisters) with
+// 64-bit and with 32-bit addressing (the data memory is below 2^31)
+constexpr x86_reg kMemoryRegisters[] = {X86_REG_R8, X86_REG_RAX, X86_REG_RDI, X86_REG_RSI,
+                                        X86_REG_RDX, X86_REG_R8D, X86_REG_EAX, X86_REG_EDI,
+                                        X86_REG_ESI, X86_REG_EDX};
+
+// registers the code of the executor relies on while the tested sequences run: the stack
+// pointer, the stack pointer saved in RBP and the start of the timer in R10
+constexpr x86_reg kReservedRegisters[] = {X86_REG_RSP, X86_REG_ESP, X86_REG_SP, X86_REG_SPL,
+                                          X86_REG_RBP, X86_REG_EBP, X86_REG_BP, X86_REG_BPL,
+                                          X86_REG_R10, X86_REG_R10D, X86_REG_R10W, X86_REG_R10B,
+                                          X86_REG_RIP, X86_REG_EIP, X86_REG_IP};
+
+static bool IsMemoryRegister(x86_reg reg) {
+  return std::find(std::begin(kMemoryRegisters), std::end(kMemoryRegisters), reg) !=
+      std::end(kMemoryRegisters);
+}
+
+static bool IsReservedRegister(x86_reg reg) {
+  return std::find(std::begin(kReservedRegisters), std::end(kReservedRegisters), reg) !=
+      std::end(kReservedRegisters);
+}
+
+static bool IsLegacyPrefix(uint8_t prefix) {
+  return std::find(std::begin(kLegacyPrefixes), std::end(kLegacyPrefixes), prefix) !=
+      std::end(kLegacyPrefixes);
+}
+
+// The candidates are numbered block by block: immediates, displacements, address size and
+// registers. Blocks the instruction does not support are empty.
+
+static size_t GetNumberOfImmediateCandidates(const OperandLayout& layout) {
+  return layout.immediate_size > 0 ? kNoImmediateCandidates : 0;
+}
+
+static size_t GetNumberOfDisplacementCandidates(const OperandLayout& layout) {
+  return layout.has_relocatable_memory_operand ? std::size(kDisplacementCandidates) : 0;
+}
+
+static size_t GetNumberOfAddressSizeCandidates(const OperandLayout& layout) {
+  return layout.has_relocatable_memory_operand && !layout.has_address_size_prefix ? 1 : 0;
+}
+
+/// \return number of registers a ModRM field can encode (the upper 8 need the REX prefix)
+static size_t GetNumberOfRegisterNumbers(const OperandLayout& layout) {
+  return layout.has_rex_prefix ? 16 : 8;
+}
+
+static size_t GetNumberOfRegisterCandidates(const OperandLayout& layout) {
+  return layout.modrm_offset > 0 ? kNoRegisterFields * GetNumberOfRegisterNumbers(layout) : 0;
+}
+
+size_t OperandLayout::GetNumberOfCandidates() const {
+  return GetNumberOfImmediateCandidates(*this) + GetNumberOfDisplacementCandidates(*this) +
+      GetNumberOfAddressSizeCandidates(*this) + GetNumberOfRegisterCandidates(*this);
+}
+
+/// Replaces the immediate of the instruction
+/// \param layout layout of the base instruction
+/// \param candidate number of the immediate in [0, kNoImmediateCandidates)
+/// \param bytes encoding of the base instruction that gets changed
+/// \return false if the immediate equals the one of the base instruction
+static bool PatchImmediate(const OperandLayout& layout, size_t candidate, byte_array* bytes) {
+  uint64_t sign_bit = uint64_t{1} << (8 * layout.immediate_size - 1);
+  const uint64_t immediates[kNoImmediateCandidates] = {0, 1, ~uint64_t{0}, sign_bit,
+                                                       sign_bit - 1, 0x40};
+  byte_array immediate = NumberToBytesLE(immediates[candidate], layout.immediate_size);
+  auto field = bytes->begin() + layout.immediate_offset;
+  if (std::equal(immediate.begin(), immediate.end(), field)) {
+    return false;
+  }
+  std::copy(immediate.begin(), immediate.end(), field);
+  return true;
+}
+
+/// Encodes the displacement of the memory operand with the smallest field that holds it (the
+/// field is added if the base instruction has none)
+/// \param layout layout of the base instruction
+/// \param displacement new displacement
+/// \param bytes encoding of the base instruction that gets replaced
+/// \return false if the encoding equals the base instruction
+static bool RelocateDisplacement(const OperandLayout& layout, int64_t displacement,
+                                 byte_array* bytes) {
+  auto modrm = std::to_integer<uint8_t>((*bytes)[layout.modrm_offset]);
+  bool is_short_displacement = displacement >= INT8_MIN && displacement <= INT8_MAX;
+  size_t displacement_offset = layout.displacement_offset;
+  if (layout.displacement_size == 0) {
+    // behind the ModRM byte and the SIB byte (if rm is 100)
+    displacement_offset = layout.modrm_offset + ((modrm & 0x7) == 0x4 ? 2 : 1);
+  }
+
+  // mod 01 and 10 select an 8-bit and a 32-bit displacement
+  byte_array variant(bytes->begin(), bytes->begin() + displacement_offset);
+  variant[layout.modrm_offset] =
+      std::byte((modrm & 0x3f) | (is_short_displacement ? 0x40 : 0x80));
+  byte_array encoded_displacement =
+      NumberToBytesLE(static_cast<uint64_t>(displacement), is_short_displacement ? 1 : 4);
+  variant.insert(variant.end(), encoded_displacement.begin(), encoded_displacement.end());
+  variant.insert(variant.end(),
+                 bytes->begin() + displacement_offset + layout.displacement_size, bytes->end());
+  if (variant == *bytes) {
+    return false;
+  }
+  *bytes = std::move(variant);
+  return true;
+}
+
+/// Substitutes the register of a ModRM field (the memory base register if rm addresses memory)
+/// \param layout layout of the base instruction
+/// \param field 0 for reg, 1 for rm
+/// \param register_number number of the new register
+/// \param bytes encoding of the base instruction that gets changed
+/// \return false if the encoding equals the base instruction
+static bool SubstituteRegister(const OperandLayout& layout, size_t field,
+                               size_t register_number, byte_array* bytes) {
+  unsigned int shift = field == 0 ? 3 : 0;
+  uint8_t rex_extension = field == 0 ? kREXExtendsReg : kREXExtendsRm;
+  auto modrm = std::to_integer<uint8_t>((*bytes)[layout.modrm_offset]);
+  modrm = (modrm & ~(0x7 << shift)) | ((register_number & 0x7) << shift);
+  (*bytes)[layout.modrm_offset] = std::byte{modrm};
+  if (layout.has_rex_prefix) {
+    auto rex = std::to_integer<uint8_t>((*bytes)[layout.rex_offset]);
+    rex = register_number & 0x8 ? rex | rex_extension : rex & ~rex_extension;
+    (*bytes)[layout.rex_offset] = std::byte{rex};
+  }
+  return *bytes != layout.base_bytes;
+}
+
+OperandMutator::OperandMutator() {
+  if (cs_open(CS_ARCH_X86, CS_MODE_64, &capstone_handle_) != CS_ERR_OK) {
+    LOG_ERROR("Couldn't initialize Capstone! Aborting!");
+    std::exit(1);
+  }
+  // the offsets of the fields and the operands are part of the details
+  cs_option(capstone_handle_, CS_OPT_DETAIL, CS_OPT_ON);
+  decoded_instruction_ = cs_malloc(capstone_handle_);
+}
+
+OperandMutator::~OperandMutator() {
+  cs_free(decoded_instruction_, 1);
+  cs_close(&capstone_handle_);
+}
+
+bool OperandMutator::DecodeInstruction(ByteView instruction_bytes) {
+  const auto* code = reinterpret_cast<const uint8_t*>(instruction_bytes.data());
+  size_t remaining_size = instruction_bytes.size();
+  uint64_t address = 0;
+  return cs_disasm_iter(capstone_handle_, &code, &remaining_size, &address,
+                        decoded_instruction_) && remaining_size == 0;
+}
+
+bool OperandMutator::DecodeBaseInstruction(ByteView instruction_bytes, OperandLayout* layout) {
+  *layout = OperandLayout();
+  if (!DecodeInstruction(instruction_bytes)) {
+    return false;
+  }
+  const cs_x86& detail = decoded_instruction_->detail->x86;
+  layout->base_bytes = instruction_bytes.ToByteArray();
+  layout->instruction_id = decoded_instruction_->id;
+  layout->modrm_offset = detail.encoding.modrm_offset;
+  if (detail.encoding.disp_size > 0) {
+    layout->displacement_offset = detail.encoding.disp_offset;
+    layout->displacement_size = detail.encoding.disp_size;
+  }
+  if (detail.encoding.imm_size > 0) {
+    layout->immediate_offset = detail.encoding.imm_offset;
+    layout->immediate_size = detail.encoding.imm_size;
+  }
+  if (detail.rex != 0) {
+    // the REX prefix immediately precedes the opcode
+    size_t rex_offset = 0;
+    while (rex_offset < instruction_bytes.size() &&
+           IsLegacyPrefix(std::to_integer<uint8_t>(instruction_bytes[rex_offset]))) {
+      rex_offset++;
+    }
+    if (rex_offset < instruction_bytes.size() &&
+        (std::to_integer<uint8_t>(instruction_bytes[rex_offset]) & kREXPrefixMask) == kREXPrefix) {
+      layout->has_rex_prefix = true;
+      layout->rex_offset = rex_offset;
+    }
+  }
+  layout->has_address_size_prefix = detail.prefix[3] == kAddressSizePrefix;
+
+  bool addresses_memory = layout->modrm_offset > 0 && (detail.modrm >> 6) != 0x3;
+  for (uint8_t i = 0; i < detail.op_count; i++) {
+    const cs_x86_op& operand = detail.operands[i];
+    if (addresses_memory && operand.type == X86_OP_MEM && IsMemoryRegister(operand.mem.base)) {
+      layout->has_relocatable_memory_operand = true;
+    }
+    layout->operands.push_back(operand);
+  }
+  return true;
+}
+
+bool OperandMutator::IsValidVariant(const OperandLayout& layout) const {
+  const cs_x86& detail = decoded_instruction_->detail->x86;
+  if (decoded_instruction_->id != layout.instruction_id ||
+      detail.op_count != layout.operands.size()) {
+    return false;
+  }
+  for (uint8_t i = 0; i < detail.op_count; i++) {
+    const cs_x86_op& operand = detail.operands[i];
+    const cs_x86_op& base_operand = layout.operands[i];
+    if (operand.type != base_operand.type) {
+      return false;
+    }
+    if (operand.type == X86_OP_REG && operand.reg != base_operand.reg &&
+        IsReservedRegister(operand.reg)) {
+      return false;
+    }
+    if (operand.type == X86_OP_MEM) {
+      if (operand.mem.segment != base_operand.mem.segment ||
+          operand.mem.index != base_operand.mem.index) {
+        return false;
+      }
+      bool is_unchanged = operand.mem.base == base_operand.mem.base &&
+          operand.mem.disp == base_operand.mem.disp;
+      bool is_inside_data_memory = IsMemoryRegister(operand.mem.base) &&
+          operand.mem.disp >= 0 && operand.mem.disp <= kMaxDisplacement;
+      if (!is_unchanged && !is_inside_data_memory) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool OperandMutator::HasOtherRegisters(const OperandLayout& layout) const {
+  const cs_x86& detail = decoded_instruction_->detail->x86;
+  for (uint8_t i = 0; i < detail.op_count; i++) {
+    const cs_x86_op& operand = detail.operands[i];
+    const cs_x86_op& base_operand = layout.operands[i];
+    if ((operand.type == X86_OP_REG && operand.reg != base_operand.reg) ||
+        (operand.type == X86_OP_MEM && operand.mem.base != base_operand.mem.base)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool OperandMutator::CreateVariant(const OperandLayout& layout, size_t variant_no,
+                                   byte_array* variant_bytes, std::string* assembly_code) {
+  if (variant_no == 0 || variant_no > layout.GetNumberOfCandidates()) {
+    LOG_ERROR("Invalid operand variant");
+    std::abort();
+  }
+  size_t candidate = variant_no - 1;
+  size_t immediates_end = GetNumberOfImmediateCandidates(layout);
+  size_t displacements_end = immediates_end + GetNumberOfDisplacementCandidates(layout);
+  size_t address_sizes_end = displacements_end + GetNumberOfAddressSizeCandidates(layout);
+
+  *variant_bytes = layout.base_bytes;
+  bool is_register_substitution = candidate >= address_sizes_end;
+  bool is_mutated;
+  if (candidate < immediates_end) {
+    is_mutated = PatchImmediate(layout, candidate, variant_bytes);
+  } else if (candidate < displacements_end) {
+    is_mutated = RelocateDisplacement(layout, kDisplacementCandidates[candidate - immediates_end],
+                                      variant_bytes);
+  } else if (candidate < address_sizes_end) {
+    // legacy prefixes may appear in any order hence it can simply be put in front
+    variant_bytes->insert(variant_bytes->begin(), std::byte{kAddressSizePrefix});
+    is_mutated = true;
+  } else {
+    size_t register_candidate = candidate - address_sizes_end;
+    size_t no_register_numbers = GetNumberOfRegisterNumbers(layout);
+    is_mutated = SubstituteRegister(layout, register_candidate / no_register_numbers,
+                                    register_candidate % no_register_numbers, variant_bytes);
+  }
+  if (!is_mutated || !DecodeInstruction(*variant_bytes) || !IsValidVariant(layout) ||
+      (is_register_substitution && !HasOtherRegisters(layout))) {
+    return false;
+  }
+  *assembly_code = decoded_instruction_->mnemonic;
+  *assembly_code += " ";
+  *assembly_code += decoded_instruction_->op_str;
+  return true;
+}
+
+}  // namespace osiris
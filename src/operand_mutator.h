@@ -0,0 +1,119 @@
+// Copyright 2021 Daniel Weber, Ahmad Ibrahim, Hamed Nemati, Michael Schwarz, Christian Rossow
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+
+
+#ifndef OSIRIS_SRC_OPERAND_MUTATOR_H_
+#define OSIRIS_SRC_OPERAND_MUTATOR_H_
+
+#include <capstone/capstone.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+namespace osiris {
+
+///
+/// separates the UID of an instruction from the number of its operand variant in UID strings
+///
+constexpr char kOperandVariantSeparator = '~';
+
+///
+/// Fields of an encoded instruction that its operand variants change. Offsets are relative to
+/// the beginning of the instruction; an offset of 0 marks a missing ModRM, displacement or
+/// immediate field (there is always at least one opcode byte in front of them).
+///
+struct OperandLayout {
+  byte_array base_bytes;
+  unsigned int instruction_id = 0;  // capstone ID every variant has to decode to
+
+  bool has_rex_prefix = false;  // legacy REX prefix (not VEX/EVEX)
+  size_t rex_offset = 0;
+  size_t modrm_offset = 0;
+  size_t displacement_offset = 0;
+  size_t displacement_size = 0;
+  size_t immediate_offset = 0;
+  size_t immediate_size = 0;
+
+  /// the memory operand is based on a register pointing to the data memory, hence its
+  /// displacement and address size can be changed without leaving the data memory
+  bool has_relocatable_memory_operand = false;
+  bool has_address_size_prefix = false;
+
+  // decoded operands the operands of the variants are compared with
+  std::vector<cs_x86_op> operands;
+
+  /// \return number of candidates for operand variants (not all of them are valid
+  ///  instructions, see OperandMutator::CreateVariant)
+  size_t GetNumberOfCandidates() const;
+};
+
+///
+/// Derives operand variants of instructions: other immediates and displacements, other
+/// registers in the ModRM fields and the address-size override. The base instruction is decoded
+/// once with capstone; the variants are numbered candidates that are patched into its encoding
+/// on demand and only kept if they decode to the same instruction with legal operands.
+///
+class OperandMutator {
+ public:
+  OperandMutator();
+  ~OperandMutator();
+
+  // owns the capstone handle
+  OperandMutator(const OperandMutator&) = delete;
+  OperandMutator& operator=(const OperandMutator&) = delete;
+
+  /// Decodes a base instruction
+  /// \param instruction_bytes encoding of the base instruction
+  /// \param layout outputs the fields the variants change
+  /// \return false if capstone can not decode the instruction (it has no variants then)
+  bool DecodeBaseInstruction(ByteView instruction_bytes, OperandLayout* layout);
+
+  /// Creates a variant of a base instruction
+  /// \param layout layout of the base instruction
+  /// \param variant_no number of the variant in [1, layout.GetNumberOfCandidates()]
+  /// \param variant_bytes outputs the encoding of the variant
+  /// \param assembly_code outputs the disassembly of the variant
+  /// \return false if the candidate is no valid variant (it is skipped then)
+  bool CreateVariant(const OperandLayout& layout, size_t variant_no, byte_array* variant_bytes,
+                     std::string* assembly_code);
+
+ private:
+  /// Decodes exactly one instruction into decoded_instruction_
+  /// \return false if the bytes are no single instruction
+  bool DecodeInstruction(ByteView instruction_bytes);
+
+  /// Checks whether the decoded variant is the base instruction with legal operands only, i.e.,
+  /// it keeps its memory accesses inside the data memory and does not touch the registers the
+  /// executor relies on
+  /// \param layout layout of the base instruction
+  /// \return true if the variant is valid
+  bool IsValidVariant(const OperandLayout& layout) const;
+
+  /// Checks whether the registers of the decoded variant differ from the base instruction
+  /// (substituting a ModRM field that extends the opcode or is ignored changes only the encoding)
+  /// \param layout layout of the base instruction
+  /// \return true if an operand register changed
+  bool HasOtherRegisters(const OperandLayout& layout) const;
+
+  csh capstone_handle_;
+  cs_insn* decoded_instruction_;  // reused for every decoding (allocated once)
+};
+
+}  // namespace osiris
+
+#endif  // OSIRIS_SRC_OPERAND_MUTATOR_H_
@@ -16,23 +16,32 @@
 #include <getopt.h>
 
 #include <cassert>
+#include <cmath>
 #include <cstddef>
+#include <filesystem>
 #include <iostream>
 #include <fstream>
 #include <random>
+#include <system_error>
+#include <utility>
 
 #include "code_generator.h"
 #include "core.h"
 #include "executor.h"
 #include "utils.h"
 #include "filter.h"
+#include "hang_blacklist.h"
 #include "logger.h"
+#include "noise_profile.h"
+#include "reset_calibration.h"
+#include "worker_pool.h"
 
 //
 // Constants
 //
 const std::string kInstructionFile("../x86-instructions/instructions.b64");
 const std::string kInstructionFileCleaned("../x86-instructions/instructions_cleaned.b64");
+const std::string kInstructionDatabase("../x86-instructions/instructions_cleaned.db");
 
 const std::string kOutputCSVNoAssumptions("./measure_trigger_pairs.csv");
 
@@ -40,22 +49,42 @@ const std::string kOutputCSVTriggerEqualsMeasurement("./triggerpairs.csv");
 const std::string kOutputFolderTriggerEqualsMeasurement("./triggerpairs");
 const std::string kOutputFolderFormattedTriggerEqualsMeasurement("./triggerpairs-formatted");
 
+const std::string kOutputCSVSequences("./sequence_triggerpairs.csv");
+
+const std::string kHangBlacklistFile("./hanging_triples.csv");
+
 //
 // Validate Target Architecture Macros
+// (optional; they only select the default timer which is otherwise chosen at runtime)
 //
 #ifdef INTEL
   #ifdef AMD
   static_assert(false, "Multiple target architectures defined! Aborting!");
   #endif
 #endif
-#ifndef INTEL
-  #ifndef AMD
-  static_assert(false, "No target architecture defined! Aborting!");
-  #endif
-#endif
 
 
-void ConfirmResultsOfFuzzer(const std::string& input_file, const std::string& output_file) {
+/// Selects the file the instructions are loaded from. The database created by --compile-isa is
+/// preferred as it is mapped instead of parsed, unless the cleaned instruction file is newer.
+/// \return filename of the instruction database or of the cleaned instruction file
+std::string GetInstructionFilename() {
+  std::error_code error;
+  auto database_time = std::filesystem::last_write_time(kInstructionDatabase, error);
+  if (error) {
+    return kInstructionFileCleaned;
+  }
+  auto instruction_file_time = std::filesystem::last_write_time(kInstructionFileCleaned, error);
+  if (!error && instruction_file_time > database_time) {
+    LOG_WARNING("Ignoring " + kInstructionDatabase + " as it is older than " +
+        kInstructionFileCleaned + " (run --compile-isa to update it)");
+    return kInstructionFileCleaned;
+  }
+  return kInstructionDatabase;
+}
+
+void ConfirmResultsOfFuzzer(const std::string& input_file, const std::string& output_file,
+                            const osiris::ExecutorConfig& executor_config, int64_t threshold,
+                            const osiris::NoiseProfile& noise_profile) {
   // parse input csv with following format:
   //  measurement-sequence;measurement-category;measurement-extension;
   //  measurement-isa-set;measurement-bytes;
@@ -86,11 +115,11 @@ void ConfirmResultsOfFuzzer(const std::string& input_file, const std::string& ou
   output_stream << input_headerline << std::endl;
   output_cleaned_stream << input_headerline << std::endl;
 
-  osiris::Executor executor;
-  osiris::CodeGenerator code_generator(kInstructionFileCleaned);
+  osiris::Executor executor(executor_config);
+  osiris::CodeGenerator code_generator(GetInstructionFilename());
   int succeeded = 0;
   int failed = 0;
-  std::vector<std::tuple<uint64_t, uint64_t, uint64_t, std::string>> inputs;
+  std::vector<std::tuple<std::string, std::string, std::string, std::string>> inputs;
   // TODO(dwe): we can go out of memory here
   //  fix idea: instead of reading all entries at once only read a few (maybe 5mio?)
   //  and process them as bulks
@@ -98,54 +127,62 @@ void ConfirmResultsOfFuzzer(const std::string& input_file, const std::string& ou
     std::vector<std::string> line_splitted = osiris::SplitString(line, ';');
     assert(line_splitted.size() == 16);
 
-    uint64_t measurement_uid = stoll(line_splitted[1], nullptr, 16);
-    uint64_t trigger_uid = stoll(line_splitted[6], nullptr, 16);
-    uint64_t reset_uid = stoll(line_splitted[11], nullptr, 16);
-    inputs.emplace_back(measurement_uid, trigger_uid, reset_uid, line);
+    // multi-instruction sequences join the UIDs of their instructions (see x86Sequence)
+    inputs.emplace_back(line_splitted[1], line_splitted[6], line_splitted[11], line);
   }
 
   // randomize order
   std::shuffle(inputs.begin(), inputs.end(), std::mt19937(std::random_device()()));
 
   for (const auto& elem : inputs) {
-    uint64_t measurement_uid = std::get<0>(elem);
-    uint64_t trigger_uid = std::get<1>(elem);
-    uint64_t reset_uid = std::get<2>(elem);
     line = std::get<3>(elem);
-    osiris::x86Instruction measurement = code_generator.CreateInstructionFromUID(measurement_uid);
-    osiris::x86Instruction trigger = code_generator.CreateInstructionFromUID(trigger_uid);
-    osiris::x86Instruction reset = code_generator.CreateInstructionFromUID(reset_uid);
+    osiris::x86Sequence measurement = code_generator.CreateSequenceFromUIDString(std::get<0>(elem));
+    osiris::x86Sequence trigger = code_generator.CreateSequenceFromUIDString(std::get<1>(elem));
+    osiris::x86Sequence reset = code_generator.CreateSequenceFromUIDString(std::get<2>(elem));
 
-    if (trigger.assembly_code == "busy-sleep" || measurement.assembly_code == "busy-sleep") {
-      // the sleep is only a valid reset sequence
-      continue;
-    }
-    if (trigger.assembly_code == "sleep-syscall" || measurement.assembly_code == "sleep-syscall") {
-      // the sleep is only a valid reset sequence
-      continue;
-    }
-    if (trigger.assembly_code == "short-busy-sleep" ||
-        measurement.assembly_code == "short-busy-sleep") {
+    if (trigger.IsSleep() || measurement.IsSleep()) {
       // the sleep is only a valid reset sequence
       continue;
     }
+    int64_t measurement_threshold = noise_profile.GetThreshold(measurement.GetSequenceUID(),
+                                                               threshold);
+    executor.SetEffectThresholds(-measurement_threshold, measurement_threshold);
     int64_t result;
-    int reset_amount = reset.assembly_code == "busy-sleep" ||
-        reset.assembly_code == "sleep-syscall" ||
-        reset.assembly_code == "short-busy-sleep" ? 1 : 100;
+    int reset_amount = reset.IsSleep() ? 1 : 100;
     executor.TestTriggerSequence(trigger.byte_representation,
                                  measurement.byte_representation,
                                  reset.byte_representation,
                                  true, 200,
                                  reset_amount, &result);
     LOG_INFO("Confirming " + measurement.assembly_code + " -- observed delta: " + std::to_string(result));
+    const osiris::SampleStatistics& trigger_statistics = executor.GetTriggerStatistics();
+    const osiris::SampleStatistics& notrigger_statistics = executor.GetNoTriggerStatistics();
+    LOG_INFO("\tmedian with trigger: " + std::to_string(trigger_statistics.median) + " [" +
+        std::to_string(trigger_statistics.median_lower_bound) + ", " +
+        std::to_string(trigger_statistics.median_upper_bound) + "], without trigger: " +
+        std::to_string(notrigger_statistics.median) + " [" +
+        std::to_string(notrigger_statistics.median_lower_bound) + ", " +
+        std::to_string(notrigger_statistics.median_upper_bound) + "]");
+    std::vector<osiris::Metric> counter_metrics = executor.GetCounterMetrics();
+    for (size_t i = 0; i < counter_metrics.size(); i++) {
+      LOG_INFO("\t" + osiris::MetricToString(counter_metrics[i]) + " delta: " +
+          std::to_string(executor.GetCounterDifferences()[i]));
+    }
 
     // write result to file
     std::string line_without_timing = line.substr(line.find(';') + 1);
     std::string output_line = std::to_string(result) + ";" + line_without_timing;
     output_stream << output_line << std::endl;
 
-    if (std::abs(result) > 50) {
+    // the difference must also be significant: either the confidence interval of the paired
+    // differences excludes 0 or the intervals of both medians are disjoint
+    const osiris::SampleStatistics& difference_statistics = executor.GetDifferenceStatistics();
+    bool is_significant = difference_statistics.no_samples > 0
+        ? difference_statistics.median_lower_bound > 0 ||
+            difference_statistics.median_upper_bound < 0
+        : trigger_statistics.median_upper_bound < notrigger_statistics.median_lower_bound ||
+            notrigger_statistics.median_upper_bound < trigger_statistics.median_lower_bound;
+    if (std::abs(result) > measurement_threshold && is_significant) {
       succeeded++;
       output_cleaned_stream << output_line << std::endl;
     } else {
@@ -154,6 +191,138 @@ void ConfirmResultsOfFuzzer(const std::string& input_file, const std::string& ou
   }
 
   LOG_INFO("succeeded: " + std::to_string(succeeded) + " failed: " + std::to_string(failed));
+  executor.PrintContaminationRate();
+}
+
+/// Prints how many faults per second the executor recovers from
+/// \param executor_config configuration of the executor
+void BenchmarkFaults(const osiris::ExecutorConfig& executor_config) {
+  constexpr int kBenchmarkExecutions = 100000;
+  const std::vector<std::pair<std::string, osiris::byte_array>> faulting_sequences = {
+      // ud2
+      {"SIGILL", osiris::byte_array{std::byte{0x0f}, std::byte{0x0b}}},
+      // mov rax, qword ptr [0]
+      {"SIGSEGV", osiris::byte_array{std::byte{0x48}, std::byte{0x8b}, std::byte{0x04},
+                                     std::byte{0x25}, std::byte{0x00}, std::byte{0x00},
+                                     std::byte{0x00}, std::byte{0x00}}},
+      // int3
+      {"SIGTRAP", osiris::byte_array{std::byte{0xcc}}},
+  };
+  osiris::Executor executor(executor_config);
+  for (const auto& [signal_name, faulting_sequence] : faulting_sequences) {
+    double fault_rate = executor.BenchmarkFaultRecovery(faulting_sequence,
+                                                        kBenchmarkExecutions);
+    LOG_INFO(signal_name + ": " + std::to_string(std::llround(fault_rate)) + " faults/s");
+  }
+  executor.PrintFaultCount();
+}
+
+/// Derives every operand variant of every instruction without executing them (e.g. to check
+/// the operand mutator against the installed capstone version)
+void CountOperandVariants() {
+  osiris::CodeGenerator code_generator(GetInstructionFilename());
+  size_t no_undecodable_instructions = 0;
+  size_t no_candidates = 0;
+  size_t no_variants = 0;
+  size_t no_instructions = code_generator.GetNumberOfInstructions();
+  for (size_t instruction_idx = 0; instruction_idx < no_instructions; instruction_idx++) {
+    osiris::OperandLayout operand_layout = code_generator.CreateOperandLayout(instruction_idx);
+    if (operand_layout.base_bytes.empty()) {
+      no_undecodable_instructions++;
+      continue;
+    }
+    no_candidates += operand_layout.GetNumberOfCandidates();
+    osiris::x86Sequence sequence = code_generator.CreateSequenceFromIndexes({instruction_idx});
+    osiris::x86Sequence variant_sequence;
+    size_t variant_no = 0;
+    while (code_generator.CreateNextOperandVariant(sequence, 0, operand_layout, &variant_no,
+                                                   &variant_sequence)) {
+      LOG_DEBUG(variant_sequence.GetUIDString() + ": " + variant_sequence.assembly_code);
+      no_variants++;
+    }
+  }
+  LOG_INFO("Instructions: " + std::to_string(no_instructions) + " (" +
+      std::to_string(no_undecodable_instructions) + " not decodable by capstone)");
+  LOG_INFO("Candidates: " + std::to_string(no_candidates));
+  LOG_INFO("Generated variants: " + std::to_string(no_variants));
+  LOG_INFO("Rejected candidates: " + std::to_string(no_candidates - no_variants));
+}
+
+void RunParallelSearch(const std::vector<int>& cpu_cores, bool all,
+                       bool execute_trigger_only_in_speculation, int64_t threshold,
+                       const osiris::ExecutorConfig& executor_config,
+                       const osiris::ScreeningConfig& screening_config,
+                       const osiris::NoiseProfile& noise_profile,
+                       const osiris::ResetCalibration& reset_calibration,
+                       const osiris::SequenceSearchConfig* sequence_search_config) {
+  // created before the workers are forked s.t. they only append to it
+  osiris::HangBlacklist().Open(kHangBlacklistFile);
+  osiris::WorkerPool worker_pool(cpu_cores);
+  LOG_INFO("Searching in parallel with " + std::to_string(worker_pool.GetNumberOfWorkers()) +
+      " workers");
+  std::string output_csvfilename = all ? kOutputCSVNoAssumptions
+                                       : kOutputCSVTriggerEqualsMeasurement;
+  if (sequence_search_config != nullptr) {
+    output_csvfilename = kOutputCSVSequences;
+  }
+  bool uses_output_folder = !all && sequence_search_config == nullptr;
+  if (uses_output_folder) {
+    // the workers share the output folder hence it is recreated only once
+    std::filesystem::remove_all(kOutputFolderTriggerEqualsMeasurement);
+    std::filesystem::create_directory(kOutputFolderTriggerEqualsMeasurement);
+  }
+
+  int error = worker_pool.Run([&](int worker_no, osiris::WorkQueue* work_queue) {
+    // every worker uses its own memory range
+    osiris::ExecutorConfig worker_executor_config = executor_config;
+    worker_executor_config.data_memory_begin =
+        osiris::WorkerPool::GetWorkerMemoryBegin(worker_no);
+    osiris::Core osiris_core(GetInstructionFilename(), worker_executor_config);
+    osiris_core.SetScreeningConfig(screening_config);
+    osiris_core.SetNoiseProfile(noise_profile);
+    osiris_core.SetResetCalibration(reset_calibration);
+    osiris_core.SetHangBlacklist(kHangBlacklistFile);
+    std::string part_filename = osiris::WorkerPool::GetPartFilename(output_csvfilename,
+                                                                    worker_no);
+    if (sequence_search_config != nullptr) {
+      osiris_core.FindAndOutputSequenceTriggerpairs(
+          part_filename,
+          *sequence_search_config,
+          execute_trigger_only_in_speculation,
+          -threshold,
+          threshold,
+          work_queue);
+    } else if (all) {
+      osiris_core.FindAndOutputTriggerpairsWithoutAssumptions(
+          part_filename,
+          execute_trigger_only_in_speculation,
+          threshold,
+          work_queue);
+    } else {
+      osiris_core.FindAndOutputTriggerpairsWithTriggerEqualsMeasurement(
+          kOutputFolderTriggerEqualsMeasurement,
+          part_filename,
+          execute_trigger_only_in_speculation,
+          -threshold,
+          threshold,
+          work_queue);
+    }
+    LOG_INFO("worker " + std::to_string(worker_no) + " finished");
+    osiris_core.PrintFaultStatistics();
+  });
+  if (error) {
+    LOG_WARNING("Not all workers finished successfully. The output is incomplete!");
+  }
+
+  if (worker_pool.MergePartFiles(output_csvfilename)) {
+    LOG_ERROR("Couldn't merge the output of the workers. Aborting!");
+    std::exit(1);
+  }
+  if (uses_output_folder) {
+    osiris::Core osiris_core(GetInstructionFilename(), executor_config);
+    osiris_core.FormatTriggerPairOutput(kOutputFolderTriggerEqualsMeasurement,
+                                        kOutputFolderFormattedTriggerEqualsMeasurement);
+  }
 }
 
 void PrintHelp(char** argv) {
@@ -164,6 +333,11 @@ void PrintHelp(char** argv) {
             << "The following options can influence or change the behavior:" << std::endl
             << "--cleanup \t Create new instruction file "
             << "consisting of only non-faulting instructions" << std::endl
+            << "--compile-isa \t Compile the cleaned instruction file into a binary database "
+            << "that is mapped at startup instead of parsed" << std::endl
+            << "--count-operand-variants \t Derive all operand variants of the instructions "
+            << "without executing them and report how many are generated and rejected"
+            << std::endl
             << "--all \t\t Search with trigger sequence != measurement sequence (takes a few days)"
             << std::endl
             << "--speculation \t Executes trigger sequence only transiently" << std::endl
@@ -171,30 +345,184 @@ void PrintHelp(char** argv) {
             << "--confirm-results \t Randomize order of the sequence triples and test again. "
             << std::endl
             << " \t\t Requires 2 positional arguments for the input and output file" << std::endl
+            << "--samples-per-execution <n> \t Take up to n timed samples per execution of a "
+            << "code page (default: 1)" << std::endl
+            << "--code-page-pool-size <n> \t Number of code pages used round-robin "
+            << "(default: 64)" << std::endl
+            << "--cores <list> \t Search (and calibrate the resets) in parallel with one "
+            << "worker per CPU core (e.g. 2,4-7)" << std::endl
+            << "--fork-server \t Execute the generated code in a separate process that gets "
+            << "replaced when it crashes" << std::endl
+            << "--keep-contaminated-samples \t Keep the samples of executions that were "
+            << "interrupted by a context switch, page fault or frequency transition" << std::endl
+            << "--code-alignment <n> \t Align the timed measurement sequence to n bytes "
+            << "(default: 64, 0 disables the alignment)" << std::endl
+            << "--match-baseline-layout \t Pad the code page without trigger sequence with NOPs "
+            << "of the trigger's length" << std::endl
+            << "--huge-pages \t Back the generated code with huge pages" << std::endl
+            << "--benchmark-faults \t Measure how many faults per second are recovered from"
+            << std::endl
+            << "--watchdog-timeout <ms> \t Abort executions of generated code that take longer "
+            << "(default: 1000, 0 disables the watchdog)" << std::endl
+            << "--serialization <auto|cpuid|lfence|serialize> \t Serializing instruction(s) "
+            << "around the timed region (default: auto, i.e. benchmarked at startup)"
+            << std::endl
+            << "--sample-order <blocked|interleaved|randomized> \t Order in which the code "
+            << "pages of a test are executed (default: interleaved)" << std::endl
+            << "--timer <auto|rdtsc|rdpru|rdpmc|clock_gettime> \t Counter used to time the "
+            << "measurement sequence (default: rdtsc/rdpru if compiled for Intel/AMD, "
+            << "auto otherwise)" << std::endl
+            << "--metric <name> \t Observable of the measurement sequence that is compared "
+            << "against the threshold and written to the output (default: cycles)" << std::endl
+            << "--counters <list> \t Performance counters to record in addition (e.g. "
+            << "uops-retired,machine-clears; reported by --confirm)" << std::endl
+            << " \t\t Metrics: cycles, instructions, uops-retired, l1d-misses, l2-misses, "
+            << "llc-misses, branch-misses, machine-clears, dsb-switches" << std::endl
+            << "--threshold <n> \t Minimum absolute difference of the metric that is reported "
+            << "(default: 50)" << std::endl
+            << "--sequential-testing <n> \t Sample adaptively until a sequential test decides "
+            << "whether there is an effect, with at most n samples (default: fixed sample count)"
+            << std::endl
+            << "--error-rate <p> \t Error rate of the sequential test (default: 0.01)"
+            << std::endl
+            << "--testruns <n> \t Samples per code page of a full measurement (default: 10)"
+            << std::endl
+            << "--screening <n> \t Screen all triples of --all with n samples first and only "
+            << "measure the candidates fully" << std::endl
+            << "--screening-threshold <f> \t Fraction of the threshold that a candidate has to "
+            << "exceed in the screening (default: 0.5)" << std::endl
+            << "--profile <file> \t Derive the threshold of every measurement sequence from its "
+            << "noise profile (measured and written to the file if it does not exist yet)"
+            << std::endl
+            << "--noise-multiple <k> \t Multiple of the noise that counts as effect with "
+            << "--profile (default: 5)" << std::endl
+            << "--relative-effect <r> \t Fraction of the baseline that counts as effect with "
+            << "--profile (default: 0.1)" << std::endl
+            << "--reset-calibration <file> \t Execute every reset sequence as often as needed "
+            << "to reset the trigger sequence (calibrated and written to the file if it does "
+            << "not exist yet; --all and composed sequences only use the amounts of calibrated "
+            << "pairs)" << std::endl
+            << "--sequence-length <k> \t Search with trigger sequences (== measurement "
+            << "sequences) composed of k instructions (reset sequences stay single "
+            << "instructions)" << std::endl
+            << "--sequence-categories <list> \t Allowed categories of the instructions of "
+            << "composed sequences per position (e.g. DATAXFER:BINARY,LOGICAL; a single list "
+            << "applies to all positions)" << std::endl
+            << "--sequence-memory-first \t Only allow instructions accessing memory at the first "
+            << "position of composed sequences" << std::endl
+            << "--sequence-samples <n> \t Test n randomly drawn composed sequences instead of "
+            << "all of them" << std::endl
+            << "--operand-variants <n> \t Additionally test up to n operand variants (other "
+            << "immediates, displacements, registers, address size) of every instruction of the "
+            << "trigger sequences (searches single instructions unless --sequence-length is "
+            << "given)" << std::endl
             << "--help/-h \t Print usage" << std::endl;
 }
 
 struct CommandLineArguments {
   bool cleanup = false;
+  bool compile_isa = false;
+  bool count_operand_variants = false;
   bool all = false;
   bool speculation_trigger = false;
 
   bool filter = false;
   std::string filename_filter;
 
+  bool benchmark_faults = false;
+
   bool confirm = false;
   std::string filename_confirm_input;
   std::string filename_confirm_output;
+
+  osiris::ExecutorConfig executor_config;
+  int64_t threshold = 50;
+
+  osiris::ScreeningConfig screening_config;
+
+  std::string filename_profile;
+  double noise_multiple = 5;
+  double relative_effect_size = 0.1;
+
+  std::string filename_reset_calibration;
+
+  bool sequence_search = false;
+  bool sequence_length_given = false;
+  osiris::SequenceSearchConfig sequence_search_config;
+
+  std::vector<int> cpu_cores;
 };
 
+/// Parses the categories of the instructions of composed sequences
+/// \param list comma-separated categories per position, positions separated by ':'
+///     (e.g. DATAXFER:BINARY,LOGICAL)
+/// \return categories per position
+std::vector<std::vector<std::string>> ParseSequenceCategories(const std::string& list) {
+  std::vector<std::vector<std::string>> position_categories;
+  for (const std::string& position_list : osiris::SplitString(list, ':')) {
+    position_categories.push_back(osiris::SplitString(position_list, ','));
+  }
+  return position_categories;
+}
+
+/// Parses the name of a metric (see osiris::MetricToString)
+/// \param name name of the metric
+/// \param metric outputs the metric
+/// \return false if the name is unknown
+bool ParseMetric(const std::string& name, osiris::Metric* metric) {
+  for (osiris::Metric candidate :
+      {osiris::Metric::CYCLES, osiris::Metric::INSTRUCTIONS, osiris::Metric::UOPS_RETIRED,
+       osiris::Metric::L1D_MISSES, osiris::Metric::L2_MISSES, osiris::Metric::LLC_MISSES,
+       osiris::Metric::BRANCH_MISSES, osiris::Metric::MACHINE_CLEARS,
+       osiris::Metric::DSB_SWITCHES}) {
+    if (osiris::MetricToString(candidate) == name) {
+      *metric = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
 CommandLineArguments ParseArguments(int argc, char** argv) {
   CommandLineArguments command_line_arguments;
   const struct option long_options[] = {
       {"cleanup", no_argument, nullptr, 'c'},
+      {"compile-isa", no_argument, nullptr, 'I'},
+      {"count-operand-variants", no_argument, nullptr, 'V'},
       {"all", no_argument, nullptr, 'a'},
       {"speculation", no_argument, nullptr, 's'},
       {"filter", required_argument, nullptr, 'f'},
       {"confirm", no_argument, nullptr, '1'},
+      {"samples-per-execution", required_argument, nullptr, 'b'},
+      {"code-page-pool-size", required_argument, nullptr, 'p'},
+      {"cores", required_argument, nullptr, 'w'},
+      {"fork-server", no_argument, nullptr, 'k'},
+      {"keep-contaminated-samples", no_argument, nullptr, 'K'},
+      {"code-alignment", required_argument, nullptr, 'A'},
+      {"match-baseline-layout", no_argument, nullptr, 'L'},
+      {"huge-pages", no_argument, nullptr, 'H'},
+      {"benchmark-faults", no_argument, nullptr, 'B'},
+      {"watchdog-timeout", required_argument, nullptr, 't'},
+      {"serialization", required_argument, nullptr, 'z'},
+      {"timer", required_argument, nullptr, 'r'},
+      {"sample-order", required_argument, nullptr, 'o'},
+      {"metric", required_argument, nullptr, 'm'},
+      {"counters", required_argument, nullptr, 'n'},
+      {"threshold", required_argument, nullptr, 'e'},
+      {"sequential-testing", required_argument, nullptr, 'q'},
+      {"error-rate", required_argument, nullptr, 'x'},
+      {"testruns", required_argument, nullptr, 'T'},
+      {"screening", required_argument, nullptr, 'S'},
+      {"screening-threshold", required_argument, nullptr, 'F'},
+      {"profile", required_argument, nullptr, 'P'},
+      {"noise-multiple", required_argument, nullptr, 'M'},
+      {"relative-effect", required_argument, nullptr, 'E'},
+      {"reset-calibration", required_argument, nullptr, 'R'},
+      {"sequence-length", required_argument, nullptr, 'y'},
+      {"sequence-categories", required_argument, nullptr, 'Y'},
+      {"sequence-memory-first", no_argument, nullptr, 'G'},
+      {"sequence-samples", required_argument, nullptr, 'g'},
+      {"operand-variants", required_argument, nullptr, 'v'},
       {nullptr, 0, nullptr, 0}
   };
 
@@ -207,6 +535,12 @@ CommandLineArguments ParseArguments(int argc, char** argv) {
       case 'c':
         command_line_arguments.cleanup = true;
         break;
+      case 'I':
+        command_line_arguments.compile_isa = true;
+        break;
+      case 'V':
+        command_line_arguments.count_operand_variants = true;
+        break;
       case 'a':
         command_line_arguments.all = true;
         break;
@@ -220,6 +554,196 @@ CommandLineArguments ParseArguments(int argc, char** argv) {
         command_line_arguments.filter = true;
         command_line_arguments.filename_filter = std::string(optarg);
         break;
+      case 'b':
+        command_line_arguments.executor_config.samples_per_execution = std::stoi(optarg);
+        break;
+      case 'p':
+        command_line_arguments.executor_config.code_page_pool_size = std::stoi(optarg);
+        break;
+      case 'k':
+        command_line_arguments.executor_config.use_fork_server = true;
+        break;
+      case 'K':
+        command_line_arguments.executor_config.discard_contaminated_samples = false;
+        break;
+      case 'A':
+        command_line_arguments.executor_config.code_alignment = std::stoi(optarg);
+        break;
+      case 'L':
+        command_line_arguments.executor_config.match_baseline_layout = true;
+        break;
+      case 'H':
+        command_line_arguments.executor_config.use_huge_pages = true;
+        break;
+      case 'B':
+        command_line_arguments.benchmark_faults = true;
+        break;
+      case 't':
+        command_line_arguments.executor_config.watchdog_timeout_ms = std::stoi(optarg);
+        break;
+      case 'z': {
+        bool is_known_primitive = false;
+        for (osiris::SerializationPrimitive serialization_primitive :
+            {osiris::SerializationPrimitive::AUTO, osiris::SerializationPrimitive::CPUID,
+             osiris::SerializationPrimitive::LFENCE,
+             osiris::SerializationPrimitive::SERIALIZE}) {
+          if (osiris::SerializationPrimitiveToString(serialization_primitive) == optarg) {
+            command_line_arguments.executor_config.serialization_primitive =
+                serialization_primitive;
+            is_known_primitive = true;
+          }
+        }
+        if (!is_known_primitive) {
+          std::cerr << "[-] Unknown serialization primitive. Aborting!" << std::endl;
+          exit(1);
+        }
+        break;
+      }
+      case 'o': {
+        bool is_known_order = false;
+        for (osiris::SampleOrder sample_order :
+            {osiris::SampleOrder::BLOCKED, osiris::SampleOrder::INTERLEAVED,
+             osiris::SampleOrder::RANDOMIZED}) {
+          if (osiris::SampleOrderToString(sample_order) == optarg) {
+            command_line_arguments.executor_config.sample_order = sample_order;
+            is_known_order = true;
+          }
+        }
+        if (!is_known_order) {
+          std::cerr << "[-] Unknown sample order. Aborting!" << std::endl;
+          exit(1);
+        }
+        break;
+      }
+      case 'r': {
+        bool is_known_timer = false;
+        for (osiris::TimerBackend timer_backend :
+            {osiris::TimerBackend::AUTO, osiris::TimerBackend::RDTSC,
+             osiris::TimerBackend::RDPRU, osiris::TimerBackend::RDPMC,
+             osiris::TimerBackend::CLOCK_GETTIME}) {
+          if (osiris::TimerBackendToString(timer_backend) == optarg) {
+            command_line_arguments.executor_config.timer_backend = timer_backend;
+            is_known_timer = true;
+          }
+        }
+        if (!is_known_timer) {
+          std::cerr << "[-] Unknown timer. Aborting!" << std::endl;
+          exit(1);
+        }
+        break;
+      }
+      case 'm':
+        if (!ParseMetric(optarg, &command_line_arguments.executor_config.metric)) {
+          std::cerr << "[-] Unknown metric. Aborting!" << std::endl;
+          exit(1);
+        }
+        break;
+      case 'n':
+        for (const std::string& name : osiris::SplitString(optarg, ',')) {
+          osiris::Metric metric;
+          if (!ParseMetric(name, &metric)) {
+            std::cerr << "[-] Unknown metric " << name << ". Aborting!" << std::endl;
+            exit(1);
+          }
+          command_line_arguments.executor_config.recorded_metrics.push_back(metric);
+        }
+        break;
+      case 'e':
+        command_line_arguments.threshold = std::stoll(optarg);
+        if (command_line_arguments.threshold < 0) {
+          std::cerr << "[-] The threshold must not be negative. Aborting!" << std::endl;
+          exit(1);
+        }
+        break;
+      case 'q':
+        command_line_arguments.executor_config.sequential_max_testruns = std::stoi(optarg);
+        if (command_line_arguments.executor_config.sequential_max_testruns <= 0) {
+          std::cerr << "[-] The sample cap must be positive. Aborting!" << std::endl;
+          exit(1);
+        }
+        break;
+      case 'x':
+        command_line_arguments.executor_config.sequential_error_rate = std::stod(optarg);
+        if (command_line_arguments.executor_config.sequential_error_rate <= 0 ||
+            command_line_arguments.executor_config.sequential_error_rate >= 0.5) {
+          std::cerr << "[-] The error rate must be in (0, 0.5). Aborting!" << std::endl;
+          exit(1);
+        }
+        break;
+      case 'T':
+        command_line_arguments.screening_config.measurement_testruns = std::stoi(optarg);
+        if (command_line_arguments.screening_config.measurement_testruns <= 0) {
+          std::cerr << "[-] The number of testruns must be positive. Aborting!" << std::endl;
+          exit(1);
+        }
+        break;
+      case 'S':
+        command_line_arguments.screening_config.screening_testruns = std::stoi(optarg);
+        if (command_line_arguments.screening_config.screening_testruns <= 0) {
+          std::cerr << "[-] The number of screening testruns must be positive. Aborting!"
+                    << std::endl;
+          exit(1);
+        }
+        break;
+      case 'F':
+        command_line_arguments.screening_config.screening_threshold_fraction =
+            std::stod(optarg);
+        if (command_line_arguments.screening_config.screening_threshold_fraction <= 0) {
+          std::cerr << "[-] The screening threshold must be positive. Aborting!" << std::endl;
+          exit(1);
+        }
+        break;
+      case 'P':
+        command_line_arguments.filename_profile = std::string(optarg);
+        break;
+      case 'M':
+        command_line_arguments.noise_multiple = std::stod(optarg);
+        if (command_line_arguments.noise_multiple <= 0) {
+          std::cerr << "[-] The noise multiple must be positive. Aborting!" << std::endl;
+          exit(1);
+        }
+        break;
+      case 'E':
+        command_line_arguments.relative_effect_size = std::stod(optarg);
+        if (command_line_arguments.relative_effect_size < 0) {
+          std::cerr << "[-] The relative effect must not be negative. Aborting!" << std::endl;
+          exit(1);
+        }
+        break;
+      case 'R':
+        command_line_arguments.filename_reset_calibration = std::string(optarg);
+        break;
+      case 'y':
+        command_line_arguments.sequence_search = true;
+        command_line_arguments.sequence_length_given = true;
+        command_line_arguments.sequence_search_config.constraints.length = std::stoi(optarg);
+        if (std::stoi(optarg) <= 0) {
+          std::cerr << "[-] The sequence length must be positive. Aborting!" << std::endl;
+          exit(1);
+        }
+        break;
+      case 'Y':
+        command_line_arguments.sequence_search_config.constraints.position_categories =
+            ParseSequenceCategories(optarg);
+        break;
+      case 'G':
+        command_line_arguments.sequence_search_config.constraints.memory_access_first = true;
+        break;
+      case 'g':
+        command_line_arguments.sequence_search_config.no_samples = std::stoull(optarg);
+        break;
+      case 'v':
+        command_line_arguments.sequence_search = true;
+        command_line_arguments.sequence_search_config.operand_variants_per_instruction =
+            std::stoull(optarg);
+        break;
+      case 'w':
+        command_line_arguments.cpu_cores = osiris::ParseCPUList(optarg);
+        if (command_line_arguments.cpu_cores.empty()) {
+          std::cerr << "[-] Invalid list of CPU cores. Aborting!" << std::endl;
+          exit(1);
+        }
+        break;
       case 'h':
       case '?':
       case ':':
@@ -230,6 +754,16 @@ CommandLineArguments ParseArguments(int argc, char** argv) {
         exit(1);
     }
   }
+  if (command_line_arguments.sequence_search && command_line_arguments.all) {
+    std::cerr << "[-] The search with composed sequences assumes trigger sequence == "
+              << "measurement sequence and can not be combined with --all. Aborting!"
+              << std::endl;
+    exit(1);
+  }
+  if (command_line_arguments.sequence_search && !command_line_arguments.sequence_length_given) {
+    // operand variants without composed sequences are variants of single instructions
+    command_line_arguments.sequence_search_config.constraints.length = 1;
+  }
   if (command_line_arguments.confirm) {
     if (argv[optind] == nullptr || argv[optind + 1] == nullptr) {
       std::cerr << "[-] Missing positional parameter for --confirm" << std::endl
@@ -244,6 +778,110 @@ CommandLineArguments ParseArguments(int argc, char** argv) {
   return command_line_arguments;
 }
 
+/// Loads the noise profile given on the command line or creates it if the file does not exist
+/// \param command_line_arguments parsed command line arguments
+/// \return noise profile (empty if no profile is used)
+osiris::NoiseProfile LoadOrCreateNoiseProfile(const CommandLineArguments& command_line_arguments) {
+  osiris::NoiseProfile noise_profile;
+  noise_profile.SetThresholdParameters(command_line_arguments.noise_multiple,
+                                       command_line_arguments.relative_effect_size);
+  if (command_line_arguments.filename_profile.empty()) {
+    return noise_profile;
+  }
+  if (noise_profile.Load(command_line_arguments.filename_profile)) {
+    LOG_INFO("Loaded noise profile " + command_line_arguments.filename_profile);
+    return noise_profile;
+  }
+  LOG_INFO(" === Starting Profiling Stage ===");
+  osiris::Core osiris_core(GetInstructionFilename(), command_line_arguments.executor_config);
+  osiris_core.SetScreeningConfig(command_line_arguments.screening_config);
+  osiris_core.CreateNoiseProfile(&noise_profile);
+  noise_profile.Save(command_line_arguments.filename_profile);
+  LOG_INFO("Wrote noise profile to " + command_line_arguments.filename_profile);
+  return noise_profile;
+}
+
+/// Calibrates the reset executions with one worker per given CPU core. Every worker writes the
+/// calibration of the trigger sequences it took to its own part of the calibration file.
+/// \param command_line_arguments parsed command line arguments
+/// \param noise_profile noise profile the thresholds of the calibration are derived from
+void CalibrateResetExecutionsInParallel(const CommandLineArguments& command_line_arguments,
+                                        const osiris::NoiseProfile& noise_profile) {
+  // created before the workers are forked s.t. they only append to it
+  osiris::HangBlacklist().Open(kHangBlacklistFile);
+  osiris::WorkerPool worker_pool(command_line_arguments.cpu_cores);
+  LOG_INFO("Calibrating in parallel with " + std::to_string(worker_pool.GetNumberOfWorkers()) +
+      " workers");
+  const std::string& calibration_filename = command_line_arguments.filename_reset_calibration;
+  int error = worker_pool.Run([&](int worker_no, osiris::WorkQueue* work_queue) {
+    // every worker uses its own memory range
+    osiris::ExecutorConfig worker_executor_config = command_line_arguments.executor_config;
+    worker_executor_config.data_memory_begin =
+        osiris::WorkerPool::GetWorkerMemoryBegin(worker_no);
+    osiris::Core osiris_core(GetInstructionFilename(), worker_executor_config);
+    osiris_core.SetScreeningConfig(command_line_arguments.screening_config);
+    osiris_core.SetNoiseProfile(noise_profile);
+    osiris_core.SetHangBlacklist(kHangBlacklistFile);
+    osiris::ResetCalibration worker_reset_calibration;
+    osiris_core.CalibrateResetExecutions(command_line_arguments.speculation_trigger,
+                                         -command_line_arguments.threshold,
+                                         command_line_arguments.threshold,
+                                         &worker_reset_calibration,
+                                         work_queue);
+    worker_reset_calibration.Save(osiris::WorkerPool::GetPartFilename(calibration_filename,
+                                                                      worker_no));
+    LOG_INFO("worker " + std::to_string(worker_no) + " finished");
+  });
+  if (error) {
+    // an incomplete calibration would be reused by all later runs
+    LOG_ERROR("Not all workers finished the reset calibration. Aborting!");
+    std::exit(1);
+  }
+  if (worker_pool.MergePartFiles(calibration_filename)) {
+    LOG_ERROR("Couldn't merge the reset calibration of the workers. Aborting!");
+    std::exit(1);
+  }
+}
+
+/// Loads the reset calibration given on the command line or creates it if the file does not
+/// exist
+/// \param command_line_arguments parsed command line arguments
+/// \param noise_profile noise profile the thresholds of the calibration are derived from
+/// \return reset calibration (empty if no calibration is used)
+osiris::ResetCalibration LoadOrCreateResetCalibration(
+    const CommandLineArguments& command_line_arguments,
+    const osiris::NoiseProfile& noise_profile) {
+  osiris::ResetCalibration reset_calibration;
+  if (command_line_arguments.filename_reset_calibration.empty()) {
+    return reset_calibration;
+  }
+  if (reset_calibration.Load(command_line_arguments.filename_reset_calibration)) {
+    LOG_INFO("Loaded reset calibration " + command_line_arguments.filename_reset_calibration);
+    return reset_calibration;
+  }
+  LOG_INFO(" === Starting Reset Calibration Stage ===");
+  if (!command_line_arguments.cpu_cores.empty()) {
+    CalibrateResetExecutionsInParallel(command_line_arguments, noise_profile);
+    if (!reset_calibration.Load(command_line_arguments.filename_reset_calibration)) {
+      LOG_ERROR("Couldn't read the merged reset calibration. Aborting!");
+      std::exit(1);
+    }
+    LOG_INFO("Wrote reset calibration to " + command_line_arguments.filename_reset_calibration);
+    return reset_calibration;
+  }
+  osiris::Core osiris_core(GetInstructionFilename(), command_line_arguments.executor_config);
+  osiris_core.SetScreeningConfig(command_line_arguments.screening_config);
+  osiris_core.SetNoiseProfile(noise_profile);
+  osiris_core.SetHangBlacklist(kHangBlacklistFile);
+  osiris_core.CalibrateResetExecutions(command_line_arguments.speculation_trigger,
+                                       -command_line_arguments.threshold,
+                                       command_line_arguments.threshold,
+                                       &reset_calibration);
+  reset_calibration.Save(command_line_arguments.filename_reset_calibration);
+  LOG_INFO("Wrote reset calibration to " + command_line_arguments.filename_reset_calibration);
+  return reset_calibration;
+}
+
 int main(int argc, char* argv[]) {
   if (DEBUGMODE) {
     LOG_WARNING("Started in DEBUGMODE");
@@ -252,12 +890,23 @@ int main(int argc, char* argv[]) {
     LOG_DEBUG("Osiris was compiled for Intel");
 #elif defined(AMD)
     LOG_DEBUG("Osiris was compiled for AMD");
+#else
+    LOG_DEBUG("Osiris was compiled without target architecture");
 #endif
   } else {
     osiris::SetLogLevel(osiris::INFO);
   }
   CommandLineArguments command_line_arguments = ParseArguments(argc, argv);
 
+  //
+  // BENCHMARK FAULT RECOVERY
+  //
+  if (command_line_arguments.benchmark_faults) {
+    LOG_INFO(" === Benchmarking Fault Recovery ===");
+    BenchmarkFaults(command_line_arguments.executor_config);
+    std::exit(0);
+  }
+
   //
   // CONFIRM RESULTS
   //
@@ -267,7 +916,9 @@ int main(int argc, char* argv[]) {
     assert(!command_line_arguments.filename_confirm_output.empty());
     std::string input_file = command_line_arguments.filename_confirm_input;
     std::string output_file = command_line_arguments.filename_confirm_output;
-    ConfirmResultsOfFuzzer(input_file, output_file);
+    ConfirmResultsOfFuzzer(input_file, output_file, command_line_arguments.executor_config,
+                           command_line_arguments.threshold,
+                           LoadOrCreateNoiseProfile(command_line_arguments));
     std::exit(0);
   }
 
@@ -318,16 +969,67 @@ int main(int argc, char* argv[]) {
   //
   if (command_line_arguments.cleanup) {
     LOG_INFO(" === Starting Cleanup Stage ===");
-    osiris::Core osiris_core(kInstructionFile);
+    osiris::Core osiris_core(kInstructionFile, command_line_arguments.executor_config);
     osiris_core.OutputNonFaultingInstructions(kInstructionFileCleaned);
     osiris_core.PrintFaultStatistics();
     exit(0);
   }
 
+  //
+  // COMPILE THE INSTRUCTION DATABASE
+  //
+  if (command_line_arguments.compile_isa) {
+    LOG_INFO(" === Compiling Instruction Database ===");
+    osiris::CodeGenerator code_generator(kInstructionFileCleaned);
+    code_generator.SaveDatabase(kInstructionDatabase);
+    LOG_INFO("Wrote " + std::to_string(code_generator.GetNumberOfInstructions()) +
+        " instructions to " + kInstructionDatabase);
+    exit(0);
+  }
+
+  //
+  // COUNT THE OPERAND VARIANTS
+  //
+  if (command_line_arguments.count_operand_variants) {
+    LOG_INFO(" === Counting Operand Variants ===");
+    CountOperandVariants();
+    exit(0);
+  }
+
   //
   // FUZZING RUNS
   //
-  osiris::Core osiris_core(kInstructionFileCleaned);
+  osiris::NoiseProfile noise_profile = LoadOrCreateNoiseProfile(command_line_arguments);
+  osiris::ResetCalibration reset_calibration =
+      LoadOrCreateResetCalibration(command_line_arguments, noise_profile);
+  if (command_line_arguments.sequence_search) {
+    // drawn before the workers are forked s.t. all of them sample the same sequences
+    std::random_device random_device;
+    command_line_arguments.sequence_search_config.sampling_seed =
+        (static_cast<uint64_t>(random_device()) << 32) | random_device();
+    LOG_INFO("Sampling seed of the sequence search: " +
+        std::to_string(command_line_arguments.sequence_search_config.sampling_seed));
+  }
+  if (!command_line_arguments.cpu_cores.empty()) {
+    LOG_INFO(" === Starting Parallel Fuzzing Stage ===");
+    RunParallelSearch(command_line_arguments.cpu_cores,
+                      command_line_arguments.all,
+                      command_line_arguments.speculation_trigger,
+                      command_line_arguments.threshold,
+                      command_line_arguments.executor_config,
+                      command_line_arguments.screening_config,
+                      noise_profile,
+                      reset_calibration,
+                      command_line_arguments.sequence_search
+                          ? &command_line_arguments.sequence_search_config : nullptr);
+    exit(0);
+  }
+
+  osiris::Core osiris_core(GetInstructionFilename(), command_line_arguments.executor_config);
+  osiris_core.SetScreeningConfig(command_line_arguments.screening_config);
+  osiris_core.SetNoiseProfile(noise_profile);
+  osiris_core.SetResetCalibration(reset_calibration);
+  osiris_core.SetHangBlacklist(kHangBlacklistFile);
   LOG_INFO(" === Starting Main Fuzzing Stage ===");
   if (command_line_arguments.speculation_trigger) {
     LOG_INFO("Searching with transiently executed trigger sequence");
@@ -335,21 +1037,36 @@ int main(int argc, char* argv[]) {
     LOG_INFO("Searching with architecturally executed trigger sequence");
   }
 
-  if (command_line_arguments.all) {
+  if (command_line_arguments.sequence_search) {
+    LOG_INFO("Searching with composed trigger sequence == measurement sequence of " +
+        std::to_string(command_line_arguments.sequence_search_config.constraints.length) +
+        " instructions");
+    if (command_line_arguments.sequence_search_config.operand_variants_per_instruction > 0) {
+      LOG_INFO("Testing up to " + std::to_string(
+          command_line_arguments.sequence_search_config.operand_variants_per_instruction) +
+          " operand variants per instruction");
+    }
+    osiris_core.FindAndOutputSequenceTriggerpairs(
+        kOutputCSVSequences,
+        command_line_arguments.sequence_search_config,
+        command_line_arguments.speculation_trigger,
+        -command_line_arguments.threshold,
+        command_line_arguments.threshold);
+  } else if (command_line_arguments.all) {
     LOG_INFO("Searching with trigger sequence != measurement sequence");
     LOG_INFO("This search is expected to take a few days!");
     osiris_core.FindAndOutputTriggerpairsWithoutAssumptions(
         kOutputCSVNoAssumptions,
         command_line_arguments.speculation_trigger,
-        50);
+        command_line_arguments.threshold);
   } else {
     LOG_INFO("Searching with trigger sequence == measurement sequence");
     osiris_core.FindAndOutputTriggerpairsWithTriggerEqualsMeasurement(
         kOutputFolderTriggerEqualsMeasurement,
         kOutputCSVTriggerEqualsMeasurement,
         command_line_arguments.speculation_trigger,
-        -50,
-        50);
+        -command_line_arguments.threshold,
+        command_line_arguments.threshold);
     osiris_core.FormatTriggerPairOutput(kOutputFolderTriggerEqualsMeasurement,
                                         kOutputFolderFormattedTriggerEqualsMeasurement);
   }
@@ -0,0 +1,117 @@
+// Copyright 2021 Daniel Weber, Ahmad Ibrahim, Hamed Nemati, Michael Schwarz, Christian Rossow
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+
+
+#include "reset_calibration.h"
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#include "executor.h"
+#include "logger.h"
+#include "utils.h"
+
+namespace osiris {
+
+const char kResetCalibrationHeaderline[] = "trigger-uid;reset-uid;executions-amount";
+
+bool ResetCalibration::Load(const std::string& filename) {
+  std::ifstream calibration_file(filename);
+  if (!calibration_file.is_open()) {
+    return false;
+  }
+  std::string line;
+  std::getline(calibration_file, line);
+  if (line != kResetCalibrationHeaderline) {
+    LOG_ERROR("Mismatch in the header line of the reset calibration " + filename +
+        ". Aborting!");
+    std::exit(1);
+  }
+  pair_executions_amounts_.clear();
+  reset_executions_amounts_.clear();
+  while (std::getline(calibration_file, line)) {
+    std::vector<std::string> line_splitted = SplitString(line, ';');
+    uint64_t trigger_uid;
+    uint64_t reset_uid;
+    int64_t executions_amount;
+    if (line_splitted.size() != 3 ||
+        !ParseUnsignedNumber(line_splitted[0], 16, &trigger_uid) ||
+        !ParseUnsignedNumber(line_splitted[1], 16, &reset_uid) ||
+        !ParseSignedNumber(line_splitted[2], &executions_amount)) {
+      LOG_ERROR("Malformed line in the reset calibration " + filename + ". Aborting!");
+      std::exit(1);
+    }
+    if (executions_amount < 1 || executions_amount > kMaxSequenceExecutions) {
+      LOG_ERROR("Amount of executions out of range [1, " +
+          std::to_string(kMaxSequenceExecutions) + "] in the reset calibration " + filename +
+          ". Aborting!");
+      std::exit(1);
+    }
+    SetExecutionsAmount(trigger_uid, reset_uid, static_cast<int>(executions_amount));
+  }
+  return true;
+}
+
+void ResetCalibration::Save(const std::string& filename) const {
+  std::ofstream calibration_file(filename);
+  if (!calibration_file.is_open()) {
+    LOG_ERROR("Couldn't open " + filename + " for writing. Aborting!");
+    std::exit(1);
+  }
+  calibration_file << kResetCalibrationHeaderline << std::endl;
+  for (const auto& [uids, executions_amount] : pair_executions_amounts_) {
+    calibration_file << std::hex << uids.first << ";" << uids.second << std::dec << ";"
+                     << executions_amount << std::endl;
+  }
+}
+
+void ResetCalibration::SetExecutionsAmount(uint64_t trigger_uid, uint64_t reset_uid,
+                                           int executions_amount) {
+  pair_executions_amounts_[{trigger_uid, reset_uid}] = executions_amount;
+  int& reset_executions_amount = reset_executions_amounts_[reset_uid];
+  reset_executions_amount = std::max(reset_executions_amount, executions_amount);
+}
+
+bool ResetCalibration::IsEmpty() const {
+  return pair_executions_amounts_.empty();
+}
+
+int ResetCalibration::GetExecutionsAmount(uint64_t trigger_uid, uint64_t reset_uid,
+                                          int default_amount) const {
+  auto entry = pair_executions_amounts_.find({trigger_uid, reset_uid});
+  if (entry == pair_executions_amounts_.end()) {
+    return GetExecutionsAmount(reset_uid, default_amount);
+  }
+  return entry->second;
+}
+
+int ResetCalibration::GetPairExecutionsAmount(uint64_t trigger_uid, uint64_t reset_uid,
+                                              int default_amount) const {
+  auto entry = pair_executions_amounts_.find({trigger_uid, reset_uid});
+  if (entry == pair_executions_amounts_.end()) {
+    return default_amount;
+  }
+  return entry->second;
+}
+
+int ResetCalibration::GetExecutionsAmount(uint64_t reset_uid, int default_amount) const {
+  auto entry = reset_executions_amounts_.find(reset_uid);
+  if (entry == reset_executions_amounts_.end()) {
+    return default_amount;
+  }
+  return entry->second;
+}
+
+}  // namespace osiris
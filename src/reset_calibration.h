@@ -0,0 +1,82 @@
+// Copyright 2021 Daniel Weber, Ahmad Ibrahim, Hamed Nemati, Michael Schwarz, Christian Rossow
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+
+
+#ifndef OSIRIS_SRC_RESET_CALIBRATION_H_
+#define OSIRIS_SRC_RESET_CALIBRATION_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace osiris {
+
+///
+/// Persistent per-(trigger, reset) table of the smallest number of back-to-back executions of
+/// the reset sequence that reliably resets the effect of the trigger sequence. A reset
+/// sequence on its own uses the largest amount over all triggers it was calibrated with.
+///
+class ResetCalibration {
+ public:
+  /// Loads a calibration written by Save
+  /// \param filename calibration file
+  /// \return false if the file does not exist
+  bool Load(const std::string& filename);
+
+  /// Writes the calibration to a file
+  /// \param filename calibration file
+  void Save(const std::string& filename) const;
+
+  /// Adds or replaces the amount of a (trigger, reset) pair
+  /// \param trigger_uid UID of the trigger sequence
+  /// \param reset_uid UID of the reset sequence
+  /// \param executions_amount smallest amount of executions that resets the trigger sequence
+  void SetExecutionsAmount(uint64_t trigger_uid, uint64_t reset_uid, int executions_amount);
+
+  /// \return true if no pair is calibrated
+  bool IsEmpty() const;
+
+  /// Returns how often the reset sequence has to be executed to reset the trigger sequence
+  /// \param trigger_uid UID of the trigger sequence
+  /// \param reset_uid UID of the reset sequence
+  /// \param default_amount amount used if neither the pair nor the reset sequence is calibrated
+  /// \return amount of executions (the one of the reset sequence if only it is calibrated)
+  int GetExecutionsAmount(uint64_t trigger_uid, uint64_t reset_uid, int default_amount) const;
+
+  /// Returns how often the reset sequence has to be executed to reset the trigger sequence if
+  /// exactly this pair is calibrated
+  /// \param trigger_uid UID of the trigger sequence
+  /// \param reset_uid UID of the reset sequence
+  /// \param default_amount amount used if the pair is not calibrated
+  /// \return amount of executions
+  int GetPairExecutionsAmount(uint64_t trigger_uid, uint64_t reset_uid,
+                              int default_amount) const;
+
+  /// Returns how often the reset sequence has to be executed to reset all triggers it was
+  /// calibrated with
+  /// \param reset_uid UID of the reset sequence
+  /// \param default_amount amount used if the reset sequence is not calibrated
+  /// \return amount of executions
+  int GetExecutionsAmount(uint64_t reset_uid, int default_amount) const;
+
+ private:
+  std::map<std::pair<uint64_t, uint64_t>, int> pair_executions_amounts_;
+  std::unordered_map<uint64_t, int> reset_executions_amounts_;
+};
+
+}  // namespace osiris
+
+#endif //OSIRIS_SRC_RESET_CALIBRATION_H_
@@ -0,0 +1,168 @@
+// Copyright 2021 Daniel Weber, Ahmad Ibrahim, Hamed Nemati, Michael Schwarz, Christian Rossow
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+
+
+#include "statistics.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace osiris {
+
+// quantile of the standard normal distribution for a two-sided 95% confidence interval
+constexpr double kConfidenceQuantile = 1.96;
+
+/// Returns the median of sorted values
+/// \param sorted sorted values
+/// \param length number of values
+/// \return median
+static double SortedMedian(const int64_t* sorted, size_t length) {
+  if (length == 0) {
+    return 0;
+  }
+  if (length % 2 == 0) {
+    return (static_cast<double>(sorted[length / 2 - 1]) +
+        static_cast<double>(sorted[length / 2])) / 2;
+  }
+  return static_cast<double>(sorted[length / 2]);
+}
+
+/// Returns the median absolute deviation of sorted values from a center. The deviations left
+/// and right of the center are sorted on their own, hence merging both sides from the center
+/// outwards yields them in ascending order without any allocation.
+/// \param sorted sorted values
+/// \param length number of values
+/// \param center value the deviations refer to
+/// \return median absolute deviation
+static double SortedMedianAbsoluteDeviation(const int64_t* sorted, size_t length,
+                                            double center) {
+  if (length == 0) {
+    return 0;
+  }
+  size_t left = std::lower_bound(sorted, sorted + length, center) - sorted;
+  size_t right = left;
+  double previous_deviation = 0;
+  double deviation = 0;
+  for (size_t rank = 0; rank <= length / 2; rank++) {
+    previous_deviation = deviation;
+    if (left > 0 &&
+        (right == length || center - sorted[left - 1] <= sorted[right] - center)) {
+      left--;
+      deviation = center - static_cast<double>(sorted[left]);
+    } else {
+      deviation = static_cast<double>(sorted[right]) - center;
+      right++;
+    }
+  }
+  return length % 2 == 0 ? (previous_deviation + deviation) / 2 : deviation;
+}
+
+double QuantileInPlace(std::vector<int64_t>* values, double quantile) {
+  if (values->empty()) {
+    return 0;
+  }
+  double position = quantile * static_cast<double>(values->size() - 1);
+  auto lower_index = static_cast<size_t>(position);
+  auto lower = values->begin() + lower_index;
+  std::nth_element(values->begin(), lower, values->end());
+  double fraction = position - static_cast<double>(lower_index);
+  if (fraction == 0) {
+    return static_cast<double>(*lower);
+  }
+  // all larger values are behind the selected one
+  double upper = static_cast<double>(*std::min_element(lower + 1, values->end()));
+  return static_cast<double>(*lower) + fraction * (upper - static_cast<double>(*lower));
+}
+
+SampleStatistics ComputeSampleStatistics(std::vector<int64_t>* samples) {
+  SampleStatistics statistics;
+  if (samples->empty()) {
+    return statistics;
+  }
+  std::sort(samples->begin(), samples->end());
+
+  // outliers are at both ends of the sorted samples
+  const int64_t* begin = samples->data();
+  const int64_t* end = begin + samples->size();
+  double median = SortedMedian(begin, samples->size());
+  double scale = std::max(
+      kMADToStandardDeviation * SortedMedianAbsoluteDeviation(begin, samples->size(), median),
+      1.0);
+  auto max_outliers_per_end =
+      static_cast<size_t>(static_cast<double>(samples->size()) * kMaxOutlierFraction);
+  const int64_t* inliers_begin = std::min(
+      std::lower_bound(begin, end, median - kOutlierMADs * scale), begin + max_outliers_per_end);
+  const int64_t* inliers_end = std::max(
+      std::upper_bound(begin, end, median + kOutlierMADs * scale), end - max_outliers_per_end);
+  auto length = static_cast<size_t>(inliers_end - inliers_begin);
+
+  statistics.no_samples = static_cast<int>(length);
+  statistics.no_outliers = static_cast<int>(samples->size() - length);
+  statistics.median = SortedMedian(inliers_begin, length);
+  statistics.median_absolute_deviation =
+      SortedMedianAbsoluteDeviation(inliers_begin, length, statistics.median);
+
+  auto trimmed = static_cast<size_t>(static_cast<double>(length) * kTrimmedFraction);
+  double sum = 0;
+  for (size_t i = trimmed; i < length - trimmed; i++) {
+    sum += static_cast<double>(inliers_begin[i]);
+  }
+  statistics.trimmed_mean = sum / static_cast<double>(length - 2 * trimmed);
+
+  // the ranks of the bounds follow from the binomial distribution of the number of samples
+  // below the true median (normal approximation)
+  auto all_samples = static_cast<double>(samples->size());
+  double half_width = kConfidenceQuantile * std::sqrt(all_samples) / 2;
+  double lower_rank = std::floor(all_samples / 2 - half_width);
+  double upper_rank = std::ceil(all_samples / 2 + half_width);
+  statistics.median_lower_bound =
+      static_cast<double>(begin[static_cast<size_t>(std::max(lower_rank, 0.0))]);
+  statistics.median_upper_bound = static_cast<double>(
+      begin[static_cast<size_t>(std::min(upper_rank, all_samples - 1))]);
+  return statistics;
+}
+
+SequentialEffectTest::SequentialEffectTest(double error_rate, int64_t negative_threshold,
+                                           int64_t positive_threshold)
+    : negative_limit_(static_cast<double>(negative_threshold) / 2),
+      positive_limit_(static_cast<double>(positive_threshold) / 2) {
+  double false_effect_rate = error_rate / 2;
+  double missed_effect_rate = error_rate;
+  effect_bound_ = std::log((1 - missed_effect_rate) / false_effect_rate);
+  no_effect_bound_ = std::log(missed_effect_rate / (1 - false_effect_rate));
+}
+
+void SequentialEffectTest::AddDifference(double difference) {
+  negative_log_likelihood_ratio_ += GetLogLikelihoodRatio(difference < negative_limit_);
+  positive_log_likelihood_ratio_ += GetLogLikelihoodRatio(difference > positive_limit_);
+}
+
+SequentialEffectTest::Decision SequentialEffectTest::GetDecision() const {
+  if (negative_log_likelihood_ratio_ >= effect_bound_ ||
+      positive_log_likelihood_ratio_ >= effect_bound_) {
+    return Decision::EFFECT;
+  }
+  if (negative_log_likelihood_ratio_ <= no_effect_bound_ &&
+      positive_log_likelihood_ratio_ <= no_effect_bound_) {
+    return Decision::NO_EFFECT;
+  }
+  return Decision::UNDECIDED;
+}
+
+double SequentialEffectTest::GetLogLikelihoodRatio(bool exceeds_limit) {
+  return exceeds_limit ? std::log(kEffectProbability / kNoEffectProbability)
+                       : std::log((1 - kEffectProbability) / (1 - kNoEffectProbability));
+}
+
+}  // namespace osiris
@@ -0,0 +1,126 @@
+// Copyright 2021 Daniel Weber, Ahmad Ibrahim, Hamed Nemati, Michael Schwarz, Christian Rossow
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+
+
+#ifndef OSIRIS_SRC_STATISTICS_H_
+#define OSIRIS_SRC_STATISTICS_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace osiris {
+
+///
+/// Robust summary of a set of samples (e.g. timings of a code page).
+/// All values except no_outliers and the confidence interval refer to the samples that remain
+/// after outlier rejection.
+///
+struct SampleStatistics {
+  double median = 0;
+
+  /// mean of the samples without the lowest and highest kTrimmedFraction of them
+  double trimmed_mean = 0;
+
+  /// median of the absolute deviations from the median (unscaled)
+  double median_absolute_deviation = 0;
+
+  /// distribution-free 95% confidence interval of the median (of all samples s.t. rejecting
+  /// outliers can not narrow it)
+  double median_lower_bound = 0;
+  double median_upper_bound = 0;
+
+  int no_samples = 0;
+  int no_outliers = 0;
+};
+
+///
+/// fraction of the samples that is cut off at each end for SampleStatistics::trimmed_mean
+///
+constexpr double kTrimmedFraction = 0.1;
+
+///
+/// scales the MAD to the standard deviation of normally distributed samples
+///
+constexpr double kMADToStandardDeviation = 1.4826;
+
+///
+/// samples that are more than this many (normal-consistent) MADs away from the median are
+/// rejected as outliers (e.g. interrupts during the measurement)
+///
+constexpr double kOutlierMADs = 5;
+
+///
+/// maximum fraction of the samples rejected as outliers at each end. Timings are integers,
+/// hence the MAD of a narrow distribution is 0 and kOutlierMADs alone would reject every
+/// sample that is a few cycles away from the median.
+///
+constexpr double kMaxOutlierFraction = 0.05;
+
+/// Computes the quantile of the given values by selection (linear time, no allocation)
+/// \param values values (gets reordered)
+/// \param quantile quantile in [0, 1] (e.g. 0.5 for the median)
+/// \return quantile (linearly interpolated between neighboring values; 0 if values is empty)
+double QuantileInPlace(std::vector<int64_t>* values, double quantile);
+
+/// Computes robust statistics of the given samples without any heap allocation
+/// \param samples samples (get sorted in place)
+/// \return statistics
+SampleStatistics ComputeSampleStatistics(std::vector<int64_t>* samples);
+
+///
+/// Wald's sequential probability ratio test on paired differences. Every difference is
+/// reduced to whether it exceeds half of the effect threshold of a direction; this happens
+/// with a probability of at most kNoEffectProbability if there is no effect and at least
+/// kEffectProbability if the effect reaches the threshold. Both directions are tested with
+/// half of the error rate each.
+///
+class SequentialEffectTest {
+ public:
+  enum class Decision {
+    UNDECIDED,
+    NO_EFFECT,
+    EFFECT
+  };
+
+  /// \param error_rate probability of a wrong decision (both false and missed effects)
+  /// \param negative_threshold negative difference that counts as effect
+  /// \param positive_threshold positive difference that counts as effect
+  SequentialEffectTest(double error_rate, int64_t negative_threshold,
+                       int64_t positive_threshold);
+
+  /// Adds the difference of one pair of samples
+  /// \param difference difference
+  void AddDifference(double difference);
+
+  /// Returns the decision based on all differences added so far
+  /// \return decision
+  Decision GetDecision() const;
+
+ private:
+  static constexpr double kNoEffectProbability = 0.25;
+  static constexpr double kEffectProbability = 0.75;
+
+  static double GetLogLikelihoodRatio(bool exceeds_limit);
+
+  double negative_limit_;
+  double positive_limit_;
+  double effect_bound_;
+  double no_effect_bound_;
+  double negative_log_likelihood_ratio_ = 0;
+  double positive_log_likelihood_ratio_ = 0;
+};
+
+}  // namespace osiris
+
+#endif //OSIRIS_SRC_STATISTICS_H_
@@ -18,8 +18,10 @@
 #include <openssl/sha.h>
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <iomanip>
+#include <stdexcept>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -55,6 +57,16 @@ byte_array NumberToBytesLE(uint64_t number, size_t result_length) {
   return bytes;
 }
 
+uint64_t CalculateHashFNV1a(const void* data, size_t length, uint64_t hash) {
+  constexpr uint64_t kFNVPrime = 0x100000001b3;
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= kFNVPrime;
+  }
+  return hash;
+}
+
 std::vector<std::string> SplitString(const std::string& input_str, char delimiter) {
   std::string delims;
   delims += delimiter;
@@ -75,6 +87,40 @@ std::vector<std::string> SplitString(const std::string& input_str, char delimite
   return results;
 }
 
+bool ParseUnsignedNumber(const std::string& field, int base, uint64_t* number) {
+  // std::stoull silently negates numbers with a minus sign
+  if (field.empty() || field[0] == '-' || field[0] == '+') {
+    return false;
+  }
+  size_t parsed_characters = 0;
+  try {
+    *number = std::stoull(field, &parsed_characters, base);
+  } catch (const std::logic_error&) {
+    return false;
+  }
+  return parsed_characters == field.size();
+}
+
+bool ParseSignedNumber(const std::string& field, int64_t* number) {
+  size_t parsed_characters = 0;
+  try {
+    *number = std::stoll(field, &parsed_characters, 10);
+  } catch (const std::logic_error&) {
+    return false;
+  }
+  return parsed_characters == field.size();
+}
+
+bool ParseFiniteNumber(const std::string& field, double* number) {
+  size_t parsed_characters = 0;
+  try {
+    *number = std::stod(field, &parsed_characters);
+  } catch (const std::logic_error&) {
+    return false;
+  }
+  return parsed_characters == field.size() && std::isfinite(*number);
+}
+
 /*
    base64.cpp and base64.h
 
@@ -156,7 +202,7 @@ byte_array base64_decode(std::string const& encoded_string) {
   return ret;
 }
 
-std::string base64_encode(const byte_array& bytes_to_encode) {
+std::string base64_encode(ByteView bytes_to_encode) {
   size_t len_encoded = (bytes_to_encode.size() + 2) / 3 * 4;
   unsigned char trailing_char = '=';
   std::string ret;
@@ -16,7 +16,8 @@
 #ifndef OSIRIS_SRC_UTILS_H_
 #define OSIRIS_SRC_UTILS_H_
 
-#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -27,6 +28,31 @@ namespace osiris {
 ///
 using byte_array = std::vector<std::byte>;
 
+///
+/// non-owning view of contiguous bytes (e.g. of a byte_array or of the instruction table)
+///
+class ByteView {
+ public:
+  ByteView() = default;
+  ByteView(const std::byte* data, size_t size) : data_(data), size_(size) {}
+  // implicit on purpose such that every byte_array can be passed where a view is expected
+  ByteView(const byte_array& bytes) : data_(bytes.data()), size_(bytes.size()) {}  // NOLINT
+
+  const std::byte* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const std::byte* begin() const { return data_; }
+  const std::byte* end() const { return data_ + size_; }
+  const std::byte& operator[](size_t idx) const { return data_[idx]; }
+
+  /// \return owning copy of the viewed bytes
+  byte_array ToByteArray() const { return byte_array(begin(), end()); }
+
+ private:
+  const std::byte* data_ = nullptr;
+  size_t size_ = 0;
+};
+
 /// Create ByteArray
 /// \param byte_arr bytes as char array
 /// \param arr_len char array length
@@ -44,6 +70,25 @@ std::string BytearrayToString(const osiris::byte_array& bytes);
 /// \return vector of splitted strings
 std::vector<std::string> SplitString(const std::string& input_str, char delimiter);
 
+/// Parses a whole field (e.g. of a line of a csv file) as unsigned number
+/// \param field field to parse
+/// \param base base of the number
+/// \param number outputs the number
+/// \return false if the field is not a number (or only starts with one)
+bool ParseUnsignedNumber(const std::string& field, int base, uint64_t* number);
+
+/// Parses a whole field as signed decimal number
+/// \param field field to parse
+/// \param number outputs the number
+/// \return false if the field is not a number (or only starts with one)
+bool ParseSignedNumber(const std::string& field, int64_t* number);
+
+/// Parses a whole field as finite floating point number
+/// \param field field to parse
+/// \param number outputs the number
+/// \return false if the field is not a finite number (or only starts with one)
+bool ParseFiniteNumber(const std::string& field, double* number);
+
 /// Encodes a number in Little Endian format
 /// \param number number
 /// \param result_length byte length of the result
@@ -58,29 +103,20 @@ byte_array base64_decode(std::string const& encoded_string);
 /// Encodes ByteArray as base64 string
 /// \param bytes_to_encode ByteArray to encode
 /// \return base64 string
-std::string base64_encode(const byte_array& bytes_to_encode);
+std::string base64_encode(ByteView bytes_to_encode);
 
 /// Calculate the SHA256 hash of a given file
 /// \param filename filename to calculate hash from
 /// \return upon failure returns empty string
 std::string CalculateFileHashSHA256(const std::string& filename);
 
-/// Calculates the median of a given vector
-/// \tparam T type of the vector elements
-/// \param values list of values
-/// \return median
-template<class T>
-double median(std::vector<T> values) {
-  if (values.empty()) {
-    return 0;
-  }
-  std::sort(values.begin(), values.end());
-  if (values.size() % 2 == 0) {
-    return static_cast<double>((values[(values.size() - 1) / 2] + values[values.size() / 2])) / 2;
-  } else {
-    return values[values.size() / 2];
-  }
-}
+/// Calculates the 64-bit FNV-1a hash of the given bytes
+/// \param data bytes to hash
+/// \param length number of bytes to hash
+/// \param hash hash value to continue from (allows hashing multiple buffers into one value)
+/// \return hash value
+uint64_t CalculateHashFNV1a(const void* data, size_t length,
+                            uint64_t hash = 0xcbf29ce484222325);
 
 }  // namespace osiris
 
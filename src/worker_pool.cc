@@ -0,0 +1,199 @@
+// Copyright 2021 Daniel Weber, Ahmad Ibrahim, Hamed Nemati, Michael Schwarz, Christian Rossow
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+
+
+#include "worker_pool.h"
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <new>
+
+#include "code_generator.h"
+#include "logger.h"
+#include "utils.h"
+
+namespace osiris {
+
+// the counter is shared between processes hence it must not rely on a lock
+static_assert(std::atomic<size_t>::is_always_lock_free);
+
+WorkQueue::WorkQueue(bool shared) : shared_(shared) {
+  if (shared_) {
+    void* memory = mmap(nullptr,
+                        sizeof(std::atomic<size_t>),
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS,
+                        -1,
+                        0);
+    if (memory == MAP_FAILED) {
+      LOG_ERROR("Couldn't allocate shared memory for the work queue. Aborting!");
+      std::exit(1);
+    }
+    next_work_item_ = new(memory) std::atomic<size_t>(0);
+  } else {
+    next_work_item_ = new std::atomic<size_t>(0);
+  }
+}
+
+WorkQueue::~WorkQueue() {
+  if (shared_) {
+    munmap(next_work_item_, sizeof(std::atomic<size_t>));
+  } else {
+    delete next_work_item_;
+  }
+}
+
+bool WorkQueue::Next(size_t end, size_t* work_item) {
+  size_t next_work_item = next_work_item_->fetch_add(1);
+  if (next_work_item >= end) {
+    return false;
+  }
+  *work_item = next_work_item;
+  return true;
+}
+
+WorkerPool::WorkerPool(std::vector<int> cpu_cores) : cpu_cores_(std::move(cpu_cores)) {
+  if (cpu_cores_.empty()) {
+    LOG_ERROR("Worker pool needs at least one CPU core. Aborting!");
+    std::exit(1);
+  }
+  // the memory ranges of all workers are encoded as sign-extended 32-bit immediates
+  if (GetWorkerMemoryBegin(GetNumberOfWorkers()) >= (1ull << 31)) {
+    LOG_ERROR("Too many workers for the available memory ranges. Aborting!");
+    std::exit(1);
+  }
+}
+
+int WorkerPool::Run(const std::function<void(int, WorkQueue*)>& worker_function) {
+  WorkQueue work_queue(true);
+  std::vector<pid_t> worker_pids;
+
+  // flush buffered output as it would be duplicated in every worker otherwise
+  std::cout.flush();
+  std::fflush(nullptr);
+  for (int worker_no = 0; worker_no < GetNumberOfWorkers(); worker_no++) {
+    pid_t pid = fork();
+    if (pid == -1) {
+      LOG_ERROR("Couldn't fork worker " + std::to_string(worker_no) + ". Aborting!");
+      std::exit(1);
+    }
+    if (pid == 0) {
+      // worker process
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      CPU_SET(cpu_cores_[worker_no], &cpu_set);
+      if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+        LOG_ERROR("Couldn't pin worker " + std::to_string(worker_no) + " to CPU core " +
+            std::to_string(cpu_cores_[worker_no]) + ". Aborting!");
+        std::_Exit(1);
+      }
+      LOG_INFO("worker " + std::to_string(worker_no) + " started on CPU core " +
+          std::to_string(cpu_cores_[worker_no]));
+      worker_function(worker_no, &work_queue);
+      std::cout.flush();
+      std::fflush(nullptr);
+      // do not run the exit handlers of the parent process
+      std::_Exit(0);
+    }
+    worker_pids.push_back(pid);
+  }
+
+  int failed_workers = 0;
+  for (size_t worker_no = 0; worker_no < worker_pids.size(); worker_no++) {
+    int status;
+    if (waitpid(worker_pids[worker_no], &status, 0) == -1 ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      // the work item the worker was processing is lost
+      LOG_ERROR("Worker " + std::to_string(worker_no) + " did not exit successfully.");
+      failed_workers++;
+    }
+  }
+  return failed_workers == 0 ? 0 : 1;
+}
+
+int WorkerPool::GetNumberOfWorkers() const {
+  return static_cast<int>(cpu_cores_.size());
+}
+
+uint64_t WorkerPool::GetWorkerMemoryBegin(int worker_no) {
+  return kMemoryBegin + worker_no * kWorkerMemoryStride;
+}
+
+std::string WorkerPool::GetPartFilename(const std::string& filename, int worker_no) {
+  return filename + ".part" + std::to_string(worker_no);
+}
+
+int WorkerPool::MergePartFiles(const std::string& filename) const {
+  std::ofstream output_file(filename);
+  if (output_file.fail()) {
+    LOG_ERROR("Couldn't open " + filename + " for writing.");
+    return 1;
+  }
+  bool headerline_written = false;
+  for (int worker_no = 0; worker_no < GetNumberOfWorkers(); worker_no++) {
+    std::string part_filename = GetPartFilename(filename, worker_no);
+    std::ifstream part_file(part_filename);
+    if (part_file.fail()) {
+      // e.g. the worker failed before it created its output
+      LOG_WARNING("Couldn't open " + part_filename + " for merging. Skipping it.");
+      continue;
+    }
+    std::string line;
+    bool is_headerline = true;
+    while (std::getline(part_file, line)) {
+      if (!is_headerline || !headerline_written) {
+        output_file << line << std::endl;
+        headerline_written = true;
+      }
+      is_headerline = false;
+    }
+    part_file.close();
+    std::remove(part_filename.c_str());
+  }
+  return 0;
+}
+
+std::vector<int> ParseCPUList(const std::string& cpu_list) {
+  std::vector<int> cpu_cores;
+  for (const std::string& entry : SplitString(cpu_list, ',')) {
+    std::vector<std::string> range = SplitString(entry, '-');
+    try {
+      if (range.size() == 1) {
+        cpu_cores.push_back(std::stoi(range[0]));
+      } else if (range.size() == 2) {
+        int first_core = std::stoi(range[0]);
+        int last_core = std::stoi(range[1]);
+        if (first_core > last_core) {
+          return {};
+        }
+        for (int core = first_core; core <= last_core; core++) {
+          cpu_cores.push_back(core);
+        }
+      } else {
+        return {};
+      }
+    } catch (const std::logic_error&) {
+      return {};
+    }
+  }
+  return cpu_cores;
+}
+
+}  // namespace osiris
@@ -0,0 +1,106 @@
+// Copyright 2021 Daniel Weber, Ahmad Ibrahim, Hamed Nemati, Michael Schwarz, Christian Rossow
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+
+
+#ifndef OSIRIS_SRC_WORKER_POOL_H_
+#define OSIRIS_SRC_WORKER_POOL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace osiris {
+
+///
+/// distance between the memory ranges of two workers (see WorkerPool::GetWorkerMemoryBegin)
+///
+constexpr uint64_t kWorkerMemoryStride = 0x100000;
+
+///
+/// Hands out consecutive work items (e.g. instruction indexes) one at a time.
+/// A shared queue lives in shared memory s.t. all worker processes forked after its creation
+/// draw from the same counter, which balances the load dynamically.
+///
+class WorkQueue {
+ public:
+  /// \param shared place the queue in memory that is shared with forked processes
+  explicit WorkQueue(bool shared = false);
+  ~WorkQueue();
+
+  WorkQueue(const WorkQueue&) = delete;
+  WorkQueue& operator=(const WorkQueue&) = delete;
+
+  /// Takes the next work item
+  /// \param end number of work items (the same for all users of the queue)
+  /// \param work_item outputs the taken work item
+  /// \return false if all work items were already taken
+  bool Next(size_t end, size_t* work_item);
+
+ private:
+  std::atomic<size_t>* next_work_item_;
+  bool shared_;
+};
+
+///
+/// Runs the same work in one forked process per CPU core.
+/// Every worker is pinned to its core and has its own Executor state (memory, code pages
+/// and fault handling) as they do not share an address space.
+///
+class WorkerPool {
+ public:
+  /// \param cpu_cores cores to run a worker on (one worker per entry)
+  explicit WorkerPool(std::vector<int> cpu_cores);
+
+  /// Forks one worker per core and waits until all of them exited
+  /// \param worker_function work of each worker; gets the number of the worker and the queue
+  ///     shared by all workers
+  /// \return 0 if all workers exited successfully
+  int Run(const std::function<void(int worker_no, WorkQueue* work_queue)>& worker_function);
+
+  /// returns the number of workers
+  int GetNumberOfWorkers() const;
+
+  /// Returns the start of the memory range accessed by the instructions of a worker.
+  /// Workers use distinct ranges s.t. their memory accesses do not alias when they run on
+  /// sibling hyperthreads.
+  /// \param worker_no number of the worker
+  /// \return address to use as ExecutorConfig::data_memory_begin
+  static uint64_t GetWorkerMemoryBegin(int worker_no);
+
+  /// Returns the name of the file a worker writes its part of the output to
+  /// \param filename name of the merged output file
+  /// \param worker_no number of the worker
+  /// \return name of the part file
+  static std::string GetPartFilename(const std::string& filename, int worker_no);
+
+  /// Merges the csv part files of all workers into one file and deletes them afterwards
+  /// (the headerline is only taken from the first part; missing parts are skipped)
+  /// \param filename name of the merged output file
+  /// \return 0 on success
+  int MergePartFiles(const std::string& filename) const;
+
+ private:
+  std::vector<int> cpu_cores_;
+};
+
+/// Parses a list of CPU cores (e.g. "2,4-7")
+/// \param cpu_list comma separated list of cores and inclusive core ranges
+/// \return list of cores (empty on parsing errors)
+std::vector<int> ParseCPUList(const std::string& cpu_list);
+
+}  // namespace osiris
+
+#endif  //OSIRIS_SRC_WORKER_POOL_H_